@@ -0,0 +1,352 @@
+#define DT_DRV_COMPAT zephyr_dmic_sim
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/audio/dmic.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+#include <errno.h>
+#include <nsi_host_trampolines.h>
+#include "cmdline.h"
+#include "soc.h"
+
+LOG_MODULE_REGISTER(dmic_sim, CONFIG_AUDIO_DMIC_LOG_LEVEL);
+
+//The command line options are global, so there is one simulated microphone
+BUILD_ASSERT(DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) == 1, "One zephyr,dmic-sim node is supported");
+
+#define DMIC_SIM_QUEUE_LEN 8
+#define DMIC_SIM_STACK_SIZE 2048
+#define DMIC_SIM_PRIORITY 1 //Above the capture thread, as the PDM interrupt is
+#define DMIC_SIM_FREE_RUN_WAIT K_MSEC(100)
+#define DMIC_SIM_HOST_O_RDONLY 0
+
+struct dmic_sim_config {
+	const char *wav_path;
+	uint32_t speed;
+	bool loop;
+};
+
+struct dmic_sim_data {
+	struct k_mem_slab *mem_slab;
+	size_t block_size;
+	uint32_t pcm_rate;
+	int fd;
+	uint32_t data_left; //Bytes of PCM left in the file
+	bool configured;
+	atomic_t running;
+	struct k_msgq queue;
+	void *queue_buf[DMIC_SIM_QUEUE_LEN];
+	struct k_sem start;
+	struct k_thread thread;
+	K_KERNEL_STACK_MEMBER(stack, DMIC_SIM_STACK_SIZE);
+	uint32_t blocks;
+	uint32_t overruns;
+	uint32_t rewinds;
+};
+
+static char *_wav_arg;
+static uint32_t _speed_arg = UINT32_MAX;
+
+static struct args_struct_t _dmic_sim_args[] = {
+	{ .option = "dmic-wav", .name = "path", .type = 's', .dest = (void *)&_wav_arg,
+	  .descript = "16 bit mono WAV file played by the simulated microphone" },
+	{ .option = "dmic-speed", .name = "factor", .type = 'u', .dest = (void *)&_speed_arg,
+	  .descript = "Capture pace: 1 real time, N times faster, 0 as fast as the pipeline takes blocks" },
+	ARG_TABLE_ENDMARKER
+};
+
+static void _register_args(void)
+{
+	native_add_command_line_opts(_dmic_sim_args);
+}
+NATIVE_TASK(_register_args, PRE_BOOT_1, 1);
+
+static uint32_t _speed(const struct dmic_sim_config *cfg)
+{
+	return (_speed_arg != UINT32_MAX) ? _speed_arg : cfg->speed;
+}
+
+static int _read_all(int fd, void *buf, size_t len)
+{
+	return (nsi_host_read(fd, buf, len) == (long)len) ? 0 : -EIO;
+}
+
+static int _skip(int fd, uint32_t len)
+{
+	uint8_t tmp[64];
+
+	while (len > 0) {
+		uint32_t n = MIN(len, sizeof(tmp));
+
+		if (_read_all(fd, tmp, n)) {
+			return -EIO;
+		}
+		len -= n;
+	}
+	return 0;
+}
+
+static void _close_wav(struct dmic_sim_data *data)
+{
+	if (data->fd >= 0) {
+		nsi_host_close(data->fd);
+		data->fd = -1;
+	}
+}
+
+//Walks the RIFF chunks up to the PCM data, which must match what the DMIC was configured for
+static int _open_wav(struct dmic_sim_data *data, const char *path)
+{
+	uint8_t riff[12];
+	bool has_fmt = false;
+	int ret = -EIO;
+
+	_close_wav(data);
+	int fd = nsi_host_open(path, DMIC_SIM_HOST_O_RDONLY);
+
+	if (fd < 0) {
+		LOG_ERR("Can't open %s", path);
+		return -ENOENT;
+	}
+	if (_read_all(fd, riff, sizeof(riff)) || memcmp(riff, "RIFF", 4) || memcmp(&riff[8], "WAVE", 4)) {
+		goto bad;
+	}
+	for (;;) {
+		uint8_t chunk[8];
+
+		if (_read_all(fd, chunk, sizeof(chunk))) {
+			goto bad;
+		}
+		uint32_t len = sys_get_le32(&chunk[4]);
+
+		if (!memcmp(chunk, "fmt ", 4)) {
+			uint8_t fmt[16];
+
+			if (len < sizeof(fmt) || _read_all(fd, fmt, sizeof(fmt)) ||
+			    _skip(fd, len - sizeof(fmt) + (len & 1))) {
+				goto bad;
+			}
+			uint16_t format = sys_get_le16(&fmt[0]);
+			uint16_t channels = sys_get_le16(&fmt[2]);
+			uint32_t rate = sys_get_le32(&fmt[4]);
+			uint16_t bits = sys_get_le16(&fmt[14]);
+
+			if (format != 1 || channels != 1 || bits != 16 || rate != data->pcm_rate) {
+				LOG_ERR("%s is format %u, %u channels, %u bits at %u Hz, needs 16 bit mono PCM at %u Hz",
+					path, format, channels, bits, rate, data->pcm_rate);
+				ret = -EINVAL;
+				goto bad;
+			}
+			has_fmt = true;
+		} else if (!memcmp(chunk, "data", 4) && has_fmt) {
+			data->fd = fd;
+			data->data_left = len;
+			return 0;
+		} else if (_skip(fd, len + (len & 1))) {
+			goto bad;
+		}
+	}
+
+bad:
+	if (ret == -EIO) {
+		LOG_ERR("%s is not a WAV file the simulated DMIC can play", path);
+	}
+	nsi_host_close(fd);
+	return ret;
+}
+
+static const char *_path(const struct dmic_sim_config *cfg)
+{
+	return _wav_arg ? _wav_arg : cfg->wav_path;
+}
+
+static int _fill(const struct device *dev, uint8_t *block)
+{
+	const struct dmic_sim_config *cfg = dev->config;
+	struct dmic_sim_data *data = dev->data;
+	size_t filled = 0;
+
+	while (filled < data->block_size) {
+		if (data->data_left == 0) {
+			if (!cfg->loop || _open_wav(data, _path(cfg)) || data->data_left == 0) {
+				return -ENODATA;
+			}
+			data->rewinds++;
+		}
+		uint32_t n = MIN(data->block_size - filled, data->data_left);
+
+		if (_read_all(data->fd, &block[filled], n)) {
+			return -EIO;
+		}
+		filled += n;
+		data->data_left -= n;
+	}
+	return 0;
+}
+
+//Plays the role of the PDM and its interrupt, one block per block period scaled by the speed
+static void _producer(void *p1, void *p2, void *p3)
+{
+	const struct device *dev = p1;
+	const struct dmic_sim_config *cfg = dev->config;
+	struct dmic_sim_data *data = dev->data;
+
+	for (;;) {
+		k_sem_take(&data->start, K_FOREVER);
+		uint32_t speed = _speed(cfg);
+		uint64_t block_us = ((uint64_t)data->block_size / sizeof(int16_t)) * USEC_PER_SEC / data->pcm_rate;
+		int64_t start = k_uptime_ticks();
+
+		for (uint64_t n = 1; atomic_get(&data->running); n++) {
+			void *block;
+
+			if (speed > 0) {
+				k_sleep(K_TIMEOUT_ABS_TICKS(start + k_us_to_ticks_ceil64(n * block_us / speed)));
+			}
+			//The PDM drops a block when the slab is exhausted, free running waits for the pipeline
+			if (k_mem_slab_alloc(data->mem_slab, &block, speed > 0 ? K_NO_WAIT : DMIC_SIM_FREE_RUN_WAIT)) {
+				data->overruns++;
+				continue;
+			}
+			int ret = _fill(dev, block);
+
+			if (ret) {
+				k_mem_slab_free(data->mem_slab, block);
+				LOG_WRN("Simulated DMIC ran dry (%d)", ret);
+				atomic_set(&data->running, 0);
+				break;
+			}
+			if (k_msgq_put(&data->queue, &block, K_NO_WAIT)) {
+				k_mem_slab_free(data->mem_slab, block);
+				data->overruns++;
+				continue;
+			}
+			data->blocks++;
+		}
+	}
+}
+
+static void _free_queued(struct dmic_sim_data *data)
+{
+	void *block;
+
+	while (k_msgq_get(&data->queue, &block, K_NO_WAIT) == 0) {
+		k_mem_slab_free(data->mem_slab, block);
+	}
+}
+
+static int dmic_sim_configure(const struct device *dev, struct dmic_cfg *config)
+{
+	const struct dmic_sim_config *cfg = dev->config;
+	struct dmic_sim_data *data = dev->data;
+	struct pcm_stream_cfg *stream = &config->streams[0];
+
+	if (atomic_get(&data->running)) {
+		return -EBUSY;
+	}
+	if (config->channel.req_num_streams != 1 || config->channel.req_num_chan != 1 ||
+	    stream->pcm_width != 16 || stream->mem_slab == NULL || stream->pcm_rate == 0 ||
+	    stream->block_size == 0) {
+		LOG_ERR("Only one 16 bit mono stream is simulated");
+		return -EINVAL;
+	}
+
+	data->configured = false;
+	data->mem_slab = stream->mem_slab;
+	data->block_size = stream->block_size;
+	data->pcm_rate = stream->pcm_rate;
+	int ret = _open_wav(data, _path(cfg));
+
+	if (ret) {
+		return ret;
+	}
+	config->channel.act_num_streams = 1;
+	config->channel.act_num_chan = 1;
+	config->channel.act_chan_map_lo = config->channel.req_chan_map_lo;
+	config->channel.act_chan_map_hi = config->channel.req_chan_map_hi;
+	data->configured = true;
+	LOG_INF("Simulated DMIC playing %s at %u times real time", _path(cfg), _speed(cfg));
+	return 0;
+}
+
+static int dmic_sim_trigger(const struct device *dev, enum dmic_trigger cmd)
+{
+	struct dmic_sim_data *data = dev->data;
+
+	switch (cmd) {
+	case DMIC_TRIGGER_START:
+	case DMIC_TRIGGER_RELEASE:
+		if (!data->configured) {
+			return -EIO;
+		}
+		if (!atomic_cas(&data->running, 0, 1)) {
+			return 0;
+		}
+		_free_queued(data);
+		k_sem_give(&data->start);
+		return 0;
+
+	case DMIC_TRIGGER_STOP:
+	case DMIC_TRIGGER_PAUSE:
+		atomic_set(&data->running, 0);
+		LOG_INF("Simulated DMIC blocks: %u, overruns: %u, rewinds: %u", data->blocks, data->overruns,
+			data->rewinds);
+		return 0;
+
+	default:
+		return -EINVAL;
+	}
+}
+
+static int dmic_sim_read(const struct device *dev, uint8_t stream, void **buffer, size_t *size,
+			 int32_t timeout)
+{
+	struct dmic_sim_data *data = dev->data;
+
+	if (!data->configured) {
+		return -EIO;
+	}
+	int ret = k_msgq_get(&data->queue, buffer, SYS_TIMEOUT_MS(timeout));
+
+	if (ret) {
+		LOG_ERR("No audio from the simulated DMIC (%d)", ret);
+		return ret;
+	}
+	*size = data->block_size;
+	return 0;
+}
+
+static const struct _dmic_ops dmic_sim_ops = {
+	.configure = dmic_sim_configure,
+	.trigger = dmic_sim_trigger,
+	.read = dmic_sim_read,
+};
+
+static int dmic_sim_init(const struct device *dev)
+{
+	struct dmic_sim_data *data = dev->data;
+
+	data->fd = -1;
+	k_msgq_init(&data->queue, (char *)data->queue_buf, sizeof(void *), DMIC_SIM_QUEUE_LEN);
+	k_sem_init(&data->start, 0, 1);
+	k_thread_create(&data->thread, data->stack, K_KERNEL_STACK_SIZEOF(data->stack), _producer,
+			(void *)dev, NULL, NULL, DMIC_SIM_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&data->thread, "dmic_sim");
+	return 0;
+}
+
+#define DMIC_SIM_DEFINE(inst)                                                                     \
+	static const struct dmic_sim_config dmic_sim_config_##inst = {                            \
+		.wav_path = DT_INST_PROP(inst, wav_path),                                         \
+		.speed = DT_INST_PROP(inst, speed),                                               \
+		.loop = DT_INST_PROP(inst, loop),                                                 \
+	};                                                                                        \
+	static struct dmic_sim_data dmic_sim_data_##inst;                                         \
+	DEVICE_DT_INST_DEFINE(inst, dmic_sim_init, NULL, &dmic_sim_data_##inst,                   \
+			      &dmic_sim_config_##inst, POST_KERNEL,                               \
+			      CONFIG_AUDIO_DMIC_INIT_PRIORITY, &dmic_sim_ops);
+
+DT_INST_FOREACH_STATUS_OKAY(DMIC_SIM_DEFINE)
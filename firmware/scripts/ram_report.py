@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Summarise static RAM use of the heart patch sources.
+
+Runs nm over the linked zephyr.elf and groups the .bss/.data symbols by the
+source file they were defined in, so growth in a single module is easy to spot.
+"""
+import argparse
+import collections
+import os
+import subprocess
+import sys
+
+RAM_TYPES = set("bBdD")
+
+
+def parse_nm(nm, elf):
+    out = subprocess.run(
+        [nm, "--print-size", "--line-numbers", "--defined-only", elf],
+        check=True, capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        parts = line.split(None, 4)
+        # addr size type name [file:line]
+        if len(parts) < 4 or parts[2] not in RAM_TYPES:
+            continue
+        size = int(parts[1], 16)
+        name = parts[3]
+        location = parts[4] if len(parts) > 4 else ""
+        path = location.rsplit(":", 1)[0] if location else ""
+        yield name, size, path
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--nm", default="arm-zephyr-eabi-nm")
+    parser.add_argument("--elf", required=True)
+    parser.add_argument("--src", required=True, help="application src/ directory")
+    parser.add_argument("--top", type=int, default=5, help="symbols listed per file")
+    args = parser.parse_args()
+
+    src = os.path.realpath(args.src)
+    per_file = collections.defaultdict(list)
+    other = 0
+    for name, size, path in parse_nm(args.nm, args.elf):
+        real = os.path.realpath(path) if path else ""
+        if real.startswith(src + os.sep):
+            per_file[os.path.relpath(real, src)].append((size, name))
+        else:
+            other += size
+
+    app_total = 0
+    for path, syms in sorted(per_file.items(), key=lambda kv: -sum(s for s, _ in kv[1])):
+        total = sum(s for s, _ in syms)
+        app_total += total
+        print(f"{total:8d}  {path}")
+        for size, name in sorted(syms, reverse=True)[:args.top]:
+            print(f"{'':10}{size:8d}  {name}")
+
+    print("-" * 40)
+    print(f"{app_total:8d}  application total")
+    print(f"{other:8d}  zephyr, libraries and unattributed")
+    print(f"{app_total + other:8d}  total static RAM")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
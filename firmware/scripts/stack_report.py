@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Worst case stack depth of the heart patch threads from the compiler's call graph.
+
+Reads the .ci files gcc writes with -fcallgraph-info=su and walks the call graph
+from each thread entry, adding up the frame sizes along the deepest path. Calls
+through function pointers are resolved with --indirect. Callees without a frame
+size (precompiled libraries, or sources built without the flag) are listed and
+covered by a fixed --external allowance.
+"""
+import argparse
+import collections
+import fnmatch
+import os
+import re
+import sys
+
+NODE_RE = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+EDGE_RE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+SIZE_RE = re.compile(r'\\n(\d+) bytes \(([a-z,]+)\)')
+
+# Thread name: entry functions, the deepest one sizes the stack
+THREADS = {
+    "capture": ["audio_capture_thread"],
+    "audio": ["consume_audio"],
+    "peak": ["process_peaks"],
+    "analysis": ["_analyse_window", "_snapshot_finish"],
+}
+
+# Caller: candidates for its calls through a function pointer
+INDIRECT = {
+    "peak_processor_process_peak": ["peak_processor_send_function"],
+    "fe_compute": ["_fe_*"],
+}
+
+INDIRECT_NODE = "__indirect_call"
+
+
+def _name(title):
+    # gcc titles static functions "file:name"
+    return title.rsplit(":", 1)[-1]
+
+
+class Function:
+    def __init__(self, name, unit, size, qualifier):
+        self.name = name
+        self.unit = unit
+        self.size = size
+        self.qualifier = qualifier  # static, dynamic or dynamic,bounded
+        self.callees = []
+
+
+def parse_ci(paths):
+    defined = {}  # (unit, name) -> Function
+    by_name = collections.defaultdict(list)
+    edges = []
+    for path in paths:
+        unit = os.path.realpath(path)
+        with open(path) as f:
+            text = f.read()
+        for title, label in NODE_RE.findall(text):
+            name = _name(title)
+            size = SIZE_RE.search(label)
+            if size:
+                fn = Function(name, unit, int(size.group(1)), size.group(2))
+                defined[(unit, name)] = fn
+                by_name[name].append(fn)
+        edges += [(unit, _name(src), _name(dst)) for src, dst in EDGE_RE.findall(text)]
+
+    # A call binds to the definition in its own unit first, as a static function would
+    for unit, src, dst in edges:
+        caller = defined.get((unit, src))
+        if caller:
+            caller.callees.append(dst if (unit, dst) not in defined else defined[(unit, dst)])
+    return defined, by_name
+
+
+def resolve(name, by_name):
+    fns = by_name.get(name, [])
+    return fns[0] if len(fns) == 1 else None
+
+
+class Walker:
+    def __init__(self, by_name, indirect):
+        self.by_name = by_name
+        self.indirect = indirect
+        self.memo = {}
+        self.active = set()
+        self.unresolved = set()
+        self.recursive = set()
+        self.dynamic = set()
+
+    def _targets(self, fn, callee):
+        if isinstance(callee, Function):
+            return [callee]
+        if callee == INDIRECT_NODE:
+            patterns = self.indirect.get(fn.name)
+            if not patterns:
+                self.unresolved.add(f"{INDIRECT_NODE} in {fn.name}")
+                return []
+            return [f for name, fns in self.by_name.items() if any(fnmatch.fnmatchcase(name, p) for p in patterns)
+                    for f in fns]
+        target = resolve(callee, self.by_name)
+        if target is None:
+            self.unresolved.add(callee)
+            return []
+        return [target]
+
+    def depth(self, fn):
+        """Deepest stack from fn's entry, with the path that reaches it."""
+        key = id(fn)
+        if key in self.memo:
+            return self.memo[key]
+        if key in self.active:
+            self.recursive.add(fn.name)
+            return 0, []
+        self.active.add(key)
+        if fn.qualifier != "static":
+            self.dynamic.add(f"{fn.name} ({fn.qualifier})")
+        deepest, path = 0, []
+        for callee in fn.callees:
+            for target in self._targets(fn, callee):
+                d, p = self.depth(target)
+                if d > deepest:
+                    deepest, path = d, p
+        self.active.discard(key)
+        result = (fn.size + deepest, [(fn.name, fn.size)] + path)
+        self.memo[key] = result
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--build", required=True, help="build directory searched for .ci files")
+    parser.add_argument("--external", type=int, default=512,
+                        help="bytes allowed for the callees without a frame size, enough for a "
+                             "minimal mode LOG call formatting in the calling thread")
+    parser.add_argument("--exception-frame", type=int, default=104,
+                        help="bytes an interrupt stacks on the thread, 104 with FPU context")
+    parser.add_argument("--margin", type=float, default=0.25, help="headroom added to the estimate")
+    parser.add_argument("--verbose", action="store_true", help="print the deepest path of each thread")
+    args = parser.parse_args()
+
+    paths = [os.path.join(root, name) for root, _, names in os.walk(args.build) for name in names
+             if name.endswith(".ci")]
+    if not paths:
+        print(f"No .ci files under {args.build}, build with -fcallgraph-info=su", file=sys.stderr)
+        return 1
+    _, by_name = parse_ci(paths)
+
+    print(f"{'thread':10}{'graph':>8}{'total':>8}{'suggest':>9}")
+    for thread, entries in THREADS.items():
+        walker = Walker(by_name, INDIRECT)
+        deepest, path = 0, []
+        for entry in entries:
+            fn = resolve(entry, by_name)
+            if fn is None:
+                print(f"{thread}: entry {entry} not found", file=sys.stderr)
+                continue
+            d, p = walker.depth(fn)
+            if d > deepest:
+                deepest, path = d, p
+        total = deepest + args.external + args.exception_frame
+        suggest = -(-int(total * (1.0 + args.margin)) // 256) * 256
+        print(f"{thread:10}{deepest:8d}{total:8d}{suggest:9d}")
+        if args.verbose:
+            for name, size in path:
+                print(f"{'':12}{size:6d}  {name}")
+            for name in sorted(walker.unresolved):
+                print(f"{'':12}{'?':>6}  {name}")
+        for name in sorted(walker.recursive):
+            print(f"{'':12}recursion through {name}, counted once")
+        for name in sorted(walker.dynamic):
+            print(f"{'':12}dynamic frame in {name}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
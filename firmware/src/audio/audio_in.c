@@ -6,8 +6,14 @@
 #endif
 
 #define PDM_MEM_SLAB_BLOCK_COUNT 8
+#define AUDIO_CAPTURE_STACK_SIZE CONFIG_HEART_PATCH_CAPTURE_STACK_SIZE
+#define AUDIO_CAPTURE_PRIORITY 2 //Above the consumer, it only waits on the PDM and hands blocks on
 
 LOG_MODULE_REGISTER(audio_in);
+K_SEM_DEFINE(_start_sem, 0, 1);
+static atomic_t _capturing;
+static atomic_t _stop_requested;
+static uint32_t _requested_blocks;
 
 K_MEM_SLAB_DEFINE(pdm_mem_slab, MAX_BLOCK_SIZE, PDM_MEM_SLAB_BLOCK_COUNT, 4); //align mem slab to 4 bytes
 int16_t _wav_input_buffer[BLOCK_SIZE_SAMPLES];
@@ -52,10 +58,12 @@ int pdm_init() {
         LOG_ERR("Failed to configure the driver: %d", ret);
         return ret;
     }
+#if IS_ENABLED(CONFIG_AUDIO_DMIC_NRFX_PDM)
     nrf_pdm_gain_set(NRF_PDM0_S, _audio_in_config.pdm_gain, _audio_in_config.pdm_gain);
     uint8_t l_gain, r_gain;
     nrf_pdm_gain_get(NRF_PDM0_S, &l_gain, &r_gain);
     LOG_INF("LEFT GAIN: %d, RIGHT GAIN: %d", l_gain, r_gain);
+#endif
     return 0;
 }
 
@@ -67,41 +75,39 @@ int pdm_stop() {
     return ret;
 }
 
-int pdm_capture_audio() {
+int pdm_capture_audio(uint32_t num_blocks) {
     int ret;
     audio_slab_msg msg;
 
     ret = dmic_trigger(_audio_in_config.dmic_ctx, DMIC_TRIGGER_START);
-        if (ret < 0) {
-            LOG_ERR("START trigger failed: %d", ret);
-            return ret;
-        }
+    if (ret < 0) {
+        LOG_ERR("START trigger failed: %d", ret);
+    }
 
-    for (int  i = 0; i < WAV_LENGTH_BLOCKS; i ++) {
+    //num_blocks of 0 captures until stopped
+    for (int  i = 0; ret >= 0 && (num_blocks == 0 || i < num_blocks) && !atomic_get(&_stop_requested); i ++) {
         ret = dmic_read(_audio_in_config.dmic_ctx, 0, &msg.buffer, &msg.size, READ_TIMEOUT);
         if (_audio_in_config.audio_input_type==AUDIO_INPUT_TYPE_PDM_TO_WAV) {
             msg.audio_output_file = _audio_in_config.output_wav_config.wav_file;
         }
         if (ret < 0) {
             LOG_ERR("%d - read failed: %d", i, ret);
-            return ret;
+            break;
         }
         msg.msg_type = AUDIO_BLOCK_TYPE_DATA;
+        msg.timestamp_cyc = k_cycle_get_32();
         LOG_INF("%d - got buffer %p of %u bytes", i, msg.buffer, msg.size);
-        ret = k_msgq_put(_audio_in_config.msgq, &msg, K_NO_WAIT);
+        ret = spsc_ring_put(_audio_in_config.ring, &msg);
         if (ret < 0) {
-        LOG_ERR("Failed to enqueue message: %d", ret);
-        return ret;
+            LOG_ERR("Failed to enqueue message: %d", ret);
+            k_mem_slab_free(&pdm_mem_slab, msg.buffer);
+            break;
         }
-        
     }
+    //Always sent so the consumer stops the PDM and reports the capture finished
     msg.msg_type = AUDIO_BLOCK_TYPE_STOP;
-    ret = k_msgq_put(_audio_in_config.msgq, &msg, K_FOREVER);
-    if (ret < 0) {
-        LOG_ERR("Failed to stop message: %d", ret);
-        return ret;
-    }
-    LOG_INF("Sent stop message: %d", ret);
+    spsc_ring_put_retry(_audio_in_config.ring, &msg, 1);
+    LOG_INF("Sent stop message");
 
     return ret;
 
@@ -110,13 +116,15 @@ void wav_file_capture_audio() {
     int block_count = 0, total_samples = 0, samples_read = 0, ret = 0;
     audio_slab_msg msg;
 
-    while ((samples_read = read_wav_block(&_audio_in_config.input_wav_config,
+    while (!atomic_get(&_stop_requested) &&
+           (samples_read = read_wav_block(&_audio_in_config.input_wav_config,
                                           _wav_input_buffer, BLOCK_SIZE_SAMPLES)) > 0) {
         msg.msg_type = AUDIO_BLOCK_TYPE_DATA;
         msg.buffer = _wav_input_buffer;
         msg.size = samples_read * sizeof(int16_t);
+        msg.timestamp_cyc = k_cycle_get_32();
 
-        ret = k_msgq_put(_audio_in_config.msgq, &msg, K_NO_WAIT);
+        ret = spsc_ring_put(_audio_in_config.ring, &msg);
         block_count++;
         total_samples += samples_read;
         //LOG_INF("Block %d: %d samples read, total: %d", block_count, samples_read, total_samples);
@@ -125,7 +133,7 @@ void wav_file_capture_audio() {
     }
     // Send STOP message
     audio_slab_msg stop_msg = { .msg_type = AUDIO_BLOCK_TYPE_STOP };
-    k_msgq_put(_audio_in_config.msgq, &stop_msg, K_FOREVER);
+    spsc_ring_put_retry(_audio_in_config.ring, &stop_msg, 1);
     LOG_INF("Processed %d blocks, %d samples total from WAV file", block_count, total_samples);
 }
 
@@ -156,17 +164,17 @@ int audio_in_init(AudioInConfig audio_in_config) {
 
 }
 
-int audio_in_start() {
+int _audio_in_capture(uint32_t num_blocks) {
     int ret;
     switch (_audio_in_config.audio_input_type) {
         case AUDIO_INPUT_TYPE_PDM:
-            ret = pdm_capture_audio();
+            ret = pdm_capture_audio(num_blocks);
             return ret;
         #if IS_ENABLED(CONFIG_SD_CARD_SUPPORT) 
         case AUDIO_INPUT_TYPE_PDM_TO_WAV:
             generate_wav_filename();
             open_wav_for_write(&_audio_in_config.output_wav_config);
-            ret = pdm_capture_audio();
+            ret = pdm_capture_audio(num_blocks);
             return ret;
         case AUDIO_INPUT_TYPE_WAV:
             ret = open_wav_for_read(&_audio_in_config.input_wav_config);
@@ -180,6 +188,41 @@ int audio_in_start() {
     return ret;
 }
 
+//Producer thread, runs one capture per start request
+void audio_capture_thread() {
+    while (1) {
+        k_sem_take(&_start_sem, K_FOREVER);
+        //Ahead of the first block, so the consumer prepares its state on its own thread
+        audio_slab_msg start_msg = { .msg_type = AUDIO_BLOCK_TYPE_START };
+        spsc_ring_put_retry(_audio_in_config.ring, &start_msg, 1);
+        int ret = _audio_in_capture(_requested_blocks);
+        if (ret < 0) {
+            LOG_ERR("Capture ended with error %d", ret);
+        }
+        atomic_set(&_capturing, 0);
+    }
+}
+K_THREAD_DEFINE(audio_capture_thread_id, AUDIO_CAPTURE_STACK_SIZE, audio_capture_thread, NULL, NULL, NULL, AUDIO_CAPTURE_PRIORITY, 0, 0);
+
+int audio_in_start(uint32_t num_blocks) {
+    if (!atomic_cas(&_capturing, 0, 1)) {
+        LOG_WRN("Capture already running");
+        return -EBUSY;
+    }
+    _requested_blocks = num_blocks;
+    atomic_set(&_stop_requested, 0);
+    k_sem_give(&_start_sem);
+    return 0;
+}
+
+void audio_in_request_stop() {
+    atomic_set(&_stop_requested, 1);
+}
+
+bool audio_in_is_capturing() {
+    return atomic_get(&_capturing) != 0;
+}
+
 int audio_in_stop() {
     int ret = 0;
     switch (_audio_in_config.audio_input_type) {
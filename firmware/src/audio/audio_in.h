@@ -3,9 +3,11 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/audio/dmic.h>
+#if IS_ENABLED(CONFIG_AUDIO_DMIC_NRFX_PDM)
 #include <nrfx_pdm.h>
-#include <zephyr/audio/dmic.h>
+#endif
 #include "wav_file.h"
+#include "spsc_ring.h"
 #include "../macros.h"
 
 typedef enum {
@@ -18,12 +20,13 @@ typedef struct {
     AudioInputType audio_input_type;
     WavConfig input_wav_config;
     const struct device *dmic_ctx;
-    nrf_pdm_gain_t pdm_gain;
+    uint8_t pdm_gain; //nrf_pdm_gain_t, only set on the nRF PDM
     WavConfig output_wav_config;
-    struct k_msgq *msgq;
+    SpscRing *ring; //Blocks out to the audio stream
 } AudioInConfig;
 
 typedef enum {
+    AUDIO_BLOCK_TYPE_START,
     AUDIO_BLOCK_TYPE_DATA,
     AUDIO_BLOCK_TYPE_STOP
 } audio_block_type_t;
@@ -32,12 +35,19 @@ typedef struct {
 	void *buffer;
 	size_t size;
     audio_block_type_t msg_type;
+    uint32_t timestamp_cyc; //Cycle count when the block finished capture
     // Optional fields
     struct fs_file_t *audio_output_file; //Only needed if saving to SD
 } audio_slab_msg;
 
 struct k_mem_slab *audio_in_get_mem_slab(void);
 int audio_in_init(AudioInConfig audio_in_config);
-int audio_in_start();
+//Start capturing num_blocks (0 = until stopped) on the capture thread and return, -EBUSY if already capturing.
+//The capture always opens with an AUDIO_BLOCK_TYPE_START message and ends with an AUDIO_BLOCK_TYPE_STOP message.
+int audio_in_start(uint32_t num_blocks);
+//End the running capture early, within one block
+void audio_in_request_stop();
+bool audio_in_is_capturing();
+//Stop the input once the consumer has seen the STOP message
 int audio_in_stop();
 #endif
\ No newline at end of file
@@ -1,44 +1,86 @@
 #include <zephyr/logging/log.h>
 #include <stdio.h>
+#include <string.h>
 #include "audio_stream.h"
 #include "audio_in.h"
 #include "arm_math.h"
 #include "dsp/filters/bandpass_coeffs.h"
 #include "dsp/filters/lowpass_coeffs.h"
 #include "dsp/circular_block_buffer.h"
+#include "pipeline_deadline.h"
+#include "dsp_snapshot.h"
+#include "dsp_consumers.h"
+#include "envelope_stream.h"
+#include "../ble/heart_service.h"
+#include "../ble/beat_history.h"
+#include "../ble/beacon.h"
+#include "../event_handler.h"
 
 #define MEM_SLAB_BLOCK_COUNT 8
-#define AUDIO_BUF_TOTAL_SIZE WAV_LENGTH_BLOCKS * MAX_BLOCK_SIZE
 
-#define PEAK_PROCESSING_STACK_SIZE CONFIG_MAIN_STACK_SIZE
+#define PEAK_PROCESSING_STACK_SIZE CONFIG_HEART_PATCH_PEAK_STACK_SIZE
+#define AUDIO_BLOCK_PROCESSING_STACK_SIZE CONFIG_HEART_PATCH_AUDIO_STACK_SIZE
+#define WINDOW_ANALYSIS_STACK_SIZE CONFIG_HEART_PATCH_ANALYSIS_STACK_SIZE
+#if IS_ENABLED(CONFIG_HEART_PATCH_DEADLINE_SCHED)
+//Block consumption and window analysis share a priority and are ordered by their deadlines,
+//extraction is short and stays above both
+#define AUDIO_BLOCK_PROCESSING_PRIORITY 5
+#define PEAK_PROCESSING_PRIORITY 4
+#define WINDOW_ANALYSIS_PRIORITY 5
+#else
 #define AUDIO_BLOCK_PROCESSING_PRIORITY 3
 #define PEAK_PROCESSING_PRIORITY 5
+#define WINDOW_ANALYSIS_PRIORITY 6 //Below extraction so the next window can be cut while one is analysed
+#endif
+#define BLOCK_PERIOD_US ((uint32_t)(((uint64_t)BLOCK_SIZE_SAMPLES * USEC_PER_SEC) / MAX_SAMPLE_RATE))
+#define ANALYSIS_SLICE_US CONFIG_HEART_PATCH_ANALYSIS_SLICE_US
 
 LOG_MODULE_REGISTER(audio_stream);
-K_MSGQ_DEFINE(audio_input_message_queue, sizeof(audio_slab_msg), 8, 4);
-K_MSGQ_DEFINE(peak_message_queue, sizeof(RTPeakMessage), 8, 4);
-
-struct k_msgq *audio_stream_get_msgq() {
-    return &audio_input_message_queue;
+SPSC_RING_DEFINE(audio_input_ring, sizeof(audio_slab_msg), 8);
+SPSC_RING_DEFINE(peak_ring, sizeof(RTPeakMessage), 8);
+SPSC_RING_DEFINE(analysis_ring, sizeof(WindowSlot *), WP_NUM_SLOTS); //Extracted windows waiting for analysis
+
+//The large buffers of the two modes are never live at the same time, so they overlay
+//one arena sized by the larger mode. Whichever mode is active owns the whole arena.
+typedef union {
+    struct {
+        float block_buffer[CB_NUM_BLOCKS][BLOCK_SIZE_SAMPLES];
+        float dec_buffer[CB_DEC_NUM_BLOCKS * CB_DEC_BLOCK_SAMPLES];
+        float window_pool[WP_POOL_SAMPLES];
+    } dsp;
+    int16_t raw_audio[RAW_AUDIO_BUF_SAMPLES];
+} AudioStreamArena;
+
+static AudioStreamArena _arena;
+static AudioStreamMode _mode;
+
+SpscRing *audio_stream_get_ring() {
+    return &audio_input_ring;
 }
 
-struct k_msgq *audio_stream_get_peak_msgq() {
-    return &peak_message_queue;
+SpscRing *audio_stream_get_peak_ring() {
+    return &peak_ring;
 }
 //==============================================DSP mode=====================================================
 
-#if IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE) 
 AudioStreamConfig _audio_stream_config;
 CircularBlockBuffer _block_buffer;
 RTPeakDetector _rt_peak_detector;
 RTPeakValidator _rt_peak_validator;
-RTPeakValidator _rt_peak_validator;
 PeakProcessor _peak_processor;
 WindowAnalysis _window_analyser;
-
-float32_t f32_buf[BLOCK_SIZE_SAMPLES];
-int16_t out_q15[BLOCK_SIZE_SAMPLES];
-float32_t envelope_buf[BLOCK_SIZE_SAMPLES];
+WindowPool _window_pool;
+SignalQuality _signal_quality;
+HeartRate _heart_rate;
+AlertManager _alert_manager; //Kept across captures so a sustained alert isn't raised again
+static uint32_t _poor_signal_windows = 0;
+
+K_THREAD_STACK_DEFINE(window_analysis_stack, WINDOW_ANALYSIS_STACK_SIZE);
+static struct k_work_q _analysis_workq;
+static void _analyse_window(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(_analysis_work, _analyse_window);
+
+float32_t envelope_buf[BLOCK_SIZE_SAMPLES]; //Also scratch for q15 conversion before the envelope is built
 int debug_peak_count = 0;
 
 float32_t bp_state[4 * NUM_STAGES_BP];
@@ -61,68 +103,254 @@ void init_filters() {
         lp_state
     );
 }
-void peak_processor_send_function(const float *window, int32_t window_start_idx, int32_t window_len) {
+//Analysis stage, runs on the analysis work queue one window at a time in extraction order.
+//Each run is a slice of at most about ANALYSIS_SLICE_US, between slices the queue sleeps for a
+//tick so every other thread gets the CPU while a long window is analysed.
+static void _analyse_window(struct k_work *work) {
+    static WindowSlot *slot = NULL;
+
+    if (!slot) {
+        if (spsc_ring_get(&analysis_ring, &slot, K_NO_WAIT) != 0) {
+            return; //Nothing waiting
+        }
+        //Poor signal windows skip analysis and publish a status instead
+        slot->result.poor_signal = slot->valid && !signal_quality_is_good(&_signal_quality, slot->sqi);
+        if (slot->result.poor_signal) {
+            _poor_signal_windows++;
+        } else if (slot->valid) {
+            wa_set_consumers(&_window_analyser, slot->consumers);
+            wa_set_segmenter(&_window_analyser, slot->segmenter, slot->info.anchor_offset);
+            wa_set_audio_window(&_window_analyser, slot->samples, slot->info.len, slot->info.dec_len, slot->info.start_idx);
+        }
+        pipeline_deadline_begin(slot->release_cyc, slot->deadline_cyc);
+    }
 
-    wa_set_audio_window(&_window_analyser, window, window_len, window_start_idx);
+    bool done = true;
+    if (slot->valid && !slot->result.poor_signal) {
+        done = wa_run_slice(&_window_analyser, &slot->result, k_us_to_cyc_ceil32(ANALYSIS_SLICE_US));
+    } else {
+        //Slots are reused without clearing, so nothing from an earlier window may be published
+        slot->result = (WindowResult){
+            .consumers = slot->consumers,
+            .poor_signal = slot->result.poor_signal,
+            .abnormal_p = -1.0f,
+        };
+    }
+    if (!done) {
+        k_work_schedule_for_queue(&_analysis_workq, &_analysis_work, K_TICKS(1));
+        return;
+    }
 
-    float window_mean = compute_mean_abs(window, window_len);
-    //2.0 Hard limit audio
-    //hard_limit(window, window_len, window_mean, _audio_stream_config.window_analysis_config.audio_hl_thresh, limited_window_buf);
-    //3.0 Calculte STE Profile
-    wa_calc_ste_blocks(&_window_analyser);
-    //4.0 Calculte STE mean & Hard Limit
-    wa_calc_ste_mean(&_window_analyser);
-    wa_hard_limit_ste(&_window_analyser);
+    if (!pipeline_deadline_end(PIPELINE_STAGE_BEAT, slot->release_cyc, slot->deadline_cyc)) {
+        LOG_WRN("Window at %d analysed after the next S1 was due", slot->info.start_idx);
+    }
+    if (slot->result.has_packet) {
+        slot->result.packet.hr_bpm = slot->heart_rate.hr_bpm;
+        slot->result.packet.hr_mean_bpm = slot->heart_rate.mean_hr_bpm;
+        slot->result.packet.sdnn_ms = slot->heart_rate.sdnn_ms;
+        slot->result.packet.rmssd_ms = slot->heart_rate.rmssd_ms;
+    }
+    if (slot->valid && !slot->result.poor_signal) {
+        LOG_INF("Window analysed: start %d, len %d (%d decimated), ste_mean: %f, ste num_peaks: %d", slot->info.start_idx, slot->info.len, slot->info.dec_len, (double)_window_analyser.ste_mean, _window_analyser.num_peaks);
+    }
+    window_pool_release_samples(&_window_pool, slot);
+    window_pool_stage_leave(&_window_pool, WP_STAGE_ANALYSIS);
+    window_pool_stage_enter(&_window_pool, WP_STAGE_PUBLISH);
+    k_work_submit(&slot->publish_work);
+    slot = NULL;
+
+    if (spsc_ring_count(&analysis_ring) > 0) {
+        k_work_schedule_for_queue(&_analysis_workq, &_analysis_work, K_TICKS(1));
+    }
+}
 
-    //5.0 Find candidate STE peaks
-    wa_find_peaks_window(&_window_analyser);
-    //6.0 Remove peak clusters, find biggest peak in each
-    wa_remove_close_peaks(&_window_analyser);
-    
-    //7.0 Identify S1 and S2 peaks via timings and ratio of cardiac period
-    wa_label_S1_S2_by_fraction(&_window_analyser);
-    
-    //8.0 Identify peaks in audio window from STE peaks
-    wa_assign_audio_peaks(&_window_analyser);
-    //8. perform FFT on window and calc RMS
-    wa_extract_peak_features(&_window_analyser);
+//Feed the window's measures to the alert manager and send its transitions, true if one was raised
+static bool _publish_alerts(const WindowSlot *slot) {
+    const WindowResult *result = &slot->result;
+    float values[ALERT_NUM_IDS];
+    bool has_value[ALERT_NUM_IDS] = { false };
+    bool raised = false;
+    uint32_t now_ms = k_uptime_get_32();
+
+    has_value[ALERT_ID_POOR_SIGNAL] = slot->valid;
+    values[ALERT_ID_POOR_SIGNAL] = slot->sqi;
+    has_value[ALERT_ID_RMS] = result->has_rms_slope;
+    values[ALERT_ID_RMS] = result->rms_slope;
+    has_value[ALERT_ID_CENTROID] = result->has_centroid_slope;
+    values[ALERT_ID_CENTROID] = result->centroid_slope;
+    has_value[ALERT_ID_ABNORMAL] = (result->abnormal_p >= 0.0f);
+    values[ALERT_ID_ABNORMAL] = result->abnormal_p;
+
+    for (int32_t id = 0; id < ALERT_NUM_IDS; id++) {
+        struct heart_alert alert;
+        if (!has_value[id] || !alert_manager_update(&_alert_manager, id, values[id], now_ms, &alert)) continue;
+
+        LOG_INF("Alert 0x%02x %s, severity %u, onset %u ms", alert.code, alert.active ? "raised" : "cleared",
+                alert.severity, alert.onset_ms);
+        if (slot->consumers & DSP_CONSUMER_ALERT) {
+            int ret = bt_heart_service_notify_alert(&alert);
+            if (ret != 0) LOG_ERR("Alert Failed to send");
+        }
+        //Poor signal doesn't bring a monitoring window forward
+        if (alert.active && id != ALERT_ID_POOR_SIGNAL) raised = true;
+    }
 
-    wa_push_trends(&_window_analyser);
+    if (slot->consumers & DSP_CONSUMER_BEACON) {
+        uint8_t alerts = 0;
+        for (int32_t id = 0; id < ALERT_NUM_IDS; id++) {
+            if (alert_manager_is_active(&_alert_manager, id)) alerts |= BIT(alert_manager_code(id) - 1);
+        }
+        beacon_update_alerts(alerts);
+    }
+    return raised;
+}
 
-    //9. Create heart beat event and publish
-    wa_make_send_ble(&_window_analyser);
+//Publish stage, runs on the system work queue
+void _publish_window(struct k_work *work) {
+    WindowSlot *slot = CONTAINER_OF(work, WindowSlot, publish_work);
 
-    LOG_INF("Window sent: start %d, len %d, first %f, mean: %f, ste_mean: %f, ste num_peaks: %d", window_start_idx, window_len, window[0], window_mean, _window_analyser.ste_mean, _window_analyser.num_peaks);
+    wa_publish_result(&slot->result);
+    if (_publish_alerts(slot)) {
+        event_handler_post((AppEvent){ .type = EVENT_HEART_ALERT });
+    }
+    window_pool_stage_leave(&_window_pool, WP_STAGE_PUBLISH);
+    window_pool_free(&_window_pool, slot);
+}
 
+//Extraction stage hands each window on without waiting for the analysis of the previous one
+void peak_processor_send_function(WindowSlot *slot) {
+    slot->sqi = signal_quality_get(&_signal_quality);
+    slot->heart_rate = *heart_rate_get(&_heart_rate);
+    slot->consumers = dsp_consumers_get();
+    slot->segmenter = _audio_stream_config.window_analysis_config.segmenter;
+    window_pool_stage_enter(&_window_pool, WP_STAGE_ANALYSIS);
+    //Never fails, the pool has no more slots than the ring
+    spsc_ring_put(&analysis_ring, &slot);
+    //No effect if a slice is already scheduled
+    k_work_schedule_for_queue(&_analysis_workq, &_analysis_work, K_NO_WAIT);
 }
 
+K_SEM_DEFINE(_peak_sync_sem, 0, 1);
+
 void process_peaks() { 
     RTPeakMessage msg;
     int ret = 0;
 
     while(1) {
-        ret = k_msgq_get(&peak_message_queue, &msg, K_FOREVER);
-        if (ret == 0) {
+        ret = spsc_ring_get(&peak_ring, &msg, K_FOREVER);
+        if (ret == 0 && msg.type == RT_PEAK_SYNC) {
+            k_sem_give(&_peak_sync_sem);
+        } else if (ret == 0 && msg.type == RT_PEAK_GAP) {
+            //Extraction and heart rate belong to this thread, restart them here
+            peak_processor_reset(&_peak_processor);
+            heart_rate_break(&_heart_rate);
+        } else if (ret == 0) {
             LOG_INF("process_peaks: Got peak type %d, global_index %d", msg.type, msg.global_index);
+            //Heart rate is cheap enough to follow every S1, extracted or not
+            if (msg.type == RT_PEAK_S1) {
+                heart_rate_add_s1(&_heart_rate, (uint32_t)msg.global_index);
+            }
             peak_processor_process_peak(&_peak_processor, &msg, &_block_buffer);
             // Process the message
         } else {
-            LOG_ERR("process_peaks: k_msgq_get error %d", ret);
+            LOG_ERR("process_peaks: spsc_ring_get error %d", ret);
         }
     }   
 }
 K_THREAD_DEFINE(peak_processing_thread_id, PEAK_PROCESSING_STACK_SIZE, process_peaks,  NULL, NULL, NULL, PEAK_PROCESSING_PRIORITY, 0, 0);
-#endif
+
+static int64_t _last_capture_end_ms = -1;
+
+//Warm start state, taken at the end of every DSP capture
+static DspSnapshot _snapshot;
+static bool _snapshot_this_boot = false;
+
+static void _snapshot_finish(struct k_work *work);
+static K_WORK_DEFINE(_snapshot_work, _snapshot_finish);
+
+//Front end state is owned by the audio consumer, take it when the capture stops
+void _dsp_snapshot_take() {
+    dsp_snapshot_stamp(&_snapshot);
+    _snapshot.sample_index = cbb_get_absolute_sample_index(&_block_buffer);
+    _snapshot.uptime_ms = k_uptime_get();
+    memcpy(_snapshot.bp_state, bp_state, sizeof(_snapshot.bp_state));
+    memcpy(_snapshot.lp_state, lp_state, sizeof(_snapshot.lp_state));
+    _snapshot.running_mean = _rt_peak_detector.running_mean;
+    rt_peak_validator_save(&_rt_peak_validator, &_snapshot.validator);
+    _snapshot_this_boot = true;
+    //Trends belong to the analysis queue, where no ring is ever half updated between work items
+    k_work_submit_to_queue(&_analysis_workq, &_snapshot_work);
+}
+
+static void _snapshot_finish(struct k_work *work) {
+    wa_save_trends(&_window_analyser, _snapshot.trends);
+    dsp_snapshot_persist(&_snapshot);
+}
+
+//Start the freshly reset DSP chain from the last snapshot. Within a boot the timeline carries on
+//as if the DSP had been running all along, so peak history and trends line up with new beats.
+void _dsp_snapshot_apply() {
+    if (!dsp_snapshot_is_valid(&_snapshot)) return;
+
+    memcpy(bp_state, _snapshot.bp_state, sizeof(_snapshot.bp_state));
+    memcpy(lp_state, _snapshot.lp_state, sizeof(_snapshot.lp_state));
+    rt_peak_detector_set_mean(&_rt_peak_detector, _snapshot.running_mean);
+
+    if (_snapshot_this_boot) {
+        int64_t gap_ms = k_uptime_get() - _snapshot.uptime_ms;
+        uint32_t blocks = (uint32_t)((_snapshot.sample_index + (gap_ms * MAX_SAMPLE_RATE) / 1000) / BLOCK_SIZE_SAMPLES);
+        cbb_skip_blocks(&_block_buffer, blocks);
+        rt_peak_validator_restore(&_rt_peak_validator, &_snapshot.validator, 0,
+                                  cbb_get_absolute_sample_index(&_block_buffer), DSP_SNAPSHOT_MAX_PEAK_AGE_SAMPLES);
+        _last_capture_end_ms = k_uptime_get();
+    }
+    LOG_INF("DSP warm started, running mean %f", (double)_snapshot.running_mean);
+}
+
+//Trends from flash are moved to end at the start of this boot's timeline, the time the patch was
+//off is not known
+void _dsp_snapshot_load() {
+    if (dsp_snapshot_storage_init() != 0) return;
+    if (dsp_snapshot_load(&_snapshot) != 0) {
+        LOG_INF("No DSP snapshot in flash");
+        return;
+    }
+    wa_restore_trends(&_window_analyser, _snapshot.trends, -(float)_snapshot.sample_index / (float)MAX_SAMPLE_RATE);
+    LOG_INF("DSP snapshot loaded from flash");
+}
+
+//Wait for everything downstream of the audio consumer to finish with the capture: peaks still
+//queued and windows being extracted, analysed or published. Only after this may the arena be
+//handed to another mode or the DSP state be reset.
+void _dsp_drain() {
+    RTPeakMessage sync = { .type = RT_PEAK_SYNC };
+    spsc_ring_put_retry(&peak_ring, &sync, 1);
+    k_sem_take(&_peak_sync_sem, K_FOREVER);
+    window_pool_drain(&_window_pool);
+}
+
+//Reset all DSP state that lives in the arena
+void _dsp_reset() {
+    _last_capture_end_ms = -1;
+    init_filters();
+    cbb_init(&_block_buffer, _arena.dsp.block_buffer, CB_NUM_BLOCKS, BLOCK_SIZE_SAMPLES,
+             _arena.dsp.dec_buffer, CB_DEC_NUM_BLOCKS, CB_DECIMATION);
+    rt_peak_detector_init(&_rt_peak_detector, &_audio_stream_config.rt_peak_config);
+    rt_peak_validator_init(&_rt_peak_validator, &_audio_stream_config.rt_peak_val_config);
+    signal_quality_init(&_signal_quality, &_audio_stream_config.signal_quality_config);
+    heart_rate_init(&_heart_rate, &_audio_stream_config.heart_rate_config);
+    window_pool_init(&_window_pool, _arena.dsp.window_pool, WP_POOL_SAMPLES, _publish_window);
+    peak_processor_init(&_peak_processor, &_audio_stream_config.peak_processor_config, &_window_pool, peak_processor_send_function);
+    _dsp_snapshot_apply();
+}
 
 //==============================================BLE transmission mode=====================================================
 
-#if !IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE) 
-static int16_t _ble_audio_buf[AUDIO_BUF_TOTAL_SIZE];
 static size_t audio_buf_offset = 0;
 
 const int16_t *get_audio_buffer(void)
 {
-	return _ble_audio_buf;
+	return _arena.raw_audio;
 }
 
 size_t get_audio_buffer_length(void)
@@ -135,28 +363,91 @@ void write_to_buffer(const audio_slab_msg *msg)
     size_t num_samples = msg->size / sizeof(int16_t);
     const int16_t *src = (const int16_t *)msg->buffer;
 
-    if ((audio_buf_offset + num_samples) > AUDIO_BUF_TOTAL_SIZE) {
+    if ((audio_buf_offset + num_samples) > RAW_AUDIO_BUF_SAMPLES) {
         LOG_ERR("Audio buffer overflow — dropping %u bytes", msg->size);
         return;
     }
 
-    memcpy(&_ble_audio_buf[audio_buf_offset], src, msg->size);
+    memcpy(&_arena.raw_audio[audio_buf_offset], src, msg->size);
     audio_buf_offset += num_samples;
 
     LOG_INF("Wrote %u int16_t samples to audio_buf (offset now %u)", num_samples, audio_buf_offset);
 }
-#endif
+
+//==============================================Mode selection=====================================================
+
+//Capture has finished and the pipeline is drained when this is called, see consume_audio
+static int _enter_mode(AudioStreamMode mode) {
+    switch (mode) {
+        case AUDIO_STREAM_MODE_DSP:
+            _mode = mode;
+            _dsp_reset();
+            break;
+        case AUDIO_STREAM_MODE_RAW:
+            _mode = mode;
+            audio_buf_offset = 0;
+            break;
+        default:
+            LOG_ERR("Unknown audio stream mode %d", mode);
+            return -EINVAL;
+    }
+    LOG_INF("Audio stream mode: %s", mode == AUDIO_STREAM_MODE_DSP ? "DSP" : "RAW");
+    return 0;
+}
+
+int audio_stream_set_mode(AudioStreamMode mode) {
+    if (mode == _mode) return 0; //Same mode, the DSP state carries on
+    return _enter_mode(mode);
+}
+
+AudioStreamMode audio_stream_get_mode() {
+    return _mode;
+}
+
+uint32_t audio_stream_get_capture_blocks() {
+    return (_mode == AUDIO_STREAM_MODE_RAW) ? RAW_AUDIO_LENGTH_BLOCKS : WAV_LENGTH_BLOCKS;
+}
+
+//Skip the DSP timeline over the time since the last capture, so timestamps stay in step with
+//real time. Filters, detector thresholds and trends carry over, beat timing restarts.
+//Runs on the audio consumer, the peak thread is idle since the last capture was drained and
+//restarts its own state when the gap reaches it through the peak ring.
+void _dsp_skip_gap() {
+    if (_last_capture_end_ms < 0) return;
+
+    int64_t gap_ms = k_uptime_get() - _last_capture_end_ms;
+    uint32_t gap_blocks = (uint32_t)((gap_ms * MAX_SAMPLE_RATE) / (1000 * BLOCK_SIZE_SAMPLES));
+    if (gap_blocks == 0) return;
+
+    cbb_skip_blocks(&_block_buffer, gap_blocks);
+    rt_peak_validator_init(&_rt_peak_validator, &_audio_stream_config.rt_peak_val_config);
+    RTPeakMessage gap = { .type = RT_PEAK_GAP, .global_index = cbb_get_absolute_sample_index(&_block_buffer) };
+    spsc_ring_put_retry(&peak_ring, &gap, 1);
+    LOG_INF("Skipped %u blocks since the last capture", gap_blocks);
+}
+
+//Start of capture message, ahead of the first block
+void _begin_capture() {
+    pipeline_deadline_reset();
+    //DSP state carries over between captures, raw audio starts a fresh recording
+    if (_mode == AUDIO_STREAM_MODE_RAW) {
+        audio_buf_offset = 0;
+    } else {
+        _dsp_skip_gap();
+    }
+}
 
 void init_audio_stream(AudioStreamConfig audio_stream_config) {
-    #if IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE)
-        _audio_stream_config = audio_stream_config;
-        init_filters();
-        cbb_init(&_block_buffer, CB_NUM_BLOCKS, BLOCK_SIZE_SAMPLES);
-        rt_peak_detector_init(&_rt_peak_detector, &_audio_stream_config.rt_peak_config);
-        rt_peak_validator_init(&_rt_peak_validator, &_audio_stream_config.rt_peak_val_config);
-        peak_processor_init(&_peak_processor, &_audio_stream_config.peak_processor_config, peak_processor_send_function);
-        wa_init(&_window_analyser,  &_audio_stream_config.window_analysis_config);
-    #endif
+    _audio_stream_config = audio_stream_config;
+    const struct k_work_queue_config analysis_cfg = { .name = "window_analysis" };
+    k_work_queue_init(&_analysis_workq);
+    k_work_queue_start(&_analysis_workq, window_analysis_stack, K_THREAD_STACK_SIZEOF(window_analysis_stack),
+                       WINDOW_ANALYSIS_PRIORITY, &analysis_cfg);
+    wa_init(&_window_analyser,  &_audio_stream_config.window_analysis_config);
+    alert_manager_init(&_alert_manager, &_audio_stream_config.alert_config);
+    envelope_stream_init();
+    _dsp_snapshot_load();
+    _enter_mode(_audio_stream_config.initial_mode);
 }
 
 //==============================================Shared functions=====================================================
@@ -164,60 +455,112 @@ void init_audio_stream(AudioStreamConfig audio_stream_config) {
 void _process_block(audio_slab_msg *msg) { //process an incoming block of audio from audio_in
 
     int ret = 0;
-    #if !IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE) //BLE Stream Mode
+    if (_mode == AUDIO_STREAM_MODE_RAW) { //BLE Stream Mode
         write_to_buffer(msg);
         k_mem_slab_free(audio_in_get_mem_slab(), msg->buffer);
-    #elif IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE) //DSP mode
-            //1. Write filtered audio to ring buffer
-        float *block_to_write = cbb_get_write_block(&_block_buffer);
-        arm_q15_to_float((int16_t *)msg->buffer, f32_buf, BLOCK_SIZE_SAMPLES); //Convert to F32
-        arm_biquad_cascade_df1_f32(&bp_inst, f32_buf, block_to_write, BLOCK_SIZE_SAMPLES); // Filter into slab buffer
-        cbb_advance_write_index(&_block_buffer); //Advance slab buffer index for next run
-        k_mem_slab_free(audio_in_get_mem_slab(), msg->buffer);
-
-        // WAV Writing
-        // arm_float_to_q15(f32_buf, out_q15, BLOCK_SIZE_SAMPLES); // Convert back to int for saving to file
-        // ret = write_wav_data(msg->audio_output_file, (const char *)out_q15, msg->size); // write to wav file
-
-        //2. Generate envelope
-        arm_abs_f32(block_to_write, envelope_buf, BLOCK_SIZE_SAMPLES);
-        arm_biquad_cascade_df1_f32(&lp_inst, envelope_buf, envelope_buf, BLOCK_SIZE_SAMPLES);
-
-        //3. Peak Detection
-        int32_t block_absolute_start = cbb_get_absolute_sample_index(&_block_buffer) - cbb_get_block_size(&_block_buffer);
+        return;
+    }
+    //DSP mode
+    //1. Write filtered audio to ring buffer, converted and filtered in place
+    float *block_to_write = cbb_get_write_block(&_block_buffer);
+    arm_q15_to_float((int16_t *)msg->buffer, block_to_write, BLOCK_SIZE_SAMPLES); //Convert to F32 into slab buffer
+    signal_quality_measure_input(&_signal_quality, block_to_write, BLOCK_SIZE_SAMPLES);
+    arm_biquad_cascade_df1_f32(&bp_inst, block_to_write, block_to_write, BLOCK_SIZE_SAMPLES); // Filter in place
+    cbb_advance_write_index(&_block_buffer); //Advance slab buffer index for next run
+    k_mem_slab_free(audio_in_get_mem_slab(), msg->buffer);
+
+    // WAV Writing
+    // arm_float_to_q15(block_to_write, (q15_t *)envelope_buf, BLOCK_SIZE_SAMPLES); // Convert back to int for saving to file
+    // ret = write_wav_data(msg->audio_output_file, (const char *)envelope_buf, msg->size); // write to wav file
+
+    //2. Generate envelope
+    arm_abs_f32(block_to_write, envelope_buf, BLOCK_SIZE_SAMPLES);
+    arm_biquad_cascade_df1_f32(&lp_inst, envelope_buf, envelope_buf, BLOCK_SIZE_SAMPLES);
+    rt_peak_detector_prime(&_rt_peak_detector, envelope_buf, BLOCK_SIZE_SAMPLES);
+    signal_quality_update(&_signal_quality, block_to_write, envelope_buf, BLOCK_SIZE_SAMPLES);
+
+    //3. Peak Detection
+    int32_t block_absolute_start = cbb_get_absolute_sample_index(&_block_buffer) - cbb_get_block_size(&_block_buffer);
+    if (dsp_consumers_get() & DSP_CONSUMER_ENVELOPE) {
+        envelope_stream_add(envelope_buf, BLOCK_SIZE_SAMPLES, (uint32_t)block_absolute_start);
+    }
 
-        for (int i = 0; i < BLOCK_SIZE_SAMPLES; i++) {
-            int32_t abs_idx_of_sample = block_absolute_start + i;
-            RTPeakMessage peak_msg;
-            bool found = rt_peak_detector_update(&_rt_peak_detector, envelope_buf[i], abs_idx_of_sample, &peak_msg);
-            if (found) {
-                ret = rt_peak_validator_notify_peak(&_rt_peak_validator, peak_msg);
-               debug_peak_count++;
-               LOG_INF("Peak at global idx %d, value %f, running peak_total: %d", peak_msg.global_index, (double)peak_msg.value, debug_peak_count);
-         }
-     }
+    for (int i = 0; i < BLOCK_SIZE_SAMPLES; i++) {
+        int32_t abs_idx_of_sample = block_absolute_start + i;
+        RTPeakMessage peak_msg;
+        bool found = rt_peak_detector_update(&_rt_peak_detector, envelope_buf[i], abs_idx_of_sample, &peak_msg);
+        if (found) {
+            ret = rt_peak_validator_notify_peak(&_rt_peak_validator, peak_msg);
+            debug_peak_count++;
+            LOG_INF("Peak at global idx %d, value %f, running peak_total: %d", peak_msg.global_index, (double)peak_msg.value, debug_peak_count);
+        }
+    }
 
     if (ret != 0) {
         LOG_ERR("Failed to write to file, rc=%d", ret);
         return;
     }
-    #endif
-
 }
+#if IS_ENABLED(CONFIG_HEART_PATCH_STACK_REPORT)
+extern const k_tid_t audio_block_processing_task_id;
+extern const k_tid_t audio_capture_thread_id;
+
+void _log_stack_usage() {
+    size_t unused_capture = 0, unused_audio = 0, unused_peak = 0, unused_analysis = 0;
+    k_thread_stack_space_get(audio_capture_thread_id, &unused_capture);
+    k_thread_stack_space_get(audio_block_processing_task_id, &unused_audio);
+    k_thread_stack_space_get(peak_processing_thread_id, &unused_peak);
+    k_thread_stack_space_get(k_work_queue_thread_get(&_analysis_workq), &unused_analysis);
+    LOG_INF("Stack unused: capture %u/%u, audio %u/%u, peak %u/%u, analysis %u/%u", unused_capture,
+            CONFIG_HEART_PATCH_CAPTURE_STACK_SIZE, unused_audio, AUDIO_BLOCK_PROCESSING_STACK_SIZE,
+            unused_peak, PEAK_PROCESSING_STACK_SIZE, unused_analysis, WINDOW_ANALYSIS_STACK_SIZE);
+}
+#endif
+
 //Audio in subscriber task
 void consume_audio() {
     audio_slab_msg msg;
     int ret = 0;
 
     while(1) {
-        if (k_msgq_get(&audio_input_message_queue, &msg, K_FOREVER) == 0) {
-            if (msg.msg_type == AUDIO_BLOCK_TYPE_DATA) {
+        if (spsc_ring_get(&audio_input_ring, &msg, K_FOREVER) == 0) {
+            if (msg.msg_type == AUDIO_BLOCK_TYPE_START) {
+                _begin_capture();
+            } else if (msg.msg_type == AUDIO_BLOCK_TYPE_DATA) {
+                uint32_t block_period_cyc = k_us_to_cyc_ceil32(BLOCK_PERIOD_US);
+                pipeline_deadline_begin(msg.timestamp_cyc, block_period_cyc);
                 _process_block(&msg);
+                pipeline_deadline_end(PIPELINE_STAGE_BLOCK, msg.timestamp_cyc, block_period_cyc);
             } else if (msg.msg_type == AUDIO_BLOCK_TYPE_STOP) {
                 audio_in_stop();
+                _last_capture_end_ms = k_uptime_get();
+                spsc_ring_log_stats(&audio_input_ring, "audio ring");
+                pipeline_deadline_log_stats();
+                if (_mode == AUDIO_STREAM_MODE_DSP) {
+                    _dsp_drain();
+                    spsc_ring_log_stats(&peak_ring, "peak ring");
+                    window_pool_log_stats(&_window_pool);
+                    wa_log_slice_stats(&_window_analyser);
+                    fe_log_bench(&_window_analyser.fe);
+                    heart_rate_log_stats(&_heart_rate);
+                    classifier_log_stats(&_window_analyser.classifier);
+                    envelope_stream_log_stats();
+                    beat_history_log_stats();
+                    alert_manager_log_stats(&_alert_manager);
+                    beacon_log_stats();
+                    LOG_INF("Windows overwritten during extraction: %u", cbb_get_torn_reads(&_block_buffer));
+                    LOG_INF("Windows skipped on signal quality: %u, SQI now %f", _poor_signal_windows, (double)signal_quality_get(&_signal_quality));
+                    _dsp_snapshot_take();
+                    k_work_queue_drain(&_analysis_workq, false); //Trend snapshot
+                }
+                #if IS_ENABLED(CONFIG_HEART_PATCH_STACK_REPORT)
+                _log_stack_usage();
+                #endif
+                //Nothing reads the arena any more, the mode may change
+                event_handler_post((AppEvent){ .type = EVENT_AUDIO_FINISHED });
             }
         }
     }   
 }
 
-K_THREAD_DEFINE(audio_block_processing_task_id, CONFIG_MAIN_STACK_SIZE, consume_audio, NULL, NULL, NULL, AUDIO_BLOCK_PROCESSING_PRIORITY, 0, 0);
+K_THREAD_DEFINE(audio_block_processing_task_id, AUDIO_BLOCK_PROCESSING_STACK_SIZE, consume_audio, NULL, NULL, NULL, AUDIO_BLOCK_PROCESSING_PRIORITY, 0, 0);
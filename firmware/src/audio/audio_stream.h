@@ -5,27 +5,44 @@
 #include <zephyr/audio/dmic.h>
 #include "../modules/sd_card.h"
 #include "wav_file.h"
-#include <nrfx_pdm.h>
 #include "../macros.h"
+#include "spsc_ring.h"
 #include "dsp/rt_peak_detector.h"
 #include "dsp/peak_validator.h"
 #include "dsp/peak_processor.h"
 #include "dsp/window_analysis.h"
+#include "dsp/signal_quality.h"
+#include "dsp/heart_rate.h"
+#include "dsp/alert_manager.h"
+
+typedef enum {
+    AUDIO_STREAM_MODE_DSP,
+    AUDIO_STREAM_MODE_RAW,
+} AudioStreamMode;
 
 typedef struct {
     struct k_mem_slab *mem_slab; 
     RTPeakConfig rt_peak_config;
     RTPeakValConfig rt_peak_val_config;
     PeakProcessorConfig peak_processor_config;
-    WindowAnalysisConfig window_analysis_config
+    WindowAnalysisConfig window_analysis_config;
+    SignalQualityConfig signal_quality_config;
+    HeartRateConfig heart_rate_config;
+    AlertManagerConfig alert_config;
+    AudioStreamMode initial_mode;
 } AudioStreamConfig;
 
 void init_audio_stream(AudioStreamConfig audio_stream_config);
 
-struct k_msgq *audio_stream_get_msgq();
-struct k_msgq *audio_stream_get_peak_msgq();
+SpscRing *audio_stream_get_ring();
+SpscRing *audio_stream_get_peak_ring();
 void consume_audio();
 
+//Mode selection, only switch while no capture is running. Selecting the current mode does nothing.
+int audio_stream_set_mode(AudioStreamMode mode);
+AudioStreamMode audio_stream_get_mode();
+uint32_t audio_stream_get_capture_blocks();
+
 //Audio Transmission Functions
 const int16_t *get_audio_buffer();          
 size_t get_audio_buffer_length();
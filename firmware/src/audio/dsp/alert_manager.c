@@ -0,0 +1,128 @@
+#include "alert_manager.h"
+#include <zephyr/logging/log.h>
+#include <math.h>
+
+LOG_MODULE_REGISTER(alert_manager);
+
+static const uint8_t _codes[ALERT_NUM_IDS] = {
+    [ALERT_ID_RMS] = HEART_ALERT_RMS,
+    [ALERT_ID_CENTROID] = HEART_ALERT_CENTROID,
+    [ALERT_ID_POOR_SIGNAL] = HEART_ALERT_POOR_SIGNAL,
+    [ALERT_ID_ABNORMAL] = HEART_ALERT_ABNORMAL,
+};
+
+void alert_manager_init(AlertManager *am, const AlertManagerConfig *cfg) {
+    am->cfg = *cfg;
+    for (int32_t i = 0; i < ALERT_NUM_IDS; i++) {
+        am->tracks[i] = (AlertTrack){ .state = ALERT_STATE_CLEAR };
+    }
+    am->transitions = 0;
+    am->suppressed = 0;
+    am->deferred = 0;
+}
+
+//Distance past the raise threshold, negative before it
+static float _excess(const AlertRule *rule, float value) {
+    return (rule->raise >= rule->clear) ? value - rule->raise : rule->raise - value;
+}
+
+static bool _is_clear(const AlertRule *rule, float value) {
+    return (rule->raise >= rule->clear) ? value <= rule->clear : value >= rule->clear;
+}
+
+static uint8_t _severity(const AlertRule *rule, float excess) {
+    float span = fabsf(rule->raise - rule->clear);
+    if (span <= 0.0f) return 1;
+    float steps = excess / span;
+    return (steps >= (float)(ALERT_MAX_SEVERITY - 1)) ? ALERT_MAX_SEVERITY : 1 + (uint8_t)steps;
+}
+
+static bool _may_send(AlertManager *am, const AlertTrack *track, uint32_t now_ms) {
+    if (track->has_sent && now_ms - track->last_sent_ms < am->cfg.min_interval_ms) {
+        am->deferred++;
+        return false;
+    }
+    return true;
+}
+
+static void _send(AlertManager *am, AlertId id, AlertTrack *track, uint32_t now_ms, struct heart_alert *out) {
+    track->has_sent = true;
+    track->last_sent_ms = now_ms;
+    am->transitions++;
+    out->code = _codes[id];
+    out->active = (track->state == ALERT_STATE_ACTIVE) ? 1 : 0;
+    out->severity = out->active ? track->severity : 0;
+    out->onset_ms = track->onset_ms;
+    out->timestamp_ms = now_ms;
+}
+
+bool alert_manager_update(AlertManager *am, AlertId id, float value, uint32_t now_ms, struct heart_alert *out) {
+    const AlertRule *rule = &am->cfg.rules[id];
+    AlertTrack *track = &am->tracks[id];
+    float excess = _excess(rule, value);
+
+    if (track->state == ALERT_STATE_CLEAR && excess >= 0.0f) {
+        track->state = ALERT_STATE_RAISING;
+        track->since_ms = now_ms;
+        track->onset_ms = now_ms;
+    }
+
+    switch (track->state) {
+        case ALERT_STATE_RAISING:
+            //Raising needs the measure held past the raise threshold, not just inside the hysteresis
+            if (excess < 0.0f) {
+                track->state = ALERT_STATE_CLEAR;
+                return false;
+            }
+            if (now_ms - track->since_ms < rule->raise_hold_ms || !_may_send(am, track, now_ms)) {
+                return false;
+            }
+            track->state = ALERT_STATE_ACTIVE;
+            track->since_ms = now_ms;
+            track->severity = _severity(rule, excess);
+            _send(am, id, track, now_ms, out);
+            return true;
+
+        case ALERT_STATE_ACTIVE:
+        case ALERT_STATE_CLEARING:
+            if (!_is_clear(rule, value)) {
+                track->state = ALERT_STATE_ACTIVE;
+                //Only a rise in severity is sent while active, it falls back on the next raise
+                if (excess >= 0.0f && _severity(rule, excess) > track->severity && _may_send(am, track, now_ms)) {
+                    track->severity = _severity(rule, excess);
+                    _send(am, id, track, now_ms, out);
+                    return true;
+                }
+                if (excess >= 0.0f) am->suppressed++;
+                return false;
+            }
+            if (track->state == ALERT_STATE_ACTIVE) {
+                track->state = ALERT_STATE_CLEARING;
+                track->since_ms = now_ms;
+            }
+            if (now_ms - track->since_ms < rule->clear_hold_ms || !_may_send(am, track, now_ms)) {
+                return false;
+            }
+            track->state = ALERT_STATE_CLEAR;
+            track->since_ms = now_ms;
+            _send(am, id, track, now_ms, out);
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+bool alert_manager_is_active(const AlertManager *am, AlertId id) {
+    AlertState state = am->tracks[id].state;
+    return state == ALERT_STATE_ACTIVE || state == ALERT_STATE_CLEARING;
+}
+
+uint8_t alert_manager_code(AlertId id) {
+    return _codes[id];
+}
+
+void alert_manager_log_stats(const AlertManager *am) {
+    LOG_INF("Alert transitions sent: %u, repeats suppressed: %u, deferred by the rate limit: %u",
+            am->transitions, am->suppressed, am->deferred);
+}
@@ -0,0 +1,71 @@
+#ifndef ALERT_MANAGER_H
+#define ALERT_MANAGER_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../macros.h"
+#include "../../ble/heart_service.h"
+
+//Turns per window measures into alert transitions, so a sustained condition is sent once when
+//it is raised and once when it clears rather than with every beat. Each alert has raise and clear
+//thresholds with a hold time on each, and notifications of one alert are rate limited.
+
+typedef enum {
+    ALERT_ID_RMS,         //S1 RMS trend slope
+    ALERT_ID_CENTROID,    //S1 centroid trend slope
+    ALERT_ID_POOR_SIGNAL, //SQI
+    ALERT_ID_ABNORMAL,    //Classifier abnormal probability
+    ALERT_NUM_IDS
+} AlertId;
+
+//A raise threshold below the clear threshold raises on low values
+typedef struct {
+    float raise;
+    float clear;
+    uint32_t raise_hold_ms; //Past the raise threshold this long before the alert is raised
+    uint32_t clear_hold_ms; //Past the clear threshold this long before it is cleared
+} AlertRule;
+
+typedef struct {
+    AlertRule rules[ALERT_NUM_IDS];
+    uint32_t min_interval_ms; //Between notifications of the same alert, transitions wait
+} AlertManagerConfig;
+
+typedef enum {
+    ALERT_STATE_CLEAR,
+    ALERT_STATE_RAISING,
+    ALERT_STATE_ACTIVE,
+    ALERT_STATE_CLEARING,
+} AlertState;
+
+typedef struct {
+    AlertState state;
+    uint32_t since_ms; //Entered the current state
+    uint32_t onset_ms; //First crossed the raise threshold
+    uint8_t severity;  //Last sent while active
+    bool has_sent;
+    uint32_t last_sent_ms;
+} AlertTrack;
+
+typedef struct {
+    AlertManagerConfig cfg;
+    AlertTrack tracks[ALERT_NUM_IDS];
+    uint32_t transitions; //Since init
+    uint32_t suppressed;  //Measures past the raise threshold with nothing sent
+    uint32_t deferred;    //Transitions held back by the rate limit
+} AlertManager;
+
+void alert_manager_init(AlertManager *am, const AlertManagerConfig *cfg);
+
+//Feed one measure of an alert, true with out filled when a transition is due to be sent
+bool alert_manager_update(AlertManager *am, AlertId id, float value, uint32_t now_ms, struct heart_alert *out);
+
+bool alert_manager_is_active(const AlertManager *am, AlertId id);
+
+//HEART_ALERT_ code the alert is sent with
+uint8_t alert_manager_code(AlertId id);
+
+void alert_manager_log_stats(const AlertManager *am);
+
+#endif
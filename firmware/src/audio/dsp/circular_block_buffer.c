@@ -1,35 +1,161 @@
 #include "circular_block_buffer.h"
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/barrier.h>
 
 LOG_MODULE_REGISTER(circ_buffer);
 
-void cbb_init(CircularBlockBuffer *buf, uint32_t num_blocks, uint32_t block_size) {
+void cbb_init(CircularBlockBuffer *buf, float (*storage)[BLOCK_SIZE_SAMPLES], uint32_t num_blocks, uint32_t block_size,
+              float *dec_storage, uint32_t dec_num_blocks, uint32_t decimation) {
+    buf->buffer = storage;
     buf->num_blocks = num_blocks;
     buf->block_size = block_size;
     buf->write_index = 0;
     buf->absolute_sample_index = 0;
-    memset(buf->buffer, 0, sizeof(buf->buffer));
+    buf->dec_buffer = dec_storage;
+    buf->dec_num_blocks = dec_num_blocks;
+    buf->decimation = decimation;
+    memset(buf->buffer, 0, num_blocks * sizeof(*buf->buffer));
+    memset(buf->dec_buffer, 0, dec_num_blocks * (block_size / decimation) * sizeof(float));
+    //Every slot starts out as written, block numbers before the first write are never requested
+    for (uint32_t i = 0; i < CB_NUM_BLOCKS; i++) atomic_set(&buf->block_seq[i], CBB_SLOT_SEQ(0, false));
+    for (uint32_t i = 0; i < CB_DEC_NUM_BLOCKS; i++) atomic_set(&buf->dec_block_seq[i], CBB_SLOT_SEQ(0, false));
+    atomic_set(&buf->torn_reads, 0);
 }
 
 float* cbb_get_write_block(CircularBlockBuffer *buf) {
+    uint32_t block_number = buf->absolute_sample_index / buf->block_size;
+    atomic_set(&buf->block_seq[buf->write_index], CBB_SLOT_SEQ(block_number, true));
+    barrier_dmem_fence_full();
     return buf->buffer[buf->write_index];
 }
 
+//Absolute index of the oldest full rate sample readers may use. The write block holds
+//the oldest audio while it is recycled, so it is served from the decimated tier instead.
+static uint32_t _full_oldest(const CircularBlockBuffer *buf, uint32_t latest) {
+    uint32_t capacity = (buf->num_blocks - 1) * buf->block_size;
+    return (latest > capacity) ? latest - capacity : 0;
+}
+
+//Absolute index of the oldest decimated sample, the decimated tier ends where the full rate tier starts
+static uint32_t _dec_oldest(const CircularBlockBuffer *buf, uint32_t latest) {
+    uint32_t dec_span = buf->dec_num_blocks * buf->block_size;
+    uint32_t full_oldest = _full_oldest(buf, latest);
+    return (full_oldest > dec_span) ? full_oldest - dec_span : 0;
+}
+
 void cbb_advance_write_index(CircularBlockBuffer *buf) {
+    //Block contents must land before the slot is published, and the slot before the new index
+    uint32_t block_number = buf->absolute_sample_index / buf->block_size;
+    barrier_dmem_fence_full();
+    atomic_set(&buf->block_seq[buf->write_index], CBB_SLOT_SEQ(block_number, false));
+    barrier_dmem_fence_full();
+
     buf->write_index = (buf->write_index + 1) % buf->num_blocks;
     buf->absolute_sample_index += buf->block_size;
+
+    //Once the ring is full the next write block holds the oldest audio, keep a decimated copy
+    if (buf->absolute_sample_index >= buf->num_blocks * buf->block_size) {
+        uint32_t dec_block_size = buf->block_size / buf->decimation;
+        uint32_t evicted_start = buf->absolute_sample_index - buf->num_blocks * buf->block_size;
+        uint32_t evicted_number = evicted_start / buf->block_size;
+        uint32_t dec_block = evicted_number % buf->dec_num_blocks;
+        const float *src = buf->buffer[buf->write_index];
+        float *dst = &buf->dec_buffer[dec_block * dec_block_size];
+
+        //After a gap the slot holds a block from before it, there is nothing to keep
+        if (atomic_get(&buf->block_seq[buf->write_index]) != CBB_SLOT_SEQ(evicted_number, false)) {
+            return;
+        }
+        atomic_set(&buf->dec_block_seq[dec_block], CBB_SLOT_SEQ(evicted_number, true));
+        barrier_dmem_fence_full();
+        for (uint32_t i = 0; i < dec_block_size; i++) {
+            dst[i] = src[i * buf->decimation];
+        }
+        barrier_dmem_fence_full();
+        atomic_set(&buf->dec_block_seq[dec_block], CBB_SLOT_SEQ(evicted_number, false));
+    }
 }
 
-size_t cbb_get_absolute_sample_index(const CircularBlockBuffer *buf) {
+void cbb_skip_blocks(CircularBlockBuffer *buf, uint32_t num_blocks) {
+    //Slots keep their old block numbers, so reads that reach into the gap fail their check
+    buf->write_index = (buf->write_index + num_blocks) % buf->num_blocks;
+    buf->absolute_sample_index += num_blocks * buf->block_size;
+}
+
+uint32_t cbb_get_absolute_sample_index(const CircularBlockBuffer *buf) {
     return buf->absolute_sample_index;
 }
 
-size_t cbb_get_block_size(const CircularBlockBuffer *buf) {
+uint32_t cbb_get_block_size(const CircularBlockBuffer *buf) {
     return buf->block_size;
 }
 
+uint32_t cbb_get_torn_reads(const CircularBlockBuffer *buf) {
+    return (uint32_t)atomic_get(&buf->torn_reads);
+}
 
-int cbb_extract_window(const CircularBlockBuffer *buf, uint32_t start_idx, uint32_t end_idx,  int32_t pre_samples, int32_t post_samples, float *out_window, int *out_window_len)
+//Seqlock read side, copy n floats from a slot that should hold block_number.
+//Returns false if the slot held another block, or was written, at any point during the copy.
+static bool _copy_slot(const atomic_t *seq, uint32_t block_number, const float *src, float *dst, uint32_t n)
+{
+    atomic_val_t expected = CBB_SLOT_SEQ(block_number, false);
+    if (atomic_get(seq) != expected) return false;
+    barrier_dmem_fence_full();
+    memcpy(dst, src, n * sizeof(float));
+    barrier_dmem_fence_full();
+    return atomic_get(seq) == expected;
+}
+
+static bool _copy_full_rate(const CircularBlockBuffer *buf, uint32_t start, int32_t len, float *out)
+{
+    uint32_t capacity = buf->num_blocks * buf->block_size;
+    for (int32_t i = 0; i < len; ) {
+        uint32_t abs_idx = start + i;
+        uint32_t rel_idx = abs_idx % capacity;
+        uint32_t block_idx = rel_idx / buf->block_size;
+        uint32_t sample_idx = rel_idx % buf->block_size;
+
+        uint32_t samples_left_in_block = buf->block_size - sample_idx;
+        uint32_t samples_left_in_window = len - i;
+        uint32_t n_to_copy = (samples_left_in_block < samples_left_in_window)
+                               ? samples_left_in_block
+                               : samples_left_in_window;
+
+        if (!_copy_slot(&buf->block_seq[block_idx], abs_idx / buf->block_size,
+                        &buf->buffer[block_idx][sample_idx], &out[i], n_to_copy)) {
+            return false;
+        }
+        i += n_to_copy;
+    }
+    return true;
+}
+
+static bool _copy_decimated(const CircularBlockBuffer *buf, uint32_t start, int32_t len, float *out)
+{
+    uint32_t dec_block_size = buf->block_size / buf->decimation;
+    uint32_t dec_idx = start / buf->decimation;
+    for (int32_t i = 0; i < len; ) {
+        uint32_t block_number = (dec_idx + i) / dec_block_size;
+        uint32_t dec_block = block_number % buf->dec_num_blocks;
+        uint32_t sample_idx = (dec_idx + i) % dec_block_size;
+
+        uint32_t samples_left_in_block = dec_block_size - sample_idx;
+        uint32_t samples_left_in_window = len - i;
+        uint32_t n_to_copy = (samples_left_in_block < samples_left_in_window)
+                               ? samples_left_in_block
+                               : samples_left_in_window;
+
+        if (!_copy_slot(&buf->dec_block_seq[dec_block], block_number,
+                        &buf->dec_buffer[dec_block * dec_block_size + sample_idx], &out[i], n_to_copy)) {
+            return false;
+        }
+        i += n_to_copy;
+    }
+    return true;
+}
+
+int cbb_plan_window(const CircularBlockBuffer *buf, uint32_t start_idx, uint32_t end_idx, int32_t pre_samples, int32_t post_samples,
+                    CbbWindowInfo *info)
 {
     int32_t start = (int32_t)start_idx - pre_samples;
     int32_t end = (int32_t)end_idx + post_samples;
@@ -39,38 +165,52 @@ int cbb_extract_window(const CircularBlockBuffer *buf, uint32_t start_idx, uint3
         return -1;
     }
 
-    int32_t window_len = end - start;
-    if (window_len <= 0) {
+    if (end - start <= 0) {
         LOG_ERR("Attempting to extract 0 length or negative window");
         return -1;
     }
 
-    uint32_t capacity = buf->num_blocks * buf->block_size;
+    //The writer may run while this thread copies, work from one snapshot and let the slot checks catch it
     uint32_t latest = buf->absolute_sample_index;
-    if ((latest - start > capacity) || (latest - end > capacity)) {
-        LOG_ERR("exceeds capacity latest - start: %d, latest - end: %d ", latest-start, latest- end);
+    barrier_dmem_fence_full();
+    if ((uint32_t)end > latest) {
+        LOG_ERR("Window end %d is ahead of latest sample %d", end, latest);
         return -1;
     }
 
-    for (int i = 0; i < window_len; ) {
-        uint32_t abs_idx = start + i;
-        uint32_t rel_idx = abs_idx % capacity;
-        uint32_t block_idx = rel_idx / buf->block_size;
-        uint32_t sample_idx = rel_idx % buf->block_size;
-
-        uint32_t samples_left_in_block = buf->block_size - sample_idx;
-        uint32_t samples_left_in_window = window_len - i;
-        uint32_t n_to_copy = (samples_left_in_block < samples_left_in_window)
-                               ? samples_left_in_block
-                               : samples_left_in_window;
-
-        memcpy(&out_window[i], &buf->buffer[block_idx][sample_idx], n_to_copy * sizeof(float));
-        i += n_to_copy;
+    uint32_t full_oldest = _full_oldest(buf, latest);
+    uint32_t dec_oldest = _dec_oldest(buf, latest);
+    if ((uint32_t)start < dec_oldest) {
+        LOG_ERR("exceeds history start: %d, oldest: %d", start, dec_oldest);
+        return -ENODATA;
     }
 
-    if (out_window_len)
-        *out_window_len = window_len;
+    int32_t dec_len = 0;
+    uint32_t full_start = start;
+    if ((uint32_t)start < full_oldest) {
+        //Older part comes from the decimated tier, whose samples sit on multiples of the decimation
+        start -= start % buf->decimation;
+        uint32_t dec_end = ((uint32_t)end < full_oldest) ? (uint32_t)end : full_oldest;
+        dec_len = (dec_end - start + buf->decimation - 1) / buf->decimation;
+        full_start = full_oldest;
+    }
+    int32_t full_len = ((uint32_t)end > full_start) ? end - full_start : 0;
 
+    info->start_idx = start;
+    info->full_start_idx = full_start;
+    info->len = dec_len + full_len;
+    info->dec_len = dec_len;
+    info->anchor_offset = (int32_t)start_idx - start;
     return 0;
 }
 
+int cbb_copy_window(const CircularBlockBuffer *buf, const CbbWindowInfo *info, float *out_window)
+{
+    if (!_copy_decimated(buf, info->start_idx, info->dec_len, out_window) ||
+        !_copy_full_rate(buf, info->full_start_idx, info->len - info->dec_len, &out_window[info->dec_len])) {
+        atomic_inc((atomic_t *)&buf->torn_reads);
+        LOG_ERR("Window at %d of %d samples overwritten during extraction", info->start_idx, info->len);
+        return -ENODATA;
+    }
+    return 0;
+}
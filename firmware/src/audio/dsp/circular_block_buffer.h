@@ -3,30 +3,71 @@
 
 #include "../../macros.h"
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 
+//Slot sequence value: absolute block number << 1, low bit set while the slot is being written
+#define CBB_SLOT_SEQ(_block_number, _writing) ((atomic_val_t)(((_block_number) << 1) | ((_writing) ? 1 : 0)))
+
+//Two tier history: the newest num_blocks are kept at full rate, blocks evicted from
+//the full rate tier are decimated into a longer ring of older audio.
+//Single writer, readers run lock free and validate every slot they copy against its
+//sequence value, seqlock style, so a window overwritten mid copy is detected and dropped.
 typedef struct {
-    float buffer[CB_NUM_BLOCKS][BLOCK_SIZE_SAMPLES];
+    float (*buffer)[BLOCK_SIZE_SAMPLES]; //Full rate block storage, owned by the caller
     uint32_t num_blocks;
     uint32_t block_size;
     uint32_t write_index;
     uint32_t absolute_sample_index;
+    float *dec_buffer; //Decimated storage of dec_num_blocks * block_size / decimation, owned by the caller
+    uint32_t dec_num_blocks;
+    uint32_t decimation;
+    atomic_t block_seq[CB_NUM_BLOCKS];
+    atomic_t dec_block_seq[CB_DEC_NUM_BLOCKS];
+    atomic_t torn_reads; //Extractions abandoned because the writer overtook them
 } CircularBlockBuffer;
 
-//Init the buffer
-void cbb_init(CircularBlockBuffer *buf, uint32_t num_blocks, uint32_t block_size);
+//Describes a window planned by cbb_plan_window
+typedef struct {
+    int32_t start_idx; //Absolute index of the first sample
+    int32_t full_start_idx; //Absolute index of the first full rate sample
+    int32_t len;       //Samples written to the window
+    int32_t dec_len;   //Leading samples taken from the decimated tier, one per decimation samples
+    int32_t anchor_offset; //Full rate position of the planned start_idx within the window
+} CbbWindowInfo;
+
+//Init the buffer over caller provided storage of num_blocks full rate and dec_num_blocks decimated blocks,
+//at most CB_NUM_BLOCKS and CB_DEC_NUM_BLOCKS
+void cbb_init(CircularBlockBuffer *buf, float (*storage)[BLOCK_SIZE_SAMPLES], uint32_t num_blocks, uint32_t block_size,
+              float *dec_storage, uint32_t dec_num_blocks, uint32_t decimation);
 
-//Get pointer to next writable block
+//Get pointer to next writable block and mark it as being written
 float* cbb_get_write_block(CircularBlockBuffer *buf);
 
-//Advance write index 
+//Publish the written block and advance write index, decimating the oldest full rate block before it is reused
 void cbb_advance_write_index(CircularBlockBuffer *buf);
 
+//Advance the timeline over num_blocks that were never captured, such as between monitoring windows.
+//Windows reaching into the gap can't be extracted.
+void cbb_skip_blocks(CircularBlockBuffer *buf, uint32_t num_blocks);
+
 //Get absolute sample index of latest samples written
 uint32_t cbb_get_absolute_sample_index(const CircularBlockBuffer *buf);
 
 //Get the size of the block for this buffer
 uint32_t cbb_get_block_size(const CircularBlockBuffer *buf);
 
-//Extract window [start_abs_idx, end_abs_idx] into out_window
-int cbb_extract_window(const CircularBlockBuffer *buf, uint32_t start_idx, uint32_t end_idx, int32_t pre_samples, int32_t post_samples, float *out_window, int *out_window_len);
-#endif
\ No newline at end of file
+//Number of extractions that failed because the writer overwrote the window
+uint32_t cbb_get_torn_reads(const CircularBlockBuffer *buf);
+
+//Work out where window [start_idx - pre_samples, end_idx + post_samples) lies in the history, without copying.
+//Any part of the window older than the full rate tier is taken from the decimated tier and
+//placed first, the start is then aligned down to the decimation. Returns -ENODATA if the
+//window has already left the history.
+int cbb_plan_window(const CircularBlockBuffer *buf, uint32_t start_idx, uint32_t end_idx, int32_t pre_samples, int32_t post_samples,
+                    CbbWindowInfo *info);
+
+//Copy a planned window into out_window, which must hold info->len samples.
+//Safe to call from a lower priority thread than the writer. Returns -ENODATA if the window
+//was overwritten since it was planned or while being copied, the window is then unusable.
+int cbb_copy_window(const CircularBlockBuffer *buf, const CbbWindowInfo *info, float *out_window);
+#endif
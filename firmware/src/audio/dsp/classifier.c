@@ -0,0 +1,122 @@
+#include "classifier.h"
+#include <zephyr/logging/log.h>
+#include <math.h>
+#ifdef CONFIG_HEART_PATCH_CLASSIFIER_CMSIS_NN
+#include "arm_nnfunctions.h"
+#endif
+
+LOG_MODULE_REGISTER(classifier);
+
+BUILD_ASSERT(sizeof(cls_l1_weights) == CLS_NUM_INPUTS * CLS_NUM_HIDDEN, "Layer 1 weights don't match");
+BUILD_ASSERT(sizeof(cls_l2_weights) == CLS_NUM_HIDDEN * CLS_NUM_OUTPUTS, "Layer 2 weights don't match");
+BUILD_ASSERT(!IS_ENABLED(CONFIG_HEART_PATCH_CLASSIFIER) || !CLS_WEIGHTS_PLACEHOLDER,
+             "Placeholder classifier weights, export a trained model with python_dsp/src/classifier.py");
+
+void classifier_init(Classifier *cls) {
+    cls->count = 0;
+    cls->cycles_total = 0;
+    cls->cycles_max = 0;
+}
+
+static int8_t _clamp_s8(int32_t v, int32_t lo, int32_t hi) {
+    return (int8_t)((v < lo) ? lo : ((v > hi) ? hi : v));
+}
+
+#ifndef CONFIG_HEART_PATCH_CLASSIFIER_CMSIS_NN
+//Rounding as arm_nn_requantize in CMSIS-NN
+static int32_t _doubling_high_mult(int32_t a, int32_t b) {
+    return (int32_t)(((int64_t)a * b + (1LL << 30)) >> 31);
+}
+
+static int32_t _divide_by_power_of_two(int32_t x, int32_t exponent) {
+    int32_t mask = (int32_t)((1LL << exponent) - 1);
+    int32_t result = x >> exponent;
+    int32_t threshold = (mask >> 1) + ((result < 0) ? 1 : 0);
+    return result + (((x & mask) > threshold) ? 1 : 0);
+}
+
+static int32_t _requantize(int32_t acc, int32_t multiplier, int32_t shift) {
+    int32_t left = (shift > 0) ? shift : 0;
+    int32_t right = (shift < 0) ? -shift : 0;
+    return _divide_by_power_of_two(_doubling_high_mult(acc * (1 << left), multiplier), right);
+}
+#endif
+
+//One fully connected layer, weights [out][in], int8 activations clamped to the full range
+static void _fully_connected(Classifier *cls, const int8_t *in, int32_t num_in, const int8_t *weights, const int32_t *bias,
+                             int32_t input_offset, int32_t multiplier, int32_t shift, int32_t output_offset,
+                             int8_t *out, int32_t num_out) {
+#ifdef CONFIG_HEART_PATCH_CLASSIFIER_CMSIS_NN
+    cmsis_nn_context ctx = { .buf = NULL, .size = 0 };
+    const cmsis_nn_fc_params fc_params = {
+        .input_offset = input_offset,
+        .filter_offset = 0,
+        .output_offset = output_offset,
+        .activation = { .min = -128, .max = 127 },
+    };
+    const cmsis_nn_per_tensor_quant_params quant_params = { .multiplier = multiplier, .shift = shift };
+    const cmsis_nn_dims input_dims = { .n = 1, .h = 1, .w = 1, .c = num_in };
+    const cmsis_nn_dims filter_dims = { .n = num_in, .h = 1, .w = 1, .c = num_out };
+    const cmsis_nn_dims bias_dims = { .n = 1, .h = 1, .w = 1, .c = num_out };
+    const cmsis_nn_dims output_dims = { .n = 1, .h = 1, .w = 1, .c = num_out };
+
+    //Cores that fold the input offset into precomputed kernel sums (CMSIS-NN 6) need a buffer
+    int32_t buf_size = arm_fully_connected_s8_get_buffer_size(&filter_dims);
+    if (buf_size > 0) {
+        if (buf_size > (int32_t)sizeof(cls->scratch)) {
+            LOG_ERR("Classifier scratch too small, %d bytes needed", buf_size);
+            return;
+        }
+        arm_vector_sum_s8(cls->scratch, num_in, num_out, weights, input_offset, bias);
+        ctx.buf = cls->scratch;
+        ctx.size = buf_size;
+    }
+    if (arm_fully_connected_s8(&ctx, &fc_params, &quant_params, &input_dims, in, &filter_dims, weights,
+                               &bias_dims, bias, &output_dims, out) != ARM_CMSIS_NN_SUCCESS) {
+        LOG_ERR("Classifier layer failed");
+    }
+#else
+    for (int32_t o = 0; o < num_out; o++) {
+        const int8_t *w = &weights[o * num_in];
+        int32_t acc = bias[o];
+        for (int32_t i = 0; i < num_in; i++) {
+            acc += ((int32_t)in[i] + input_offset) * w[i];
+        }
+        out[o] = _clamp_s8(_requantize(acc, multiplier, shift) + output_offset, -128, 127);
+    }
+#endif
+}
+
+float classifier_run(Classifier *cls, const float *inputs) {
+    uint32_t start = k_cycle_get_32();
+
+    for (int32_t i = 0; i < CLS_NUM_INPUTS; i++) {
+        float z = (inputs[i] - cls_input_mean[i]) * cls_input_inv_std[i];
+        cls->input[i] = _clamp_s8((int32_t)lroundf(z / CLS_INPUT_SCALE) + CLS_INPUT_ZERO_POINT, -128, 127);
+    }
+    //Hidden ReLU: clamping at the zero point of -128 drops the negatives
+    _fully_connected(cls, cls->input, CLS_NUM_INPUTS, cls_l1_weights, cls_l1_bias, -CLS_INPUT_ZERO_POINT,
+                     CLS_L1_MULTIPLIER, CLS_L1_SHIFT, CLS_HIDDEN_ZERO_POINT, cls->hidden, CLS_NUM_HIDDEN);
+    _fully_connected(cls, cls->hidden, CLS_NUM_HIDDEN, cls_l2_weights, cls_l2_bias, -CLS_HIDDEN_ZERO_POINT,
+                     CLS_L2_MULTIPLIER, CLS_L2_SHIFT, CLS_OUTPUT_ZERO_POINT, cls->output, CLS_NUM_OUTPUTS);
+
+    //Two class softmax of the dequantised logits
+    float margin = (float)((int32_t)cls->output[1] - (int32_t)cls->output[0]) * CLS_OUTPUT_SCALE;
+    float p = 1.0f / (1.0f + expf(-margin));
+
+    uint32_t cycles = k_cycle_get_32() - start;
+    cls->count++;
+    cls->cycles_total += cycles;
+    if (cycles > cls->cycles_max) cls->cycles_max = cycles;
+    return p;
+}
+
+void classifier_log_stats(const Classifier *cls) {
+    if (cls->count == 0) return;
+    LOG_INF("Classifier (%s): %u inferences, avg %u us, max %u us, %u bytes RAM, %u bytes weights",
+            IS_ENABLED(CONFIG_HEART_PATCH_CLASSIFIER_CMSIS_NN) ? "CMSIS-NN" : "C",
+            cls->count, k_cyc_to_us_ceil32(cls->cycles_total / cls->count), k_cyc_to_us_ceil32(cls->cycles_max),
+            (uint32_t)sizeof(*cls),
+            (uint32_t)(sizeof(cls_l1_weights) + sizeof(cls_l1_bias) + sizeof(cls_l2_weights) + sizeof(cls_l2_bias) +
+                       sizeof(cls_input_mean) + sizeof(cls_input_inv_std)));
+}
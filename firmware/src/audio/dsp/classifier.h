@@ -0,0 +1,31 @@
+#ifndef CLASSIFIER_H
+#define CLASSIFIER_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "models/classifier_weights.h"
+
+//Per cycle abnormal sound classifier, an int8 MLP (CLS_NUM_INPUTS-CLS_NUM_HIDDEN-CLS_NUM_OUTPUTS)
+//exported by python_dsp/src/classifier.py, which also holds the bit exact reference. Runs on
+//CMSIS-NN with CONFIG_HEART_PATCH_CLASSIFIER_CMSIS_NN, otherwise on the plain C kernel here.
+typedef struct {
+    int8_t input[CLS_NUM_INPUTS];
+    int8_t hidden[CLS_NUM_HIDDEN];
+    int8_t output[CLS_NUM_OUTPUTS];
+    int32_t scratch[CLS_NUM_HIDDEN]; //CMSIS-NN kernel sums, if the build needs them
+    uint32_t count;
+    uint32_t cycles_total;
+    uint32_t cycles_max;
+} Classifier;
+
+void classifier_init(Classifier *cls);
+
+//Probability the cycle is abnormal. Inputs: S1 features, S2 features (FeatureId order), then
+//systolic and diastolic energy ratios.
+float classifier_run(Classifier *cls, const float *inputs);
+
+//Inferences, latency and RAM
+void classifier_log_stats(const Classifier *cls);
+
+#endif
@@ -0,0 +1,315 @@
+#include "feature_engine.h"
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(feature_engine);
+
+#define FE_EPS 1e-12f
+
+//Band energy edges in Hz
+static const float _bands[FE_NUM_BANDS][2] = {
+    { 25.0f, 50.0f },
+    { 50.0f, 100.0f },
+    { 100.0f, 200.0f },
+};
+
+//Per sound working state, the spectrum points into the engine's scratch
+typedef struct {
+    const float *samples;
+    uint32_t n;
+    uint32_t fs;
+    const float *mag;  //FE_SPECTRUM_BINS magnitudes
+    float bin_width;
+    float mag_sum;
+    float centroid;
+    float fb_log[FE_NUM_FILTERS];
+} FeatureFrame;
+
+typedef float (*FeatureFn)(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg);
+
+typedef struct {
+    const char *name;
+    uint32_t stages; //BIT(FeatureStage) needed before fn runs
+    FeatureFn fn;
+    uint8_t arg;
+} FeatureDescriptor;
+
+//==============================================Features=====================================================
+
+static float _fe_rms(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    float rms;
+    arm_rms_f32(frame->samples, frame->n, &rms);
+    return rms;
+}
+
+static float _fe_centroid(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    return frame->centroid;
+}
+
+static float _fe_bandwidth(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    if (frame->mag_sum < FE_EPS) return 0.0f;
+    float acc = 0.0f;
+    for (uint32_t k = 0; k < FE_SPECTRUM_BINS; k++) {
+        float d = k * frame->bin_width - frame->centroid;
+        acc += d * d * frame->mag[k];
+    }
+    return sqrtf(acc / frame->mag_sum);
+}
+
+static float _fe_rolloff(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    float target = FE_ROLLOFF_FRACTION * frame->mag_sum;
+    float acc = 0.0f;
+    for (uint32_t k = 0; k < FE_SPECTRUM_BINS; k++) {
+        acc += frame->mag[k];
+        if (acc >= target) return k * frame->bin_width;
+    }
+    return (FE_SPECTRUM_BINS - 1) * frame->bin_width;
+}
+
+static float _fe_flatness(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    //DC is left out, the bandpass removes it
+    float log_sum = 0.0f, sum = 0.0f;
+    for (uint32_t k = 1; k < FE_SPECTRUM_BINS; k++) {
+        float p = frame->mag[k] * frame->mag[k] + FE_EPS;
+        log_sum += logf(p);
+        sum += p;
+    }
+    float n = (float)(FE_SPECTRUM_BINS - 1);
+    return expf(log_sum / n) / (sum / n);
+}
+
+static float _fe_peak_freq(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    float max_val;
+    uint32_t max_idx;
+    arm_max_f32(frame->mag, FE_SPECTRUM_BINS, &max_val, &max_idx);
+    return max_idx * frame->bin_width;
+}
+
+static float _fe_band(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    float energy = 0.0f;
+    for (uint32_t k = fe->band_bins[arg][0]; k < fe->band_bins[arg][1]; k++) {
+        energy += frame->mag[k] * frame->mag[k];
+    }
+    return energy;
+}
+
+static float _fe_cepstrum(const FeatureEngine *fe, const FeatureFrame *frame, uint8_t arg) {
+    float c;
+    arm_dot_prod_f32(fe->dct[arg], frame->fb_log, FE_NUM_FILTERS, &c);
+    return c;
+}
+
+#define SPECTRUM BIT(FE_STAGE_SPECTRUM)
+#define MOMENTS BIT(FE_STAGE_MOMENTS)
+#define FILTERBANK BIT(FE_STAGE_FILTERBANK)
+
+static const FeatureDescriptor _features[FE_NUM_FEATURES] = {
+    [FE_RMS]       = { "rms",        0,                     _fe_rms,       0 },
+    [FE_CENTROID]  = { "centroid",   SPECTRUM | MOMENTS,    _fe_centroid,  0 },
+    [FE_BANDWIDTH] = { "bandwidth",  SPECTRUM | MOMENTS,    _fe_bandwidth, 0 },
+    [FE_ROLLOFF]   = { "rolloff",    SPECTRUM | MOMENTS,    _fe_rolloff,   0 },
+    [FE_FLATNESS]  = { "flatness",   SPECTRUM,              _fe_flatness,  0 },
+    [FE_PEAK_FREQ] = { "peak_freq",  SPECTRUM,              _fe_peak_freq, 0 },
+    [FE_BAND_LOW]  = { "band_low",   SPECTRUM,              _fe_band,      0 },
+    [FE_BAND_MID]  = { "band_mid",   SPECTRUM,              _fe_band,      1 },
+    [FE_BAND_HIGH] = { "band_high",  SPECTRUM,              _fe_band,      2 },
+    [FE_CEP_0]     = { "cep_0",      SPECTRUM | FILTERBANK, _fe_cepstrum,  0 },
+    [FE_CEP_1]     = { "cep_1",      SPECTRUM | FILTERBANK, _fe_cepstrum,  1 },
+    [FE_CEP_2]     = { "cep_2",      SPECTRUM | FILTERBANK, _fe_cepstrum,  2 },
+    [FE_CEP_3]     = { "cep_3",      SPECTRUM | FILTERBANK, _fe_cepstrum,  3 },
+};
+
+static const char *_stage_names[FE_NUM_STAGES] = {
+    [FE_STAGE_SPECTRUM] = "spectrum",
+    [FE_STAGE_MOMENTS] = "moments",
+    [FE_STAGE_FILTERBANK] = "filterbank",
+};
+
+//==============================================Stages=====================================================
+
+//Apply an N point Hann window stored as its first half
+static void _apply_half_hann(const float *in, const float *half_hann, float *out, uint32_t N)
+{
+    uint32_t half = N / 2;
+    arm_mult_f32(in, half_hann, out, half);
+    for (uint32_t i = 0; i < half; i++) {
+        out[half + i] = in[half + i] * half_hann[half - 1 - i];
+    }
+}
+
+static void _stage_spectrum(FeatureEngine *fe, FeatureFrame *frame, bool decimated, float *mag)
+{
+    uint32_t N = frame->n;
+    _apply_half_hann(frame->samples, decimated ? fe->hann_window_dec : fe->hann_window, fe->windowed, N);
+    arm_rfft_fast_f32(decimated ? &fe->fft_instance_dec : &fe->fft_instance, fe->windowed, fe->fft_out, 0);
+
+    //Packed RFFT output: DC and nyquist are the real parts in the first pair
+    mag[0] = fabsf(fe->fft_out[0]);
+    uint32_t complex_bins = MIN(FE_SPECTRUM_BINS, N / 2) - 1;
+    arm_cmplx_mag_f32(&fe->fft_out[2], &mag[1], complex_bins);
+    if (FE_SPECTRUM_BINS > N / 2) {
+        mag[N / 2] = fabsf(fe->fft_out[1]);
+    }
+    frame->mag = mag;
+    frame->bin_width = (float)frame->fs / (float)N;
+}
+
+static void _stage_moments(FeatureEngine *fe, FeatureFrame *frame)
+{
+    float freq_sum = 0.0f, mag_sum = 0.0f;
+    for (uint32_t k = 0; k < FE_SPECTRUM_BINS; k++) {
+        freq_sum += k * frame->bin_width * frame->mag[k];
+        mag_sum += frame->mag[k];
+    }
+    frame->mag_sum = mag_sum;
+    frame->centroid = (mag_sum < 1e-6f) ? 0.0f : freq_sum / mag_sum;
+}
+
+static void _stage_filterbank(FeatureEngine *fe, FeatureFrame *frame)
+{
+    float power[FE_SPECTRUM_BINS];
+    arm_mult_f32(frame->mag, frame->mag, power, FE_SPECTRUM_BINS);
+    for (uint32_t m = 0; m < FE_NUM_FILTERS; m++) {
+        float e;
+        arm_dot_prod_f32(fe->fb_weights[m], power, FE_SPECTRUM_BINS, &e);
+        frame->fb_log[m] = logf(e + FE_EPS);
+    }
+}
+
+//==============================================Engine=====================================================
+
+//Generates the first N/2 points of an N point Hann window
+static void _generate_hann_window(float *buf, uint32_t N)
+{
+    for (uint32_t n = 0; n < N / 2; ++n) {
+        buf[n] = 0.5f * (1.0f - cosf(2.0f * M_PI * n / (N - 1)));
+    }
+}
+
+static float _hz_to_mel(float hz)
+{
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+static float _mel_to_hz(float mel)
+{
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+//Triangular filters evenly spaced in mel over the spectrum, and the DCT-II basis for the cepstrum
+static void _build_tables(FeatureEngine *fe, float bin_width)
+{
+    float mel_max = _hz_to_mel(FE_SPECTRUM_MAX_HZ);
+    float edges[FE_NUM_FILTERS + 2];
+    for (uint32_t i = 0; i < FE_NUM_FILTERS + 2; i++) {
+        edges[i] = _mel_to_hz(mel_max * i / (FE_NUM_FILTERS + 1));
+    }
+    for (uint32_t m = 0; m < FE_NUM_FILTERS; m++) {
+        for (uint32_t k = 0; k < FE_SPECTRUM_BINS; k++) {
+            float f = k * bin_width;
+            float w = 0.0f;
+            if (f > edges[m] && f < edges[m + 1]) {
+                w = (f - edges[m]) / (edges[m + 1] - edges[m]);
+            } else if (f >= edges[m + 1] && f < edges[m + 2]) {
+                w = (edges[m + 2] - f) / (edges[m + 2] - edges[m + 1]);
+            }
+            fe->fb_weights[m][k] = w;
+        }
+    }
+    for (uint32_t c = 0; c < FE_NUM_CEPS; c++) {
+        for (uint32_t m = 0; m < FE_NUM_FILTERS; m++) {
+            fe->dct[c][m] = cosf(M_PI * c * (m + 0.5f) / FE_NUM_FILTERS);
+        }
+    }
+    for (uint32_t b = 0; b < FE_NUM_BANDS; b++) {
+        uint32_t lo = (uint32_t)ceilf(_bands[b][0] / bin_width);
+        uint32_t hi = (uint32_t)ceilf(_bands[b][1] / bin_width);
+        fe->band_bins[b][0] = MIN(lo, FE_SPECTRUM_BINS);
+        fe->band_bins[b][1] = MIN(hi, FE_SPECTRUM_BINS);
+    }
+}
+
+void fe_init(FeatureEngine *fe, uint32_t window_size, uint32_t decimation)
+{
+    fe->window_size = window_size;
+    fe->decimation = decimation;
+    _generate_hann_window(fe->hann_window, window_size);
+    arm_rfft_fast_init_f32(&fe->fft_instance, (uint16_t)window_size);
+    _generate_hann_window(fe->hann_window_dec, window_size / decimation);
+    arm_rfft_fast_init_f32(&fe->fft_instance_dec, (uint16_t)(window_size / decimation));
+    memset(fe->windowed, 0, sizeof(fe->windowed));
+    memset(fe->fft_out, 0, sizeof(fe->fft_out));
+    memset(fe->bench, 0, sizeof(fe->bench));
+    //Both FFTs have the same bin width
+    _build_tables(fe, (float)MAX_SAMPLE_RATE / (float)window_size);
+}
+
+static inline uint32_t _bench_start(void)
+{
+    return IS_ENABLED(CONFIG_HEART_PATCH_FEATURE_BENCH) ? k_cycle_get_32() : 0;
+}
+
+static inline void _bench_end(FeatureEngine *fe, uint32_t slot, uint32_t start)
+{
+    if (IS_ENABLED(CONFIG_HEART_PATCH_FEATURE_BENCH)) {
+        fe->bench[slot].cycles += k_cycle_get_32() - start;
+        fe->bench[slot].count++;
+    }
+}
+
+void fe_compute(FeatureEngine *fe, const float *samples, bool decimated, uint32_t mask, FeatureVector *out)
+{
+    float mag[FE_SPECTRUM_BINS];
+    FeatureFrame frame = {
+        .samples = samples,
+        .n = decimated ? fe->window_size / fe->decimation : fe->window_size,
+        .fs = decimated ? MAX_SAMPLE_RATE / fe->decimation : MAX_SAMPLE_RATE,
+    };
+
+    uint32_t stages = 0;
+    for (uint32_t id = 0; id < FE_NUM_FEATURES; id++) {
+        if (mask & FE_MASK(id)) stages |= _features[id].stages;
+    }
+
+    uint32_t t;
+    if (stages & SPECTRUM) {
+        t = _bench_start();
+        _stage_spectrum(fe, &frame, decimated, mag);
+        _bench_end(fe, FE_NUM_FEATURES + FE_STAGE_SPECTRUM, t);
+    }
+    if (stages & MOMENTS) {
+        t = _bench_start();
+        _stage_moments(fe, &frame);
+        _bench_end(fe, FE_NUM_FEATURES + FE_STAGE_MOMENTS, t);
+    }
+    if (stages & FILTERBANK) {
+        t = _bench_start();
+        _stage_filterbank(fe, &frame);
+        _bench_end(fe, FE_NUM_FEATURES + FE_STAGE_FILTERBANK, t);
+    }
+
+    out->mask = 0;
+    for (uint32_t id = 0; id < FE_NUM_FEATURES; id++) {
+        if (!(mask & FE_MASK(id))) continue;
+        t = _bench_start();
+        out->values[id] = _features[id].fn(fe, &frame, _features[id].arg);
+        _bench_end(fe, id, t);
+        out->mask |= FE_MASK(id);
+    }
+}
+
+const char *fe_feature_name(FeatureId id)
+{
+    return (id < FE_NUM_FEATURES) ? _features[id].name : "?";
+}
+
+void fe_log_bench(const FeatureEngine *fe)
+{
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_FEATURE_BENCH)) return;
+
+    for (uint32_t i = 0; i < FE_NUM_FEATURES + FE_NUM_STAGES; i++) {
+        if (fe->bench[i].count == 0) continue;
+        const char *name = (i < FE_NUM_FEATURES) ? _features[i].name : _stage_names[i - FE_NUM_FEATURES];
+        LOG_INF("Feature %s: %u cycles avg over %u", name, fe->bench[i].cycles / fe->bench[i].count, fe->bench[i].count);
+    }
+}
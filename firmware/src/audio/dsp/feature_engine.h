@@ -0,0 +1,77 @@
+#ifndef FEATURE_ENGINE_H
+#define FEATURE_ENGINE_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "arm_math.h"
+#include "../../macros.h"
+
+//Features of one heart sound. Everything spectral comes from a single FFT of the sound, limited
+//to 0-FE_SPECTRUM_MAX_HZ so full rate and decimated sounds are described the same way.
+typedef enum {
+    FE_RMS,       //Time domain RMS
+    FE_CENTROID,  //Spectral centroid, Hz
+    FE_BANDWIDTH, //Magnitude weighted spread about the centroid, Hz
+    FE_ROLLOFF,   //Frequency below which FE_ROLLOFF_FRACTION of the magnitude lies, Hz
+    FE_FLATNESS,  //Geometric over arithmetic mean of the power spectrum, 0-1
+    FE_PEAK_FREQ, //Frequency of the largest bin, Hz
+    FE_BAND_LOW,  //Band energies, see _bands
+    FE_BAND_MID,
+    FE_BAND_HIGH,
+    FE_CEP_0,     //Cepstral coefficients of the log mel filterbank energies
+    FE_CEP_1,
+    FE_CEP_2,
+    FE_CEP_3,
+    FE_NUM_FEATURES
+} FeatureId;
+
+#define FE_MASK(id) BIT(id)
+#define FE_MASK_ALL (BIT(FE_NUM_FEATURES) - 1)
+
+//Shared intermediate results, each computed at most once per sound
+typedef enum {
+    FE_STAGE_SPECTRUM,   //Hann window, RFFT and magnitudes
+    FE_STAGE_MOMENTS,    //Magnitude sum and centroid
+    FE_STAGE_FILTERBANK, //Log mel filterbank energies
+    FE_NUM_STAGES
+} FeatureStage;
+
+typedef struct {
+    float values[FE_NUM_FEATURES];
+    uint32_t mask; //Features filled in
+} FeatureVector;
+
+typedef struct {
+    uint32_t cycles;
+    uint32_t count;
+} FeatureBench;
+
+typedef struct {
+    uint32_t window_size; //Full rate FFT size, the decimated FFT covers the same span
+    uint32_t decimation;
+    float hann_window[HS_WINDOW_SIZE / 2]; //First half only, the window is symmetric
+    arm_rfft_fast_instance_f32 fft_instance;
+    float hann_window_dec[HS_WINDOW_SIZE / CB_DECIMATION / 2];
+    arm_rfft_fast_instance_f32 fft_instance_dec;
+    float windowed[HS_WINDOW_SIZE]; //Consumed by the RFFT
+    float fft_out[HS_WINDOW_SIZE];
+    //Precomputed tables
+    float fb_weights[FE_NUM_FILTERS][FE_SPECTRUM_BINS];
+    float dct[FE_NUM_CEPS][FE_NUM_FILTERS];
+    uint8_t band_bins[FE_NUM_BANDS][2]; //First and one past last bin of each band
+    FeatureBench bench[FE_NUM_FEATURES + FE_NUM_STAGES]; //With CONFIG_HEART_PATCH_FEATURE_BENCH
+} FeatureEngine;
+
+void fe_init(FeatureEngine *fe, uint32_t window_size, uint32_t decimation);
+
+//Compute the features in mask for one sound of window_size samples, or window_size / decimation
+//if decimated. Stages are only run when a requested feature needs them.
+void fe_compute(FeatureEngine *fe, const float *samples, bool decimated, uint32_t mask, FeatureVector *out);
+
+const char *fe_feature_name(FeatureId id);
+
+//Average cycles per feature and per shared stage
+void fe_log_bench(const FeatureEngine *fe);
+
+#endif
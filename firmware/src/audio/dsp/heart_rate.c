@@ -0,0 +1,126 @@
+#include "heart_rate.h"
+#include <zephyr/logging/log.h>
+#include <math.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(heart_rate);
+
+static void _clear(HeartRate *hr) {
+    hr->write = 0;
+    hr->count = 0;
+    hr->sum = 0;
+    hr->sum_sq = 0;
+    hr->diff_sum_sq = 0;
+    hr->num_diffs = 0;
+    hr->chained = false;
+    hr->consecutive_rejects = 0;
+    memset(&hr->stats, 0, sizeof(hr->stats));
+}
+
+void heart_rate_init(HeartRate *hr, const HeartRateConfig *cfg) {
+    hr->cfg = *cfg;
+    if (hr->cfg.horizon_beats == 0 || hr->cfg.horizon_beats > HR_MAX_HORIZON_BEATS) {
+        hr->cfg.horizon_beats = HR_MAX_HORIZON_BEATS;
+    }
+    hr->has_last_s1 = false;
+    hr->rejected = 0;
+    _clear(hr);
+}
+
+void heart_rate_break(HeartRate *hr) {
+    hr->has_last_s1 = false;
+    hr->chained = false;
+}
+
+static bool _is_outlier(const HeartRate *hr, uint32_t rr_ms) {
+    if (rr_ms < hr->cfg.min_rr_ms || rr_ms > hr->cfg.max_rr_ms) return true;
+    if (hr->count < HR_MIN_BEATS_FOR_OUTLIERS) return false;
+
+    float mean = (float)hr->sum / (float)hr->count;
+    return fabsf((float)rr_ms - mean) > hr->cfg.outlier_ratio * mean;
+}
+
+static void _update_stats(HeartRate *hr, uint32_t rr_ms) {
+    HeartRateStats *s = &hr->stats;
+    float n = (float)hr->count;
+    float mean = (float)hr->sum / n;
+
+    s->hr_bpm = 60000.0f / (float)rr_ms;
+    s->mean_hr_bpm = 60000.0f / mean;
+    s->sdnn_ms = 0.0f;
+    if (hr->count > 1) {
+        //Exact in integers, n * sum_sq - sum^2 is never negative
+        uint64_t scaled_var = (uint64_t)hr->count * hr->sum_sq - hr->sum * hr->sum;
+        s->sdnn_ms = sqrtf((float)scaled_var / (n * (n - 1.0f)));
+    }
+    s->rmssd_ms = (hr->num_diffs > 0) ? sqrtf((float)hr->diff_sum_sq / (float)hr->num_diffs) : 0.0f;
+    s->beats = hr->count;
+}
+
+static void _push(HeartRate *hr, uint32_t rr_ms) {
+    uint32_t slot = hr->write;
+
+    //Drop the oldest interval once the horizon is full
+    if (hr->count == hr->cfg.horizon_beats) {
+        uint32_t old = hr->rr_ms[slot];
+        hr->sum -= old;
+        hr->sum_sq -= (uint64_t)old * old;
+        if (hr->diff_sq[slot] >= 0) {
+            hr->diff_sum_sq -= (uint64_t)hr->diff_sq[slot];
+            hr->num_diffs--;
+        }
+        hr->count--;
+    }
+
+    int32_t diff_sq = -1;
+    if (hr->chained && hr->count > 0) {
+        uint32_t prev = hr->rr_ms[(slot + hr->cfg.horizon_beats - 1) % hr->cfg.horizon_beats];
+        int32_t diff = (int32_t)rr_ms - (int32_t)prev;
+        diff_sq = diff * diff;
+        hr->diff_sum_sq += (uint64_t)diff_sq;
+        hr->num_diffs++;
+    }
+
+    hr->rr_ms[slot] = (uint16_t)rr_ms;
+    hr->diff_sq[slot] = diff_sq;
+    hr->sum += rr_ms;
+    hr->sum_sq += (uint64_t)rr_ms * rr_ms;
+    hr->count++;
+    hr->write = (slot + 1) % hr->cfg.horizon_beats;
+    hr->chained = true;
+}
+
+void heart_rate_add_s1(HeartRate *hr, uint32_t sample_index) {
+    bool had_last = hr->has_last_s1;
+    uint32_t interval = sample_index - hr->last_s1; //Wraps with the sample index
+    hr->last_s1 = sample_index;
+    hr->has_last_s1 = true;
+    if (!had_last) return;
+
+    uint32_t rr_ms = (uint32_t)(((uint64_t)interval * 1000) / MAX_SAMPLE_RATE);
+    if (_is_outlier(hr, rr_ms)) {
+        hr->rejected++;
+        hr->chained = false;
+        //A lasting change of rhythm rather than a missed or extra S1, start again from here
+        if (++hr->consecutive_rejects <= hr->cfg.max_rejects ||
+            rr_ms < hr->cfg.min_rr_ms || rr_ms > hr->cfg.max_rr_ms) {
+            return;
+        }
+        LOG_INF("Heart rate statistics restarted after %u rejected intervals", hr->consecutive_rejects);
+        _clear(hr);
+    }
+    hr->consecutive_rejects = 0;
+    _push(hr, rr_ms);
+    _update_stats(hr, rr_ms);
+}
+
+const HeartRateStats *heart_rate_get(const HeartRate *hr) {
+    return &hr->stats;
+}
+
+void heart_rate_log_stats(const HeartRate *hr) {
+    const HeartRateStats *s = &hr->stats;
+    LOG_INF("Heart rate %f bpm (mean %f), SDNN %f ms, RMSSD %f ms over %u beats, %u intervals rejected",
+            (double)s->hr_bpm, (double)s->mean_hr_bpm, (double)s->sdnn_ms, (double)s->rmssd_ms,
+            s->beats, hr->rejected);
+}
@@ -0,0 +1,57 @@
+#ifndef HEART_RATE_H
+#define HEART_RATE_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../macros.h"
+
+//Heart rate and variability from S1 to S1 (RR) intervals, O(1) per beat. Sums over the horizon
+//are kept in integer ms so they never drift as intervals enter and leave.
+typedef struct {
+    uint32_t horizon_beats;  //Intervals in the statistics, at most HR_MAX_HORIZON_BEATS
+    uint32_t min_rr_ms;      //Shorter intervals are rejected
+    uint32_t max_rr_ms;      //Longer intervals are rejected
+    float outlier_ratio;     //Intervals further than this fraction from the mean are rejected
+    uint32_t max_rejects;    //After this many rejections in a row the statistics restart
+} HeartRateConfig;
+
+typedef struct {
+    float hr_bpm;       //From the last accepted interval, 0 if none
+    float mean_hr_bpm;  //From the mean interval over the horizon
+    float sdnn_ms;      //Standard deviation of the intervals
+    float rmssd_ms;     //RMS of the successive interval differences
+    uint32_t beats;     //Intervals in the horizon
+} HeartRateStats;
+
+typedef struct {
+    HeartRateConfig cfg;
+    uint16_t rr_ms[HR_MAX_HORIZON_BEATS];
+    int32_t diff_sq[HR_MAX_HORIZON_BEATS]; //Squared difference to the previous interval, -1 if it was rejected
+    uint32_t write;
+    uint32_t count;
+    uint64_t sum;
+    uint64_t sum_sq;
+    uint64_t diff_sum_sq;
+    uint32_t num_diffs;
+    uint32_t last_s1;   //Sample index of the last S1
+    bool has_last_s1;
+    bool chained;       //The last interval was accepted, the next one has a successive difference
+    uint32_t consecutive_rejects;
+    uint32_t rejected;  //Since init
+    HeartRateStats stats;
+} HeartRate;
+
+void heart_rate_init(HeartRate *hr, const HeartRateConfig *cfg);
+
+//Forget the last S1, the next interval starts from the next S1. The statistics are kept.
+void heart_rate_break(HeartRate *hr);
+
+//Call with the sample index of every validated S1
+void heart_rate_add_s1(HeartRate *hr, uint32_t sample_index);
+
+const HeartRateStats *heart_rate_get(const HeartRate *hr);
+
+void heart_rate_log_stats(const HeartRate *hr);
+
+#endif
@@ -0,0 +1,147 @@
+#include "hsmm.h"
+#include <math.h>
+#include <errno.h>
+#include <string.h>
+
+#define HSMM_LOG_MIN (INT32_MIN / 2) //Impossible, with room to add to
+#define HSMM_DUR_NONE INT16_MIN
+
+BUILD_ASSERT(HSMM_MAX_DUR <= UINT8_MAX, "Durations are traced back as uint8_t");
+
+static inline int32_t _prev_state(int32_t j) {
+    return (j + HSMM_NUM_STATES - 1) % HSMM_NUM_STATES;
+}
+
+void hsmm_init(Hsmm *hsmm, const HsmmConfig *cfg) {
+    hsmm->cfg = *cfg;
+    hsmm->num_obs = 0;
+
+    //Gaussian over the centre of each level, the only floating point log taken
+    for (int32_t j = 0; j < HSMM_NUM_STATES; j++) {
+        float sd = (cfg->emission_sd[j] > 0.1f) ? cfg->emission_sd[j] : 0.1f;
+        for (int32_t l = 0; l < HSMM_NUM_LEVELS; l++) {
+            float x = ((float)(l - HSMM_NUM_LEVELS / 2) + 0.5f) / HSMM_LEVELS_PER_OCTAVE;
+            float z = (x - cfg->emission_mean[j]) / sd;
+            float logp = (-0.5f * z * z - logf(sd)) * (float)(1 << HSMM_LOG_Q);
+            hsmm->emission[j][l] = (int16_t)((logp < -32767.0f) ? -32767.0f : lroundf(logp));
+        }
+    }
+}
+
+//Unnormalised Gaussian in whole observations. Each cycle passes through every state once, so the
+//normalisation would add the same to every complete path.
+static void _set_duration(Hsmm *hsmm, int32_t j, float mean_ms, float sd_ms) {
+    int32_t mean_q4 = (int32_t)(mean_ms * 16.0f / HSMM_OBS_MS);
+    int32_t sd_q4 = (int32_t)(sd_ms * 16.0f / HSMM_OBS_MS);
+    if (mean_q4 < 16) mean_q4 = 16;
+    if (sd_q4 < 8) sd_q4 = 8;
+    int64_t limit = (int64_t)HSMM_DUR_SIGMAS * HSMM_DUR_SIGMAS * sd_q4 * sd_q4;
+
+    hsmm->dur_mean[j] = mean_q4 / 16;
+    hsmm->dur_max[j] = 0;
+    hsmm->duration[j][0] = HSMM_DUR_NONE;
+    for (int32_t d = 1; d <= HSMM_MAX_DUR; d++) {
+        int64_t diff = (int64_t)d * 16 - mean_q4;
+        if (diff * diff > limit) {
+            hsmm->duration[j][d] = HSMM_DUR_NONE;
+            continue;
+        }
+        hsmm->duration[j][d] = (int16_t)-((diff * diff << HSMM_LOG_Q) / (2 * (int64_t)sd_q4 * sd_q4));
+        hsmm->dur_max[j] = d;
+    }
+}
+
+int hsmm_begin(Hsmm *hsmm, const float *ste, int32_t ste_len, float period_ms) {
+    int32_t n = (ste_len + HSMM_DECIMATION - 1) / HSMM_DECIMATION;
+    hsmm->num_obs = 0;
+    if (n < HSMM_NUM_STATES || n > HSMM_MAX_OBS) return -EINVAL;
+
+    float mean = 0.0f;
+    for (int32_t k = 0; k < ste_len; k++) mean += ste[k];
+    mean /= (float)ste_len;
+    if (mean <= 0.0f) return -EINVAL;
+
+    memset(hsmm->cum[0], 0, sizeof(hsmm->cum[0]));
+    for (int32_t t = 0; t < n; t++) {
+        int32_t start = t * HSMM_DECIMATION;
+        int32_t end = (start + HSMM_DECIMATION < ste_len) ? start + HSMM_DECIMATION : ste_len;
+        float env = 0.0f;
+        for (int32_t k = start; k < end; k++) env += ste[k];
+        env /= (float)(end - start) * mean;
+
+        int32_t level = 0;
+        if (env > 0.0f) {
+            level = (int32_t)floorf(HSMM_LEVELS_PER_OCTAVE * log2f(env)) + HSMM_NUM_LEVELS / 2;
+            level = (level < 0) ? 0 : (level >= HSMM_NUM_LEVELS ? HSMM_NUM_LEVELS - 1 : level);
+        }
+        hsmm->obs[t] = (uint8_t)level;
+        for (int32_t j = 0; j < HSMM_NUM_STATES; j++) {
+            hsmm->cum[t + 1][j] = hsmm->cum[t][j] + hsmm->emission[j][level];
+        }
+    }
+
+    //S1 to S2 interval falls linearly with heart rate, systole never takes under 30% or over half the cycle
+    const HsmmConfig *cfg = &hsmm->cfg;
+    float interval_ms = WL_SYSTOLE_BASE_MS - WL_SYSTOLE_PER_BPM_MS * (60000.0f / period_ms);
+    if (interval_ms < 0.3f * period_ms) interval_ms = 0.3f * period_ms;
+    if (interval_ms > 0.5f * period_ms) interval_ms = 0.5f * period_ms;
+    float diastole_ms = period_ms - interval_ms - (float)cfg->s2_ms;
+
+    _set_duration(hsmm, HSMM_S1, (float)cfg->s1_ms, (float)cfg->s1_sd_ms);
+    _set_duration(hsmm, HSMM_SYSTOLE, interval_ms - (float)cfg->s1_ms, (float)cfg->systole_sd_ms);
+    _set_duration(hsmm, HSMM_S2, (float)cfg->s2_ms, (float)cfg->s2_sd_ms);
+    _set_duration(hsmm, HSMM_DIASTOLE, diastole_ms, cfg->diastole_sd_r * diastole_ms + (float)cfg->diastole_sd_ms);
+
+    hsmm->num_obs = n;
+    return n;
+}
+
+void hsmm_step(Hsmm *hsmm, int32_t t) {
+    bool last = (t == hsmm->num_obs - 1);
+
+    for (int32_t j = 0; j < HSMM_NUM_STATES; j++) {
+        int32_t prev = _prev_state(j);
+        int32_t best = HSMM_LOG_MIN;
+        int32_t best_d = 0;
+        int32_t d_max = (hsmm->dur_max[j] < t + 1) ? hsmm->dur_max[j] : t + 1;
+
+        for (int32_t d = 1; d <= d_max; d++) {
+            bool first = (d == t + 1);
+            int32_t dur = hsmm->duration[j][d];
+            //The window cuts the first and last state short, only overlong ones are penalised
+            if ((first || last) && d <= hsmm->dur_mean[j]) dur = 0;
+            if (dur == HSMM_DUR_NONE) continue;
+
+            int32_t from = first ? 0 : hsmm->delta[t - d][prev];
+            if (from <= HSMM_LOG_MIN) continue;
+
+            int32_t score = from + dur + hsmm->cum[t + 1][j] - hsmm->cum[t + 1 - d][j];
+            if (score > best) {
+                best = score;
+                best_d = d;
+            }
+        }
+        hsmm->delta[t][j] = best;
+        hsmm->best_dur[t][j] = (uint8_t)best_d;
+    }
+}
+
+int hsmm_decode(Hsmm *hsmm) {
+    int32_t t = hsmm->num_obs - 1;
+    if (t < 0) return -ENODATA;
+
+    int32_t j = 0;
+    for (int32_t k = 1; k < HSMM_NUM_STATES; k++) {
+        if (hsmm->delta[t][k] > hsmm->delta[t][j]) j = k;
+    }
+    if (hsmm->delta[t][j] <= HSMM_LOG_MIN) return -ENODATA;
+
+    while (t >= 0) {
+        int32_t d = hsmm->best_dur[t][j];
+        if (d <= 0) return -ENODATA;
+        for (int32_t k = t - d + 1; k <= t; k++) hsmm->path[k] = (uint8_t)j;
+        t -= d;
+        j = _prev_state(j);
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef HSMM_H
+#define HSMM_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include "../../macros.h"
+
+//Duration dependent hidden semi-Markov model of the cardiac cycle (after Springer et al.) over
+//the STE envelope. States follow each other in a fixed cycle, so a state's predecessor is
+//implied and the trellis only keeps the best duration per state. All buffers are sized for
+//HSMM_MAX_OBS, and the Viterbi runs in Q8 integer log probabilities one observation at a time.
+
+typedef enum {
+    HSMM_S1,
+    HSMM_SYSTOLE,
+    HSMM_S2,
+    HSMM_DIASTOLE,
+    HSMM_NUM_STATES
+} HsmmState;
+
+typedef struct {
+    //Emissions, log2 of the envelope over its window mean
+    float emission_mean[HSMM_NUM_STATES];
+    float emission_sd[HSMM_NUM_STATES];
+    //Durations, systole and diastole follow from the heart rate
+    uint32_t s1_ms;
+    uint32_t s1_sd_ms;
+    uint32_t s2_ms;
+    uint32_t s2_sd_ms;
+    uint32_t systole_sd_ms;
+    float diastole_sd_r;     //Diastole sd is this fraction of its mean...
+    uint32_t diastole_sd_ms; //...plus this
+} HsmmConfig;
+
+typedef struct {
+    HsmmConfig cfg;
+    int16_t emission[HSMM_NUM_STATES][HSMM_NUM_LEVELS];
+    int16_t duration[HSMM_NUM_STATES][HSMM_MAX_DUR + 1]; //For the current window
+    int32_t dur_mean[HSMM_NUM_STATES];
+    int32_t dur_max[HSMM_NUM_STATES];
+    int32_t num_obs;
+    uint8_t obs[HSMM_MAX_OBS];
+    int32_t cum[HSMM_MAX_OBS + 1][HSMM_NUM_STATES]; //Running sums of the emissions
+    int32_t delta[HSMM_MAX_OBS][HSMM_NUM_STATES];   //Best path with a state ending at each observation
+    uint8_t best_dur[HSMM_MAX_OBS][HSMM_NUM_STATES];
+    uint8_t path[HSMM_MAX_OBS];                     //Decoded state of each observation
+} Hsmm;
+
+void hsmm_init(Hsmm *hsmm, const HsmmConfig *cfg);
+
+//Quantises the envelope of ste[0..ste_len) and sets the duration tables for a cardiac period of
+//period_ms. Returns the number of observations to step, -EINVAL if the window doesn't fit.
+int hsmm_begin(Hsmm *hsmm, const float *ste, int32_t ste_len, float period_ms);
+
+//Fills the trellis for observation t, call for t = 0 .. num_obs - 1 in order
+void hsmm_step(Hsmm *hsmm, int32_t t);
+
+//Traces the best path back into hsmm->path. Returns -ENODATA if no path fits the durations.
+int hsmm_decode(Hsmm *hsmm);
+
+#endif
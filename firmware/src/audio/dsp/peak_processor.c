@@ -11,12 +11,17 @@ static int32_t compute_pre_samples(int32_t avg_cardiac_period_samples, float pre
     return pre;
 }
 
-void peak_processor_init(PeakProcessor *proc, const PeakProcessorConfig *conf, PeakProcessFn fn)
+void peak_processor_init(PeakProcessor *proc, const PeakProcessorConfig *conf, WindowPool *pool, PeakProcessFn fn)
 { 
     proc->has_previous_s1 = false;
+    proc->pool = pool;
     proc->process_fn = fn;
     proc->config = *conf;
-    proc->window_len = 0;
+}
+
+void peak_processor_reset(PeakProcessor *proc)
+{
+    proc->has_previous_s1 = false;
 }
 
 void peak_processor_process_peak(PeakProcessor *proc, const RTPeakMessage *peak_message, const CircularBlockBuffer *slab_buffer)
@@ -33,23 +38,23 @@ void peak_processor_process_peak(PeakProcessor *proc, const RTPeakMessage *peak_
                     proc->config.pre_min_samples,
                     proc->config.pre_max_samples
                 );
-                int32_t window_start_index = s1_idx_prev - pre_samples;
-                int32_t window_len = s1_idx_curr - window_start_index;
-
-                if (window_len > 0 && window_len <= PP_MAX_WINDOW_LEN) {
-                    int ret = cbb_extract_window(
-                        slab_buffer, s1_idx_prev, s1_idx_curr,
-                        pre_samples, -pre_samples,
-                        proc->window, &window_len
-                    );
-                    if (ret == 0 && proc->process_fn) {
-                        proc->window_len = window_len;
-                        proc->process_fn(proc->window, window_start_index, window_len);
-                    } else {
-                        LOG_ERR("Window extraction failed or window too long");
-                    }
+                CbbWindowInfo info;
+                int ret = cbb_plan_window(
+                    slab_buffer, s1_idx_prev, s1_idx_curr,
+                    pre_samples, -pre_samples, &info
+                );
+                WindowSlot *slot = (ret == 0) ? window_pool_alloc(proc->pool, info.len) : NULL;
+                if (slot) {
+                    slot->info = info;
+                    //Due before the next S1, expected one cardiac period from now
+                    slot->release_cyc = k_cycle_get_32();
+                    slot->deadline_cyc = k_us_to_cyc_ceil32((uint32_t)(((uint64_t)cardiac_period_samples * USEC_PER_SEC) / MAX_SAMPLE_RATE));
+                    slot->valid = (cbb_copy_window(slab_buffer, &info, slot->samples) == 0);
+                    proc->process_fn(slot);
+                } else if (ret == 0) {
+                    LOG_WRN("No room for window of %d samples, dropped", info.len);
                 } else {
-                    LOG_ERR("Invalid window_len: %d (MAX %d)", window_len, PP_MAX_WINDOW_LEN);
+                    LOG_ERR("Window extraction failed, cardiac period %d samples", cardiac_period_samples);
                 }
             }
         }
@@ -3,12 +3,14 @@
 
 #include "peak_validator.h"         
 #include "circular_block_buffer.h" 
+#include "window_pool.h"
 #include <zephyr/kernel.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include "../../macros.h"
 
-typedef void (*PeakProcessFn)(const float *window, int32_t window_start_idx, int32_t window_len);
+//Takes ownership of an extracted window, slot->info describes it, see cbb_plan_window
+typedef void (*PeakProcessFn)(WindowSlot *slot);
 
 typedef struct {
     float pre_ratio;
@@ -19,13 +21,15 @@ typedef struct {
 typedef struct {
     RTPeakMessage previous_s1_event;
     bool has_previous_s1;
-    float window[PP_MAX_WINDOW_LEN];
-    int32_t window_len;
+    WindowPool *pool; //Windows are extracted into slots of the pool, owned by the caller
     PeakProcessFn process_fn;
     PeakProcessorConfig config;
 } PeakProcessor;
 
-void peak_processor_init(PeakProcessor *proc, const PeakProcessorConfig *conf, PeakProcessFn fn);
+void peak_processor_init(PeakProcessor *proc, const PeakProcessorConfig *conf, WindowPool *pool, PeakProcessFn fn);
+
+//Forget the previous S1, the next window starts from the next S1 seen
+void peak_processor_reset(PeakProcessor *proc);
 
 // Process a single peak message 
 void peak_processor_process_peak(PeakProcessor *proc, const RTPeakMessage *peak_message, const CircularBlockBuffer *slab_buffer);
@@ -1,5 +1,6 @@
 #include "peak_validator.h"
 #include <zephyr/logging/log.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(peak_validator);
 
@@ -10,7 +11,28 @@ void rt_peak_validator_init(RTPeakValidator* peak_validator, RTPeakValConfig *pe
     peak_validator->close_r = peak_validator_conf->close_r;
     peak_validator->far_r = peak_validator_conf->far_r;
     peak_validator->margin = peak_validator_conf->margin;
-    peak_validator->peak_msgq = peak_validator_conf->peak_msgq;
+    peak_validator->peak_ring = peak_validator_conf->peak_ring;
+}
+
+void rt_peak_validator_save(const RTPeakValidator* peak_validator, RTPeakValSnapshot *snapshot) {
+    memcpy(snapshot->buffer, peak_validator->buffer, sizeof(snapshot->buffer));
+    snapshot->write_idx = peak_validator->write_idx;
+    snapshot->valid_count = peak_validator->valid_count;
+}
+
+void rt_peak_validator_restore(RTPeakValidator* peak_validator, const RTPeakValSnapshot *snapshot,
+                               int32_t index_offset, int32_t now_index, int32_t max_age) {
+    if (snapshot->valid_count == 0 || snapshot->write_idx >= PEAK_BUF_SIZE) return;
+
+    int newest = (snapshot->write_idx + PEAK_BUF_SIZE - 1) % PEAK_BUF_SIZE;
+    if (now_index - (snapshot->buffer[newest].global_index + index_offset) > max_age) return;
+
+    for (int i = 0; i < PEAK_BUF_SIZE; i++) {
+        peak_validator->buffer[i] = snapshot->buffer[i];
+        peak_validator->buffer[i].global_index += index_offset;
+    }
+    peak_validator->write_idx = snapshot->write_idx;
+    peak_validator->valid_count = MIN(snapshot->valid_count, PEAK_BUF_SIZE);
 }
 
 void rt_peak_validator_update(RTPeakValidator* peak_validator) {
@@ -66,9 +88,9 @@ int rt_peak_validator_notify_peak(RTPeakValidator* peak_validator, RTPeakMessage
         p1->type = RT_PEAK_UNVAL;
         //Don't accept peak
     }
-    int ret = k_msgq_put(peak_validator->peak_msgq, p1, K_NO_WAIT);
+    int ret = spsc_ring_put(peak_validator->peak_ring, p1);
     if (ret != 0) {
-        LOG_ERR("peak_validator: Failed to put message: global_index=%d type=%d, k_msgq_put returned %d", p1->global_index, p1->type, ret);
+        LOG_ERR("peak_validator: Failed to put message: global_index=%d type=%d, spsc_ring_put returned %d", p1->global_index, p1->type, ret);
     }
     return ret;
 }
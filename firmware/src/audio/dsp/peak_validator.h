@@ -3,6 +3,7 @@
 
 #include <zephyr/kernel.h>
 #include "rt_peak_detector.h"
+#include "../spsc_ring.h"
 
 #define PEAK_BUF_SIZE 3
 
@@ -10,7 +11,7 @@ typedef struct {
     float close_r;
     float far_r;
     float margin;
-    struct k_msgq *peak_msgq;
+    SpscRing *peak_ring;
 } RTPeakValConfig;
 
 typedef struct {
@@ -21,13 +22,28 @@ typedef struct {
     float close_r;
     float far_r;
     float margin;
-    struct k_msgq *peak_msgq;
+    SpscRing *peak_ring;
 } RTPeakValidator;
 
+//Peak history carried between sessions
+typedef struct {
+    RTPeakMessage buffer[PEAK_BUF_SIZE];
+    uint32_t write_idx;
+    uint32_t valid_count;
+} RTPeakValSnapshot;
+
 void rt_peak_validator_init(RTPeakValidator* peak_validator, RTPeakValConfig *peak_validator_conf);
 
 void rt_peak_validator_update(RTPeakValidator* peak_validator);
 
+void rt_peak_validator_save(const RTPeakValidator* peak_validator, RTPeakValSnapshot *snapshot);
+
+//Move the saved peaks by index_offset onto the current timeline. The history is only restored if
+//the newest peak is at most max_age samples before now_index, an older one can't be paired with
+//the next peak.
+void rt_peak_validator_restore(RTPeakValidator* peak_validator, const RTPeakValSnapshot *snapshot,
+                               int32_t index_offset, int32_t now_index, int32_t max_age);
+
 int rt_peak_validator_notify_peak(RTPeakValidator* peak_validator, RTPeakMessage new_peak);
 
 #endif
@@ -10,12 +10,31 @@ void rt_peak_detector_init(RTPeakDetector *det, RTPeakConfig *rt_peak_config)
         det->samples[i] = 0.0f;
     det->index = 0;
     det->running_mean = 0.0f;
+    det->primed = false;
     det->alpha = rt_peak_config->alpha;
     det->threshold_scale = rt_peak_config->threshold_scale;
     det->min_distance = rt_peak_config->min_distance_samples;
     det->samples_since_peak = UINT32_MAX;
 }
 
+void rt_peak_detector_prime(RTPeakDetector *det, const float *block, uint32_t len)
+{
+    if (det->primed || len == 0) return;
+
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += block[i];
+    }
+    det->running_mean = sum / (float)len;
+    det->primed = true;
+}
+
+void rt_peak_detector_set_mean(RTPeakDetector *det, float running_mean)
+{
+    det->running_mean = running_mean;
+    det->primed = true;
+}
+
 bool rt_peak_detector_update(RTPeakDetector *det,
                              float x,
                              int32_t global_index,
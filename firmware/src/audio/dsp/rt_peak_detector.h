@@ -16,7 +16,9 @@ typedef struct {
 typedef enum {
     RT_PEAK_UNVAL,
     RT_PEAK_S1,
-    RT_PEAK_S2
+    RT_PEAK_S2,
+    RT_PEAK_SYNC, //Not a peak, marks the point the peak ring has been drained up to
+    RT_PEAK_GAP,  //Not a peak, the timeline skipped ahead and beat timing restarts
 } RTPeakType;
 
 typedef struct {
@@ -31,6 +33,7 @@ typedef struct {
     float samples[3];
     uint8_t index;
     float running_mean;
+    bool primed; //running_mean has been seeded
     float alpha;
     float threshold_scale;
     uint32_t min_distance;
@@ -39,6 +42,12 @@ typedef struct {
 
 void rt_peak_detector_init(RTPeakDetector *det, RTPeakConfig *rt_peak_config);
 
+//Seed the running mean from the first block instead of converging up from zero, no effect once seeded
+void rt_peak_detector_prime(RTPeakDetector *det, const float *block, uint32_t len);
+
+//Restore a running mean saved from an earlier session
+void rt_peak_detector_set_mean(RTPeakDetector *det, float running_mean);
+
 bool rt_peak_detector_update(RTPeakDetector *det,
                              float x,
                              int32_t global_index,
@@ -0,0 +1,97 @@
+#include "signal_quality.h"
+#include <zephyr/logging/log.h>
+#include "arm_math.h"
+
+LOG_MODULE_REGISTER(signal_quality);
+
+static float _clamp01(float x) {
+    return (x < 0.0f) ? 0.0f : ((x > 1.0f) ? 1.0f : x);
+}
+
+void signal_quality_init(SignalQuality *sq, const SignalQualityConfig *cfg) {
+    sq->cfg = *cfg;
+    sq->clip_rate = 0.0f;
+    sq->raw_energy = 0.0f;
+    sq->env_write = 0;
+    sq->env_count = 0;
+    sq->periodicity = 0.0f;
+    sq->sqi = 1.0f; //Don't gate until there is something to judge by
+}
+
+void signal_quality_measure_input(SignalQuality *sq, const float *block, uint32_t len) {
+    uint32_t clipped = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        if (fabsf(block[i]) >= sq->cfg.clip_level) {
+            clipped++;
+        }
+    }
+    sq->clip_rate = (float)clipped / (float)len;
+    //Variance rather than power, so a DC offset on the input doesn't count as out of band energy
+    arm_var_f32(block, len, &sq->raw_energy);
+}
+
+//Normalised autocorrelation peak of the decimated envelope, across lags of SQ_MIN_LAG to SQ_MAX_LAG
+static float _envelope_periodicity(const SignalQuality *sq) {
+    uint32_t n = sq->env_count;
+    uint32_t oldest = (sq->env_write + SQ_ENV_HISTORY_LEN - n) % SQ_ENV_HISTORY_LEN;
+
+    float mean = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        mean += sq->env_history[(oldest + i) % SQ_ENV_HISTORY_LEN];
+    }
+    mean /= (float)n;
+
+    float energy = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        float x = sq->env_history[(oldest + i) % SQ_ENV_HISTORY_LEN] - mean;
+        energy += x * x;
+    }
+    if (energy <= 0.0f) return 0.0f;
+
+    float best = 0.0f;
+    for (uint32_t lag = SQ_MIN_LAG; lag <= SQ_MAX_LAG && lag < n; lag++) {
+        float acc = 0.0f;
+        for (uint32_t i = 0; i + lag < n; i++) {
+            float a = sq->env_history[(oldest + i) % SQ_ENV_HISTORY_LEN] - mean;
+            float b = sq->env_history[(oldest + i + lag) % SQ_ENV_HISTORY_LEN] - mean;
+            acc += a * b;
+        }
+        if (acc > best) best = acc;
+    }
+    return best / energy;
+}
+
+void signal_quality_update(SignalQuality *sq, const float *filtered, const float *envelope, uint32_t len) {
+    float band_energy;
+    arm_var_f32(filtered, len, &band_energy);
+
+    for (uint32_t i = 0; i + SQ_ENV_DECIMATION <= len; i += SQ_ENV_DECIMATION) {
+        float mean;
+        arm_mean_f32(&envelope[i], SQ_ENV_DECIMATION, &mean);
+        sq->env_history[sq->env_write] = mean;
+        sq->env_write = (sq->env_write + 1) % SQ_ENV_HISTORY_LEN;
+        if (sq->env_count < SQ_ENV_HISTORY_LEN) sq->env_count++;
+    }
+
+    float clip_score = _clamp01(1.0f - sq->clip_rate / sq->cfg.clip_rate_max);
+    float band_ratio = (sq->raw_energy > 0.0f) ? band_energy / sq->raw_energy : 0.0f;
+    float band_score = _clamp01(band_ratio / sq->cfg.band_ratio_good);
+
+    //Periodicity needs a couple of beats of history before it means anything
+    float period_score = 1.0f;
+    if (sq->env_count > SQ_MAX_LAG) {
+        sq->periodicity = _envelope_periodicity(sq);
+        period_score = _clamp01(sq->periodicity / sq->cfg.periodicity_good);
+    }
+
+    float block_sqi = clip_score * band_score * period_score;
+    sq->sqi += sq->cfg.alpha * (block_sqi - sq->sqi);
+}
+
+float signal_quality_get(const SignalQuality *sq) {
+    return sq->sqi;
+}
+
+bool signal_quality_is_good(const SignalQuality *sq, float sqi) {
+    return sqi >= sq->cfg.sqi_thresh;
+}
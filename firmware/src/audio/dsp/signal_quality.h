@@ -0,0 +1,46 @@
+#ifndef SIGNAL_QUALITY_H
+#define SIGNAL_QUALITY_H
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../macros.h"
+
+//Cheap per block signal quality index (SQI) in [0, 1], the product of three scores:
+//  clipping: fraction of input samples at full scale
+//  band energy: energy left after the 30-150hz bandpass relative to the input energy
+//  periodicity: peak of the envelope's autocorrelation over plausible heart rates
+typedef struct {
+    float clip_level;        //|sample| at or above this counts as clipped (full scale = 1.0)
+    float clip_rate_max;     //Clipped fraction scoring zero
+    float band_ratio_good;   //Band to input energy ratio scoring one
+    float periodicity_good;  //Normalised autocorrelation peak scoring one
+    float alpha;             //Smoothing of the SQI per block
+    float sqi_thresh;        //Windows below this are not analysed
+} SignalQualityConfig;
+
+typedef struct {
+    SignalQualityConfig cfg;
+    float clip_rate;
+    float raw_energy;
+    float env_history[SQ_ENV_HISTORY_LEN]; //Envelope decimated to SQ_ENV_RATE
+    uint32_t env_write;
+    uint32_t env_count;
+    float periodicity;
+    float sqi;
+} SignalQuality;
+
+void signal_quality_init(SignalQuality *sq, const SignalQualityConfig *cfg);
+
+//Call on the input block before the bandpass
+void signal_quality_measure_input(SignalQuality *sq, const float *block, uint32_t len);
+
+//Call with the bandpassed block and its envelope, updates the SQI
+void signal_quality_update(SignalQuality *sq, const float *filtered, const float *envelope, uint32_t len);
+
+//Safe to read from other threads
+float signal_quality_get(const SignalQuality *sq);
+
+bool signal_quality_is_good(const SignalQuality *sq, float sqi);
+
+#endif
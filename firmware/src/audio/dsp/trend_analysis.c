@@ -29,6 +29,31 @@ void trend_analyser_update(TrendAnalyser* ta, float timestamp_ms, float feature_
     }
 }
 
+void trend_analyser_save(const TrendAnalyser* ta, TrendSnapshot* snapshot)
+{
+    for (int32_t i = 0; i < TREND_ANALYSER_MAX_BUFFER; i++) {
+        snapshot->timestamp_ms[i] = ta->timestamp_ms[i];
+        snapshot->feature_values[i] = ta->feature_values[i];
+    }
+    snapshot->buffer_size = ta->buffer_size;
+    snapshot->write_idx = ta->write_idx;
+    snapshot->count = ta->count;
+}
+
+void trend_analyser_restore(TrendAnalyser* ta, const TrendSnapshot* snapshot, float time_offset)
+{
+    if (snapshot->buffer_size != ta->buffer_size || snapshot->count > ta->buffer_size ||
+        snapshot->write_idx >= ta->buffer_size || snapshot->write_idx < 0) {
+        return;
+    }
+    for (int32_t i = 0; i < TREND_ANALYSER_MAX_BUFFER; i++) {
+        ta->timestamp_ms[i] = snapshot->timestamp_ms[i] + time_offset;
+        ta->feature_values[i] = snapshot->feature_values[i];
+    }
+    ta->write_idx = snapshot->write_idx;
+    ta->count = snapshot->count;
+}
+
 int trend_analyser_get_slope(TrendAnalyser* ta, float* slope_out)
 {
     if (ta->count < ta->min_windows) {
@@ -15,12 +15,27 @@ typedef struct {
     int32_t count;
 } TrendAnalyser;
 
+//Trend history carried between sessions
+typedef struct {
+    float timestamp_ms[TREND_ANALYSER_MAX_BUFFER];
+    float feature_values[TREND_ANALYSER_MAX_BUFFER];
+    int32_t buffer_size;
+    int32_t write_idx;
+    int32_t count;
+} TrendSnapshot;
+
 void trend_analyser_init(TrendAnalyser* ta, int32_t buffer_size, float slope_thresh, int32_t min_windows);
 
 void trend_analyser_update(TrendAnalyser* ta, float timestamp_ms, float feature_val);
 
 int trend_analyser_get_slope(TrendAnalyser* ta, float* slope_out);
 
+void trend_analyser_save(const TrendAnalyser* ta, TrendSnapshot* snapshot);
+
+//time_offset is added to every restored timestamp to move it onto the current timeline.
+//Nothing is restored if the buffer size has changed since the snapshot was taken.
+void trend_analyser_restore(TrendAnalyser* ta, const TrendSnapshot* snapshot, float time_offset);
+
 bool trend_analyser_is_alert(TrendAnalyser* ta);
 
 #endif // TREND_ANALYSIS_H
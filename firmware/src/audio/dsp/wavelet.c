@@ -0,0 +1,72 @@
+#include "wavelet.h"
+
+//Elements of one level are x[i * s], i < m. Odd elements become details, even ones approximations.
+//Boundaries use symmetric extension. Each pass runs over elements [first, end) of its level only.
+
+static void _predict(float *x, int32_t m, int32_t s, float sign, int32_t first, int32_t end) {
+    for (int32_t i = first | 1; i < end; i += 2) {
+        float left = x[(i - 1) * s];
+        float right = (i + 1 < m) ? x[(i + 1) * s] : left;
+        x[i * s] -= sign * 0.5f * (left + right);
+    }
+}
+
+static void _update(float *x, int32_t m, int32_t s, float sign, int32_t first, int32_t end) {
+    for (int32_t i = (first + 1) & ~1; i < end; i += 2) {
+        float right = (i + 1 < m) ? x[(i + 1) * s] : x[(i - 1) * s];
+        float left = (i > 0) ? x[(i - 1) * s] : right;
+        x[i * s] += sign * 0.25f * (left + right);
+    }
+}
+
+static int32_t _level_len(int32_t n, int32_t s) {
+    return (n + s - 1) / s;
+}
+
+//Level of a pass, forward passes go up the levels and inverse ones back down
+static int32_t _pass_level(int32_t levels, int32_t pass, bool inverse) {
+    return inverse ? levels - 1 - pass / 2 : pass / 2;
+}
+
+int32_t wl_pass_len(int32_t n, int32_t levels, int32_t pass, bool inverse) {
+    int32_t m = _level_len(n, 1 << _pass_level(levels, pass, inverse));
+    return (m < 2) ? 0 : m;
+}
+
+void wl_forward_part(float *x, int32_t n, int32_t levels, int32_t pass, int32_t first, int32_t end) {
+    int32_t s = 1 << _pass_level(levels, pass, false);
+    int32_t m = _level_len(n, s);
+    if (m < 2) return;
+    if (pass & 1) {
+        _update(x, m, s, 1.0f, first, end);
+    } else {
+        _predict(x, m, s, 1.0f, first, end);
+    }
+}
+
+void wl_inverse_part(float *x, int32_t n, int32_t levels, int32_t pass, int32_t first, int32_t end) {
+    int32_t s = 1 << _pass_level(levels, pass, true);
+    int32_t m = _level_len(n, s);
+    if (m < 2) return;
+    if (pass & 1) {
+        _predict(x, m, s, -1.0f, first, end);
+    } else {
+        _update(x, m, s, -1.0f, first, end);
+    }
+}
+
+void wl_forward(float *x, int32_t n, int32_t levels) {
+    for (int32_t pass = 0; pass < WL_NUM_PASSES(levels); pass++) {
+        wl_forward_part(x, n, levels, pass, 0, wl_pass_len(n, levels, pass, false));
+    }
+}
+
+void wl_inverse(float *x, int32_t n, int32_t levels) {
+    for (int32_t pass = 0; pass < WL_NUM_PASSES(levels); pass++) {
+        wl_inverse_part(x, n, levels, pass, 0, wl_pass_len(n, levels, pass, true));
+    }
+}
+
+int32_t wl_num_approx(int32_t n, int32_t levels) {
+    return _level_len(n, 1 << levels);
+}
@@ -0,0 +1,24 @@
+#ifndef WAVELET_H
+#define WAVELET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//In place CDF 5/3 lifting DWT. After wl_forward the level L approximation of x[0..n) sits at
+//x[k << L] and the details of level l at the odd multiples of 1 << (l - 1). wl_inverse restores
+//x to rounding error, so a window can be transformed, read and handed back unchanged.
+void wl_forward(float *x, int32_t n, int32_t levels);
+void wl_inverse(float *x, int32_t n, int32_t levels);
+
+//The same transforms in parts: each is WL_NUM_PASSES lifting passes over the wl_pass_len elements
+//of one level. Running elements [first, end) of every pass in order, in any number of parts,
+//gives the same result as the whole transform.
+#define WL_NUM_PASSES(levels) (2 * (levels))
+int32_t wl_pass_len(int32_t n, int32_t levels, int32_t pass, bool inverse);
+void wl_forward_part(float *x, int32_t n, int32_t levels, int32_t pass, int32_t first, int32_t end);
+void wl_inverse_part(float *x, int32_t n, int32_t levels, int32_t pass, int32_t first, int32_t end);
+
+//Number of level L approximation coefficients of n samples
+int32_t wl_num_approx(int32_t n, int32_t levels);
+
+#endif
@@ -1,19 +1,13 @@
 #include <zephyr/logging/log.h>
 #include <stdlib.h>
 #include "window_analysis.h"
-#include "../../ble/heart_service.h"
+#include "wavelet.h"
+#include "../../ble/beat_history.h"
+#include "../../ble/beacon.h"
 
 
 LOG_MODULE_REGISTER(window_analysis);
 
-void _generate_hann_window(float *buf, uint32_t N) {
-    if (!buf || N <= 0) return;
-    for (int32_t n = 0; n < N; ++n) {
-        buf[n] = 0.5f * (1.0f - cosf(2.0f * M_PI * n / (N - 1)));
-        //LOG_INF("%f", buf[n]);
-    }
-}
-
 void wa_init(WindowAnalysis *window_analysis, const WindowAnalysisConfig *window_analysis_config)
 {
     if (!window_analysis || !window_analysis_config) return;
@@ -21,31 +15,64 @@ void wa_init(WindowAnalysis *window_analysis, const WindowAnalysisConfig *window
     window_analysis->cfg = *window_analysis_config;
     window_analysis->audio_window = NULL;
     window_analysis->audio_window_len = 0;
+    window_analysis->consumers = 0;
+    window_analysis->audio_window_dec_len = 0;
+    window_analysis->audio_window_span = 0;
     window_analysis->ste_window_len = 0;
     window_analysis->ste_mean = 0.0;
     window_analysis->num_peaks = 0;
+    window_analysis->step = WA_STEP_DONE;
+    window_analysis->step_index = 0;
+    window_analysis->slice_count = 0;
+    window_analysis->slice_max_cycles = 0;
+    window_analysis->segmenter = window_analysis_config->segmenter;
+    window_analysis->s1_offset = 0;
+    memset(window_analysis->seg_cycles, 0, sizeof(window_analysis->seg_cycles));
+    memset(window_analysis->seg_count, 0, sizeof(window_analysis->seg_count));
+    hsmm_init(&window_analysis->hsmm, &window_analysis_config->hsmm);
+    window_analysis->hsmm_fallbacks = 0;
 
-    _generate_hann_window(window_analysis->hann_window, window_analysis_config->hs_window_size);
-    arm_rfft_fast_init_f32(&window_analysis->fft_instance, (uint16_t)window_analysis_config->hs_window_size);
+    fe_init(&window_analysis->fe, window_analysis_config->hs_window_size, window_analysis_config->history_decimation);
     //Memset buffers
     memset(window_analysis->ste_buffer, 0, sizeof(window_analysis->ste_buffer));
-    memset(window_analysis->scratch_windowed, 0, sizeof(window_analysis->scratch_windowed));
-    memset(window_analysis->scratch_fft_out, 0, sizeof(window_analysis->scratch_fft_out));
-    memset(window_analysis->scratch_fft_mag, 0, sizeof(window_analysis->scratch_fft_mag));
     memset(window_analysis->peaks, 0, sizeof(window_analysis->peaks));
+    memset(window_analysis->sound_features, 0, sizeof(window_analysis->sound_features));
 
     trend_analyser_init(&window_analysis->ta_s1_rms, window_analysis_config->ta_rms_buf_size, window_analysis_config->ta_rms_slope_thresh, window_analysis_config->ta_rms_min_windows);
     trend_analyser_init(&window_analysis->ta_s2_rms, window_analysis_config->ta_rms_buf_size, window_analysis_config->ta_rms_slope_thresh, window_analysis_config->ta_rms_min_windows);
     trend_analyser_init(&window_analysis->ta_s1_centroid, window_analysis_config->ta_centroid_buf_size, window_analysis_config->ta_centroid_slope_thresh, window_analysis_config->ta_centroid_min_windows);
     trend_analyser_init(&window_analysis->ta_s2_centroid, window_analysis_config->ta_centroid_buf_size, window_analysis_config->ta_centroid_slope_thresh, window_analysis_config->ta_centroid_min_windows);
+
+    classifier_init(&window_analysis->classifier);
+
+    //Segment trends only report a slope
+    for (int32_t g = 0; g < WA_NUM_SEGMENTS; g++) {
+        trend_analyser_init(&window_analysis->ta_segment_ratio[g], TREND_ANALYSER_MAX_BUFFER, 0.0f, window_analysis_config->ta_rms_min_windows);
+    }
+
+    //Further trended features only report a slope, alerts stay on RMS and centroid
+    window_analysis->num_feature_trends = 0;
+    uint32_t extra = window_analysis_config->feature_trend_mask & ~(FE_MASK(FE_RMS) | FE_MASK(FE_CENTROID));
+    for (uint32_t id = 0; id < FE_NUM_FEATURES && window_analysis->num_feature_trends < FE_MAX_TRENDS; id++) {
+        if (!(extra & FE_MASK(id))) continue;
+        int32_t t = window_analysis->num_feature_trends++;
+        window_analysis->feature_trend_ids[t] = (FeatureId)id;
+        trend_analyser_init(&window_analysis->feature_trends[t], TREND_ANALYSER_MAX_BUFFER, 0.0f, window_analysis_config->ta_rms_min_windows);
+    }
 }
 
-void wa_set_audio_window(WindowAnalysis *window_analysis, const float *audio_window, int32_t window_len, uint32_t window_start_idx)
+//Full rate span covered by the decimated head of the window
+static inline int32_t _dec_span(const WindowAnalysis *wa)
 {
-    if (!window_analysis) return;
-    window_analysis->window_start_idx = window_start_idx;
-    window_analysis->audio_window = audio_window;
-    window_analysis->audio_window_len = window_len;
+    return wa->audio_window_dec_len * (int32_t)wa->cfg.history_decimation;
+}
+
+//Map a full rate position in the window to an index into audio_window
+static inline int32_t _window_index(const WindowAnalysis *wa, int32_t pos)
+{
+    int32_t dec_span = _dec_span(wa);
+    if (pos < dec_span) return pos / (int32_t)wa->cfg.history_decimation;
+    return wa->audio_window_dec_len + (pos - dec_span);
 }
 
 
@@ -57,29 +84,100 @@ float compute_mean_abs(const float *window, int32_t len)
     return abs_sum / len;
 }
 
-void _hard_limit(const float *window, int32_t len, float mean, float threshold, float *out)
+static int32_t _ste_num_blocks(const WindowAnalysis *wa)
 {
-    float hl_thresh = mean * threshold;
-    for (int32_t i = 0; i < len; i++)
-        out[i] = (fabsf(window[i]) > hl_thresh) ? window[i] : 0.0f;
+    int32_t num_blocks = wa->audio_window_span / (int32_t)wa->cfg.ste_block_size_samples;
+    return (num_blocks > STE_MAX_BUF_LEN) ? STE_MAX_BUF_LEN : num_blocks;
 }
 
-void wa_calc_ste_blocks(WindowAnalysis *window_analysis)
+void wa_set_audio_window(WindowAnalysis *window_analysis, float *audio_window, int32_t window_len, int32_t dec_len, uint32_t window_start_idx)
 {
-    if (!window_analysis || !window_analysis->audio_window) return;
+    if (!window_analysis) return;
+    window_analysis->window_start_idx = window_start_idx;
+    window_analysis->audio_window = audio_window;
+    window_analysis->audio_window_len = window_len;
+    window_analysis->audio_window_dec_len = dec_len;
+    window_analysis->audio_window_span = dec_len * (int32_t)window_analysis->cfg.history_decimation + (window_len - dec_len);
+    window_analysis->ste_window_len = _ste_num_blocks(window_analysis);
+    window_analysis->num_peaks = 0;
+    window_analysis->ste_hl_level = 0.0f;
+    window_analysis->abnormal_p = -1.0f;
+    window_analysis->segments[WA_SEGMENT_SYSTOLE].valid = false;
+    window_analysis->segments[WA_SEGMENT_DIASTOLE].valid = false;
+    window_analysis->sound_features[0].mask = 0;
+    window_analysis->sound_features[1].mask = 0;
+    window_analysis->step = WA_STEP_STE;
+    window_analysis->step_index = 0;
+}
 
-    uint32_t block_size = window_analysis->cfg.ste_block_size_samples;
-    int32_t num_blocks = window_analysis->audio_window_len / block_size;
-    window_analysis->ste_window_len = num_blocks; 
+void wa_set_consumers(WindowAnalysis *wa, uint32_t consumers)
+{
+    wa->consumers = consumers;
+}
 
-    for (int32_t k = 0; k < num_blocks; k++) {
-        float sum = 0.0f;
-        int32_t start = k * block_size;
-        for (uint32_t i = 0; i < block_size; i++) {   
-            float v = window_analysis->audio_window[start + i];
-            sum += v * v;
+//Beat packets go out live, into the beat history and the beacon
+#define WA_PACKET_CONSUMERS (DSP_CONSUMER_PACKET | DSP_CONSUMER_HISTORY | DSP_CONSUMER_BEACON)
+
+//The classifier only runs for alerts, on windows past the signal quality gate
+static bool _classifier_active(const WindowAnalysis *wa)
+{
+    return IS_ENABLED(CONFIG_HEART_PATCH_CLASSIFIER) && (wa->consumers & DSP_CONSUMER_ALERT);
+}
+
+//Features of a sound: RMS and centroid always feed the trends and packet, S1 adds the trended
+//features, the BLE mask adds features of both sounds for subscribers
+static uint32_t _feature_mask(const WindowAnalysis *wa, WindowPeakType type)
+{
+    if (type != WINDOW_PEAK_TYPE_S1 && type != WINDOW_PEAK_TYPE_S2) return 0;
+
+    uint32_t mask = FE_MASK(FE_RMS) | FE_MASK(FE_CENTROID);
+    if (type == WINDOW_PEAK_TYPE_S1) {
+        mask |= wa->cfg.feature_trend_mask;
+    }
+    if (wa->consumers & DSP_CONSUMER_FEATURES) {
+        mask |= wa->cfg.feature_ble_mask;
+    }
+    if (_classifier_active(wa)) {
+        mask |= FE_MASK_ALL;
+    }
+    return mask;
+}
+
+//Energy of STE block k. Blocks are on a uniform full rate grid across both parts of the window
+static float _ste_block(const WindowAnalysis *wa, int32_t k)
+{
+    int32_t block_size = (int32_t)wa->cfg.ste_block_size_samples;
+    int32_t decimation = (int32_t)wa->cfg.history_decimation;
+    int32_t dec_span = _dec_span(wa);
+
+    float sum = 0.0f;
+    int32_t pos = k * block_size;
+    int32_t end = pos + block_size;
+    if (pos < dec_span) {
+        //Each decimated sample stands in for decimation full rate samples
+        int32_t dec_end = (end < dec_span) ? end : dec_span;
+        float dec_sum = 0.0f;
+        for (int32_t j = (pos + decimation - 1) / decimation; j * decimation < dec_end; j++) {
+            float v = wa->audio_window[j];
+            dec_sum += v * v;
         }
-        window_analysis->ste_buffer[k] = sum;
+        sum += dec_sum * decimation;
+        pos = dec_end;
+    }
+    for (; pos < end; pos++) {
+        float v = wa->audio_window[_window_index(wa, pos)];
+        sum += v * v;
+    }
+    return sum;
+}
+
+void wa_calc_ste_blocks(WindowAnalysis *window_analysis)
+{
+    if (!window_analysis || !window_analysis->audio_window) return;
+
+    window_analysis->ste_window_len = _ste_num_blocks(window_analysis);
+    for (int32_t k = 0; k < window_analysis->ste_window_len; k++) {
+        window_analysis->ste_buffer[k] = _ste_block(window_analysis, k);
     }
 }
 
@@ -88,11 +186,18 @@ void wa_calc_ste_mean(WindowAnalysis *window_analysis) {
     arm_mean_f32(window_analysis->ste_buffer, window_analysis->ste_window_len, &window_analysis->ste_mean);
 }
 
+//The hard limit is applied as the STE is read, the raw profile is kept for the segments
 void wa_hard_limit_ste(WindowAnalysis *window_analysis)
 {
-    if (!window_analysis || window_analysis->ste_window_len <= 0 || window_analysis->ste_mean == 0.0) return;
+    if (!window_analysis) return;
+
+    window_analysis->ste_hl_level = window_analysis->ste_mean * window_analysis->cfg.ste_hl_thresh;
+}
 
-    _hard_limit(window_analysis->ste_buffer, window_analysis->ste_window_len, window_analysis->ste_mean, window_analysis->cfg.ste_hl_thresh, window_analysis->ste_buffer);
+static float _ste_limited(const WindowAnalysis *wa, int32_t i)
+{
+    float v = wa->ste_buffer[i];
+    return (fabsf(v) > wa->ste_hl_level) ? v : 0.0f;
 }
 
 void wa_find_peaks_window(WindowAnalysis *wa) {
@@ -103,15 +208,16 @@ void wa_find_peaks_window(WindowAnalysis *wa) {
     int32_t n_found = 0;
 
     for (int32_t i = 1; i < wa->ste_window_len - 1; ++i) {
+        float v = _ste_limited(wa, i);
         if (
-            wa->ste_buffer[i] > threshold &&
-            wa->ste_buffer[i] > wa->ste_buffer[i - 1] &&
-            wa->ste_buffer[i] > wa->ste_buffer[i + 1] &&
+            v > threshold &&
+            v > _ste_limited(wa, i - 1) &&
+            v > _ste_limited(wa, i + 1) &&
             (i - last_peak) >= wa->cfg.peak_min_distance
         ) {
             if (n_found < MAX_NUM_WINDOW_PEAKS) {
                 wa->peaks[n_found].ste_index = i;
-                wa->peaks[n_found].value = wa->ste_buffer[i];
+                wa->peaks[n_found].value = v;
                 wa->peaks[n_found].type = WINDOW_PEAK_TYPE_UNVAL;
                 n_found++;
             }
@@ -230,12 +336,241 @@ void wa_label_S1_S2_by_fraction(WindowAnalysis *wa)
     }
 }
 
+void wa_set_segmenter(WindowAnalysis *wa, WaSegmenter segmenter, int32_t s1_offset)
+{
+    wa->segmenter = (segmenter < WA_NUM_SEGMENTERS) ? segmenter : WA_SEGMENTER_STE;
+    wa->s1_offset = s1_offset;
+}
+
+BUILD_ASSERT((1 << WL_LEVELS) == (CB_DECIMATION << WL_DEC_LEVELS), "Wavelet bands of the two tiers must line up");
+
+#define WA_WL_PASSES (WL_NUM_PASSES(WL_DEC_LEVELS) + WL_NUM_PASSES(WL_LEVELS)) //Decimated tier first
+
+//Up to WL_CHUNK_ELEMENTS elements of one lifting pass over either tier, from step_index on. True
+//once the pass is finished.
+static bool _wl_pass_chunk(WindowAnalysis *wa, int32_t pass, bool inverse)
+{
+    float *x = wa->audio_window;
+    int32_t n = wa->audio_window_dec_len;
+    int32_t levels = WL_DEC_LEVELS;
+    if (pass >= WL_NUM_PASSES(WL_DEC_LEVELS)) {
+        x += wa->audio_window_dec_len;
+        n = wa->audio_window_len - wa->audio_window_dec_len;
+        levels = WL_LEVELS;
+        pass -= WL_NUM_PASSES(WL_DEC_LEVELS);
+    }
+    int32_t len = wl_pass_len(n, levels, pass, inverse);
+    int32_t end = MIN(wa->step_index + WL_CHUNK_ELEMENTS, len);
+    if (inverse) {
+        wl_inverse_part(x, n, levels, pass, wa->step_index, end);
+    } else {
+        wl_forward_part(x, n, levels, pass, wa->step_index, end);
+    }
+    wa->step_index = (end < len) ? end : 0;
+    return end >= len;
+}
+
+//One unit of wavelet segmentation: a chunk of the forward transform, the peaks, the labels, then
+//a chunk of the inverse. True once the window is labelled and restored.
+static bool _wavelet_slice(WindowAnalysis *wa)
+{
+    int32_t unit = wa->wl_unit;
+
+    if (unit < WA_WL_PASSES) {
+        if (_wl_pass_chunk(wa, unit, false)) wa->wl_unit++;
+    } else if (unit == WA_WL_PASSES) {
+        wa_wavelet_find_peaks(wa);
+        wa->wl_unit++;
+    } else if (unit == WA_WL_PASSES + 1) {
+        wa_wavelet_label(wa);
+        wa->wl_unit++;
+    } else if (_wl_pass_chunk(wa, unit - WA_WL_PASSES - 2, true)) {
+        wa->wl_unit++;
+        return wa->wl_unit == 2 * WA_WL_PASSES + 2;
+    }
+    return false;
+}
+
+//Approximation coefficient k of the transformed window in time order across both tiers, and its
+//full rate position
+static float _wl_coef(const WindowAnalysis *wa, int32_t k, int32_t num_dec, int32_t *pos)
+{
+    if (k < num_dec) {
+        int32_t j = k << WL_DEC_LEVELS;
+        *pos = j * (int32_t)wa->cfg.history_decimation;
+        return wa->audio_window[j];
+    }
+    int32_t j = (k - num_dec) << WL_LEVELS;
+    *pos = _dec_span(wa) + j;
+    return wa->audio_window[wa->audio_window_dec_len + j];
+}
+
+static int32_t _wl_ste_index(const WindowAnalysis *wa, int32_t pos)
+{
+    int32_t k = pos / (int32_t)wa->cfg.ste_block_size_samples;
+    return (k < wa->ste_window_len) ? k : wa->ste_window_len - 1;
+}
+
+//Smoothed band energy along the window. Returns its mean, and with pick set also records local
+//maxima above threshold, keeping the larger of any two closer than WL_MIN_PEAK_GAP_MS.
+static float _wl_scan(WindowAnalysis *wa, float threshold, bool pick)
+{
+    int32_t num_dec = wl_num_approx(wa->audio_window_dec_len, WL_DEC_LEVELS);
+    int32_t num = num_dec + wl_num_approx(wa->audio_window_len - wa->audio_window_dec_len, WL_LEVELS);
+    int32_t min_gap = (WL_MIN_PEAK_GAP_MS * MAX_SAMPLE_RATE) / 1000;
+    float ring[WL_SMOOTH_LEN] = { 0 };
+    int32_t ring_pos[WL_SMOOTH_LEN] = { 0 };
+    float sum = 0.0f, total = 0.0f;
+    float prev = 0.0f, prev2 = 0.0f;
+    int32_t prev_pos = 0;
+    int32_t n_found = 0;
+
+    for (int32_t k = 0; k < num; k++) {
+        int32_t pos;
+        float a = _wl_coef(wa, k, num_dec, &pos);
+        int32_t r = k % WL_SMOOTH_LEN;
+        sum += a * a - ring[r];
+        ring[r] = a * a;
+        ring_pos[r] = pos;
+        if (k < WL_SMOOTH_LEN - 1) continue;
+
+        //Centred on the middle of the smoothing span
+        float e = sum / WL_SMOOTH_LEN;
+        int32_t e_pos = ring_pos[(k - WL_SMOOTH_LEN / 2) % WL_SMOOTH_LEN];
+        total += e;
+
+        if (pick && prev > threshold && prev > prev2 && prev >= e) {
+            if (n_found > 0 && prev_pos - (wa->peaks[n_found - 1].ste_index * (int32_t)wa->cfg.ste_block_size_samples) < min_gap) {
+                if (prev > wa->peaks[n_found - 1].value) {
+                    wa->peaks[n_found - 1].ste_index = _wl_ste_index(wa, prev_pos);
+                    wa->peaks[n_found - 1].value = prev;
+                }
+            } else if (n_found < MAX_NUM_WINDOW_PEAKS) {
+                wa->peaks[n_found].ste_index = _wl_ste_index(wa, prev_pos);
+                wa->peaks[n_found].value = prev;
+                wa->peaks[n_found].type = WINDOW_PEAK_TYPE_CANDIDATE;
+                n_found++;
+            }
+        }
+        prev2 = prev;
+        prev = e;
+        prev_pos = e_pos;
+    }
+    if (pick) wa->num_peaks = n_found;
+
+    int32_t num_e = num - (WL_SMOOTH_LEN - 1);
+    return (num_e > 0) ? total / (float)num_e : 0.0f;
+}
+
+void wa_wavelet_find_peaks(WindowAnalysis *wa)
+{
+    wa->num_peaks = 0;
+    if (wa->ste_window_len <= 0) return;
+    float mean = _wl_scan(wa, 0.0f, false);
+    if (mean <= 0.0f) return;
+    _wl_scan(wa, mean * wa->cfg.wl_peak_thresh_scale, true);
+}
+
+//S1 is the strongest peak near where the opening S1 was detected in real time, S2 the strongest
+//peak near the S1 to S2 interval expected at this heart rate. The window spans one cardiac period.
+void wa_wavelet_label(WindowAnalysis *wa)
+{
+    int32_t block_size = (int32_t)wa->cfg.ste_block_size_samples;
+    int32_t search = (wa->cfg.wl_s1_search_ms * MAX_SAMPLE_RATE) / 1000;
+    int32_t s1 = -1, s2 = -1;
+
+    for (int32_t i = 0; i < wa->num_peaks; i++) {
+        int32_t pos = wa->peaks[i].ste_index * block_size;
+        if (abs(pos - wa->s1_offset) <= search && (s1 < 0 || wa->peaks[i].value > wa->peaks[s1].value)) {
+            s1 = i;
+        }
+    }
+
+    if (s1 >= 0) {
+        float period_ms = (float)wa->audio_window_span * 1000.0f / (float)MAX_SAMPLE_RATE;
+        float systole_ms = WL_SYSTOLE_BASE_MS - WL_SYSTOLE_PER_BPM_MS * (60000.0f / period_ms);
+        //The linear fit runs out at very high rates, systole never takes under 30% or over half the cycle
+        if (systole_ms < 0.3f * period_ms) systole_ms = 0.3f * period_ms;
+        if (systole_ms > 0.5f * period_ms) systole_ms = 0.5f * period_ms;
+        float expected = systole_ms * (float)MAX_SAMPLE_RATE / 1000.0f;
+        int32_t s1_pos = wa->peaks[s1].ste_index * block_size;
+
+        for (int32_t i = s1 + 1; i < wa->num_peaks; i++) {
+            float gap = (float)(wa->peaks[i].ste_index * block_size - s1_pos);
+            if (fabsf(gap - expected) <= wa->cfg.wl_s2_tol * expected &&
+                (s2 < 0 || wa->peaks[i].value > wa->peaks[s2].value)) {
+                s2 = i;
+            }
+        }
+    }
+
+    for (int32_t i = 0; i < wa->num_peaks; i++) {
+        if (s2 >= 0 && i == s1) {
+            wa->peaks[i].type = WINDOW_PEAK_TYPE_S1;
+        } else if (i == s2) {
+            wa->peaks[i].type = WINDOW_PEAK_TYPE_S2;
+        } else {
+            wa->peaks[i].type = WINDOW_PEAK_TYPE_OTHER;
+        }
+        //Later stages compare peaks in STE terms
+        wa->peaks[i].value = wa->ste_buffer[wa->peaks[i].ste_index];
+    }
+}
+
+void wa_hsmm_label(WindowAnalysis *wa)
+{
+    const Hsmm *hsmm = &wa->hsmm;
+    int32_t block_size = (int32_t)wa->cfg.ste_block_size_samples;
+    wa->num_peaks = 0;
+
+    for (int32_t t = 0; t < hsmm->num_obs && wa->num_peaks < MAX_NUM_WINDOW_PEAKS; ) {
+        int32_t state = hsmm->path[t];
+        int32_t end = t;
+        while (end + 1 < hsmm->num_obs && hsmm->path[end + 1] == state) end++;
+
+        if (state == HSMM_S1 || state == HSMM_S2) {
+            int32_t first = t * HSMM_DECIMATION;
+            int32_t last = (end + 1) * HSMM_DECIMATION;
+            if (last > wa->ste_window_len) last = wa->ste_window_len;
+            int32_t k_max = first;
+            for (int32_t k = first + 1; k < last; k++) {
+                if (wa->ste_buffer[k] > wa->ste_buffer[k_max]) k_max = k;
+            }
+            WindowPeak *peak = &wa->peaks[wa->num_peaks++];
+            peak->ste_index = k_max;
+            peak->value = wa->ste_buffer[k_max];
+            peak->type = (state == HSMM_S1) ? WINDOW_PEAK_TYPE_S1 : WINDOW_PEAK_TYPE_S2;
+        }
+        t = end + 1;
+    }
+
+    //The S1 decoded nearest the opening S1 and the S2 after it, as with the other segmenters
+    int32_t s1 = -1, s2 = -1;
+    for (int32_t i = 0; i < wa->num_peaks; i++) {
+        if (wa->peaks[i].type != WINDOW_PEAK_TYPE_S1) continue;
+        if (s1 < 0 || abs(wa->peaks[i].ste_index * block_size - wa->s1_offset) <
+                      abs(wa->peaks[s1].ste_index * block_size - wa->s1_offset)) {
+            s1 = i;
+        }
+    }
+    for (int32_t i = s1 + 1; s1 >= 0 && i < wa->num_peaks; i++) {
+        if (wa->peaks[i].type == WINDOW_PEAK_TYPE_S2) {
+            s2 = i;
+            break;
+        }
+    }
+    for (int32_t i = 0; i < wa->num_peaks; i++) {
+        if (!(s2 >= 0 && (i == s1 || i == s2))) wa->peaks[i].type = WINDOW_PEAK_TYPE_OTHER;
+    }
+}
+
 void wa_assign_audio_peaks(WindowAnalysis *wa)
 {
     if (!wa || !wa->audio_window) return;
 
     int32_t block_size = wa->cfg.ste_block_size_samples;
-    int32_t audio_len = wa->audio_window_len;
+    int32_t audio_len = wa->audio_window_span;
+    int32_t dec_span = _dec_span(wa);
 
     for (int i = 0; i < wa->num_peaks; i++) {
         WindowPeak *peak = &wa->peaks[i];
@@ -251,8 +586,9 @@ void wa_assign_audio_peaks(WindowAnalysis *wa)
 
             float max_val = 0.0f;
             int32_t max_idx = start;
-            for (int32_t j = start; j < end; j++) {
-                float abs_sample = fabsf(wa->audio_window[j]);
+            //Positions are full rate, the decimated head only has every decimation'th sample
+            for (int32_t j = start; j < end; j += (j < dec_span) ? (int32_t)wa->cfg.history_decimation : 1) {
+                float abs_sample = fabsf(wa->audio_window[_window_index(wa, j)]);
                 if (abs_sample > max_val) {
                     max_val = abs_sample;
                     max_idx = j;
@@ -264,45 +600,48 @@ void wa_assign_audio_peaks(WindowAnalysis *wa)
     }
 }
 
-float _calc_rms(const float *window, uint32_t len) {
-    float rms_val = 0.0f;
-    arm_rms_f32(window, len, &rms_val);
-    return rms_val;
-}
+//hs_window_size samples (full rate positions) around center for the feature engine, NULL if the
+//window is too short. It must sit inside whichever part of the window holds center.
+static const float *_feature_window(WindowAnalysis *wa, int32_t center, bool *decimated_out)
+{
+    int32_t dec_span = _dec_span(wa);
+    bool decimated = center < dec_span;
+    int32_t region_start = decimated ? 0 : dec_span;
+    int32_t region_end = decimated ? dec_span : wa->audio_window_span;
 
-float _calc_spectral_centroid(
-    const float *audio_start,
-    const float *hann_window,
-    uint32_t N,
-    uint32_t fs,
-    arm_rfft_fast_instance_f32 *rfft_inst,
-    float *scratch_windowed,
-    float *fft_out,
-    float *fft_mag
-) {
-    // 1. Apply Hann window 
-    arm_mult_f32(audio_start, hann_window, scratch_windowed, N);
+    int32_t half = (int32_t)(wa->cfg.hs_window_size / 2);
+    int32_t start = center - half;
+    if (start < region_start) start = region_start;
+    int32_t end = start + (int32_t)wa->cfg.hs_window_size;
+    if (end > region_end) end = region_end;
 
-    // 2. Compute RFFT
-    arm_rfft_fast_f32(rfft_inst, scratch_windowed, fft_out, 0);
+    int32_t sub_len = end - start;
+    if (sub_len != wa->cfg.hs_window_size) {
+        LOG_ERR("Sub window sizes don't match");
+        return NULL;
+    }
+    *decimated_out = decimated;
+    return &wa->audio_window[_window_index(wa, start)];
+}
 
-    // 3. Magnitude spectrum for first N/2+1 bins
-    arm_cmplx_mag_f32(fft_out, fft_mag, N/2 + 1);
+//Features around S1/S2 peak i, one spectrum per sound
+static void _extract_peak_features(WindowAnalysis *wa, int32_t i)
+{
+    uint32_t mask = _feature_mask(wa, wa->peaks[i].type);
+    if (!mask) return;
 
-    // 4. Spectral centroid calculation
-    float freq_sum = 0.0f, mag_sum = 0.0f;
-    float bin_width = (float)fs / (float)N;
+    bool decimated;
+    const float *sub_window = _feature_window(wa, wa->peaks[i].audio_index, &decimated);
+    if (!sub_window) return;
 
-    for (int k = 0; k < N/2 + 1; ++k) {
-        float freq = k * bin_width;
-        float mag  = fft_mag[k];
-        freq_sum  += freq * mag;
-        mag_sum   += mag;
-    }
-    if (mag_sum < 1e-6f)
-        return 0.0f;
+    //Decimated history keeps the same span and bin width with 1/decimation of the points,
+    //the bandpass leaves nothing above its nyquist
+    FeatureVector *features = &wa->sound_features[(wa->peaks[i].type == WINDOW_PEAK_TYPE_S1) ? 0 : 1];
+    fe_compute(&wa->fe, sub_window, decimated, mask, features);
+    wa->peaks[i].rms = features->values[FE_RMS];
+    wa->peaks[i].centroid = features->values[FE_CENTROID];
 
-    return freq_sum / mag_sum;
+    //LOG_INF("RMS: %f, SPECTRAL CENTROID: %f", wa->peaks[i].rms, wa->peaks[i].centroid);
 }
 
 void wa_extract_peak_features(WindowAnalysis *wa)
@@ -310,85 +649,438 @@ void wa_extract_peak_features(WindowAnalysis *wa)
     if (!wa) return;
 
     for (int32_t i = 0; i < wa->num_peaks; i++) {
-        if (wa->peaks[i].type == WINDOW_PEAK_TYPE_S1 || wa->peaks[i].type == WINDOW_PEAK_TYPE_S2) {
-
-            int32_t center = wa->peaks[i].audio_index;
-            int32_t half = (int32_t)(wa->cfg.hs_window_size / 2);
-            int32_t start = center - half;
-            if (start < 0) start = 0;
-            int32_t end = start + (int32_t)wa->cfg.hs_window_size;
-            if (end > wa->audio_window_len) end = wa->audio_window_len;
-
-            int32_t sub_len = end - start;
-            const float *sub_window = &wa->audio_window[start];
-            if (sub_len != wa->cfg.hs_window_size) {
-                LOG_ERR("Sub window sizes don't match");
-                continue;
-            }
+        _extract_peak_features(wa, i);
+    }
+}
 
-            // Calculate RMS
-            wa->peaks[i].rms = _calc_rms(sub_window, (uint32_t)sub_len);
-
-            // Calculate Spectral Centroid
-            wa->peaks[i].centroid = _calc_spectral_centroid(
-                sub_window,
-                wa->hann_window,
-                wa->cfg.hs_window_size,
-                MAX_SAMPLE_RATE,
-                &wa->fft_instance,
-                wa->scratch_windowed,
-                wa->scratch_fft_out,
-                wa->scratch_fft_mag
-            );
-
-            //LOG_INF("RMS: %f, SPECTRAL CENTROID: %f", wa->peaks[i].rms, wa->peaks[i].centroid);
+//The first S1 and the S2 labelled after it, -1 if missing
+static void _find_s1_s2(const WindowAnalysis *wa, int32_t *s1, int32_t *s2)
+{
+    *s1 = -1;
+    *s2 = -1;
+    for (int32_t i = 0; i < wa->num_peaks; i++) {
+        if (*s1 < 0 && wa->peaks[i].type == WINDOW_PEAK_TYPE_S1) {
+            *s1 = i;
+        } else if (*s1 >= 0 && wa->peaks[i].type == WINDOW_PEAK_TYPE_S2) {
+            *s2 = i;
+            return;
         }
     }
 }
 
-void wa_push_trends(WindowAnalysis *wa) {
+void wa_calc_segments(WindowAnalysis *wa)
+{
+    wa->segments[WA_SEGMENT_SYSTOLE].valid = false;
+    wa->segments[WA_SEGMENT_DIASTOLE].valid = false;
 
+    int32_t s1, s2;
+    _find_s1_s2(wa, &s1, &s2);
+    if (s2 < 0) return;
+
+    //Leave out the STE blocks the sounds themselves cover
+    int32_t block_size = (int32_t)wa->cfg.ste_block_size_samples;
+    int32_t guard = ((int32_t)wa->cfg.hs_window_size / 2 + block_size - 1) / block_size;
+    int32_t bounds[WA_NUM_SEGMENTS][2] = {
+        { wa->peaks[s1].ste_index + guard, wa->peaks[s2].ste_index - guard },
+        { wa->peaks[s2].ste_index + guard, wa->ste_window_len },
+    };
+    float sound_ste = 0.5f * (wa->peaks[s1].value + wa->peaks[s2].value);
+
+    for (int32_t g = 0; g < WA_NUM_SEGMENTS; g++) {
+        WindowSegment *seg = &wa->segments[g];
+        int32_t len = bounds[g][1] - bounds[g][0];
+        if (len <= 0) continue;
+
+        float mean;
+        arm_mean_f32(&wa->ste_buffer[bounds[g][0]], len, &mean);
+        seg->ste_start = bounds[g][0];
+        seg->ste_end = bounds[g][1];
+        seg->rms = sqrtf(mean / (float)block_size);
+        seg->energy_ratio = (sound_ste > 0.0f) ? mean / sound_ste : 0.0f;
+        seg->duration_ms = (float)(len * block_size) * 1000.0f / (float)MAX_SAMPLE_RATE;
+        seg->centroid = 0.0f;
+        seg->valid = true;
+    }
+}
+
+//Centroid of the middle of segment g, band limited like the sounds
+static void _segment_spectrum(WindowAnalysis *wa, int32_t g)
+{
+    WindowSegment *seg = &wa->segments[g];
+    if (!seg->valid || !wa->cfg.segment_spectrum) return;
+    if (!(wa->consumers & (WA_PACKET_CONSUMERS | DSP_CONSUMER_SD_LOG))) return;
+    //Too short to hold a feature window clear of the sounds
+    if ((seg->ste_end - seg->ste_start) * (int32_t)wa->cfg.ste_block_size_samples < (int32_t)wa->cfg.hs_window_size) return;
+
+    int32_t center = ((seg->ste_start + seg->ste_end) * (int32_t)wa->cfg.ste_block_size_samples) / 2;
+    bool decimated;
+    const float *sub_window = _feature_window(wa, center, &decimated);
+    if (!sub_window) return;
+
+    FeatureVector features;
+    fe_compute(&wa->fe, sub_window, decimated, FE_MASK(FE_CENTROID), &features);
+    seg->centroid = features.values[FE_CENTROID];
+}
+
+BUILD_ASSERT(CLS_NUM_INPUTS == 2 * FE_NUM_FEATURES + WA_NUM_SEGMENTS, "Classifier inputs don't match the features");
+
+//Classify a cycle with an S1, an S2 and both segments
+static void _classify(WindowAnalysis *wa)
+{
+    wa->abnormal_p = -1.0f;
+    if (!_classifier_active(wa)) return;
+    if (wa->sound_features[0].mask != FE_MASK_ALL || wa->sound_features[1].mask != FE_MASK_ALL) return;
+    if (!wa->segments[WA_SEGMENT_SYSTOLE].valid || !wa->segments[WA_SEGMENT_DIASTOLE].valid) return;
+
+    float inputs[CLS_NUM_INPUTS];
+    memcpy(&inputs[0], wa->sound_features[0].values, sizeof(wa->sound_features[0].values));
+    memcpy(&inputs[FE_NUM_FEATURES], wa->sound_features[1].values, sizeof(wa->sound_features[1].values));
+    inputs[2 * FE_NUM_FEATURES] = wa->segments[WA_SEGMENT_SYSTOLE].energy_ratio;
+    inputs[2 * FE_NUM_FEATURES + 1] = wa->segments[WA_SEGMENT_DIASTOLE].energy_ratio;
+    wa->abnormal_p = classifier_run(&wa->classifier, inputs);
+}
+
+void wa_push_trends(WindowAnalysis *wa) {
     for (int32_t i = 0; i < wa->num_peaks; i++) {
         if (wa->peaks[i].type == WINDOW_PEAK_TYPE_S1) {
             int32_t absolute_sample_index = wa->window_start_idx + wa->peaks[i].audio_index;
             float timestamp_s = (float)absolute_sample_index / (float)MAX_SAMPLE_RATE; 
             trend_analyser_update(&wa->ta_s1_rms, timestamp_s, wa->peaks[i].rms);
             trend_analyser_update(&wa->ta_s1_centroid, timestamp_s, wa->peaks[i].centroid);
+            for (int32_t t = 0; t < wa->num_feature_trends; t++) {
+                FeatureId id = wa->feature_trend_ids[t];
+                if (wa->sound_features[0].mask & FE_MASK(id)) {
+                    trend_analyser_update(&wa->feature_trends[t], timestamp_s, wa->sound_features[0].values[id]);
+                }
+            }
+        } else if (wa->peaks[i].type == WINDOW_PEAK_TYPE_S2) {
+            int32_t absolute_sample_index = wa->window_start_idx + wa->peaks[i].audio_index;
+            float timestamp_s = (float)absolute_sample_index / (float)MAX_SAMPLE_RATE;
+            trend_analyser_update(&wa->ta_s2_rms, timestamp_s, wa->peaks[i].rms);
+            trend_analyser_update(&wa->ta_s2_centroid, timestamp_s, wa->peaks[i].centroid);
+        }
+    }
+
+    //Segments are stamped with the S1 that opens them
+    int32_t s1, s2;
+    _find_s1_s2(wa, &s1, &s2);
+    if (s1 < 0) return;
+    float timestamp_s = (float)(int32_t)(wa->window_start_idx + wa->peaks[s1].audio_index) / (float)MAX_SAMPLE_RATE;
+    for (int32_t g = 0; g < WA_NUM_SEGMENTS; g++) {
+        if (wa->segments[g].valid) {
+            trend_analyser_update(&wa->ta_segment_ratio[g], timestamp_s, wa->segments[g].energy_ratio);
+        }
+    }
+}
+
+void wa_save_trends(const WindowAnalysis *wa, TrendSnapshot out[WA_NUM_TRENDS]) {
+    trend_analyser_save(&wa->ta_s1_rms, &out[0]);
+    trend_analyser_save(&wa->ta_s2_rms, &out[1]);
+    trend_analyser_save(&wa->ta_s1_centroid, &out[2]);
+    trend_analyser_save(&wa->ta_s2_centroid, &out[3]);
+    trend_analyser_save(&wa->ta_segment_ratio[WA_SEGMENT_SYSTOLE], &out[4]);
+    trend_analyser_save(&wa->ta_segment_ratio[WA_SEGMENT_DIASTOLE], &out[5]);
+}
+
+void wa_restore_trends(WindowAnalysis *wa, const TrendSnapshot in[WA_NUM_TRENDS], float time_offset_s) {
+    trend_analyser_restore(&wa->ta_s1_rms, &in[0], time_offset_s);
+    trend_analyser_restore(&wa->ta_s2_rms, &in[1], time_offset_s);
+    trend_analyser_restore(&wa->ta_s1_centroid, &in[2], time_offset_s);
+    trend_analyser_restore(&wa->ta_s2_centroid, &in[3], time_offset_s);
+    trend_analyser_restore(&wa->ta_segment_ratio[WA_SEGMENT_SYSTOLE], &in[4], time_offset_s);
+    trend_analyser_restore(&wa->ta_segment_ratio[WA_SEGMENT_DIASTOLE], &in[5], time_offset_s);
+}
+
+//Slopes after the n values: RMS and centroid, then for S1 the further trended features
+static uint32_t _append_slopes(WindowAnalysis *wa, int32_t sound, struct heart_features *features, uint32_t n)
+{
+    uint32_t slope_mask = 0;
+    float slope;
+
+    if (trend_analyser_get_slope(sound == 0 ? &wa->ta_s1_rms : &wa->ta_s2_rms, &slope) == 0) {
+        slope_mask |= FE_MASK(FE_RMS);
+        features->data[n++] = slope;
+    }
+    if (trend_analyser_get_slope(sound == 0 ? &wa->ta_s1_centroid : &wa->ta_s2_centroid, &slope) == 0) {
+        slope_mask |= FE_MASK(FE_CENTROID);
+        features->data[n++] = slope;
+    }
+    if (sound != 0) return slope_mask;
+    for (int32_t t = 0; t < wa->num_feature_trends; t++) {
+        if (trend_analyser_get_slope(&wa->feature_trends[t], &slope) == 0) {
+            slope_mask |= FE_MASK(wa->feature_trend_ids[t]);
+            features->data[n++] = slope;
         }
     }
+    return slope_mask;
 }
 
-void wa_make_send_ble(WindowAnalysis *wa) {
-    struct heart_packet packet;  
+static void _make_features(WindowAnalysis *wa, int32_t i, WindowResult *result)
+{
+    int32_t sound = (wa->peaks[i].type == WINDOW_PEAK_TYPE_S1) ? 0 : 1;
+    const FeatureVector *vector = &wa->sound_features[sound];
+    struct heart_features *features = &result->features[sound];
+    uint32_t n = 0;
+
+    if (result->has_features[sound]) return;
+    features->value_mask = vector->mask & wa->cfg.feature_ble_mask;
+    if (!features->value_mask) return;
+
+    uint32_t absolute_sample_index = wa->window_start_idx + wa->peaks[i].audio_index;
+    features->timestamp_ms = (uint32_t)(((float)absolute_sample_index / (float)MAX_SAMPLE_RATE) * 1000.0f);
+    features->sound = (uint8_t)(sound + 1);
+    for (uint32_t id = 0; id < FE_NUM_FEATURES; id++) {
+        if (features->value_mask & FE_MASK(id)) features->data[n++] = vector->values[id];
+    }
+    features->slope_mask = _append_slopes(wa, sound, features, n);
+    result->has_features[sound] = true;
+}
+
+//The S2 following S1 peak s1, with the systolic interval between them
+static void _make_s2_packet(WindowAnalysis *wa, int32_t s1, struct heart_packet *packet)
+{
+    packet->s2_rms = 0.0f;
+    packet->s2_centroid = 0.0f;
+    packet->s2_rms_trend = 0.0f;
+    packet->s2_centroid_trend = 0.0f;
+    packet->systolic_ms = 0.0f;
+
+    for (int32_t i = s1 + 1; i < wa->num_peaks; i++) {
+        if (wa->peaks[i].type != WINDOW_PEAK_TYPE_S2) continue;
+
+        float rms_slope = 0.0f, centroid_slope = 0.0f;
+        trend_analyser_get_slope(&wa->ta_s2_rms, &rms_slope);
+        trend_analyser_get_slope(&wa->ta_s2_centroid, &centroid_slope);
+
+        packet->s2_rms = wa->peaks[i].rms;
+        packet->s2_centroid = wa->peaks[i].centroid;
+        packet->s2_rms_trend = rms_slope;
+        packet->s2_centroid_trend = centroid_slope;
+        packet->systolic_ms = (float)(wa->peaks[i].audio_index - wa->peaks[s1].audio_index) * 1000.0f / (float)MAX_SAMPLE_RATE;
+        return;
+    }
+}
+
+static void _make_segment_packet(WindowAnalysis *wa, struct heart_packet *packet)
+{
+    const WindowSegment *sys = &wa->segments[WA_SEGMENT_SYSTOLE];
+    const WindowSegment *dia = &wa->segments[WA_SEGMENT_DIASTOLE];
+    float sys_slope = 0.0f, dia_slope = 0.0f;
+    trend_analyser_get_slope(&wa->ta_segment_ratio[WA_SEGMENT_SYSTOLE], &sys_slope);
+    trend_analyser_get_slope(&wa->ta_segment_ratio[WA_SEGMENT_DIASTOLE], &dia_slope);
+
+    packet->systolic_rms = sys->valid ? sys->rms : 0.0f;
+    packet->systolic_ratio = sys->valid ? sys->energy_ratio : 0.0f;
+    packet->systolic_centroid = sys->valid ? sys->centroid : 0.0f;
+    packet->systolic_ratio_trend = sys_slope;
+    packet->diastolic_rms = dia->valid ? dia->rms : 0.0f;
+    packet->diastolic_ratio = dia->valid ? dia->energy_ratio : 0.0f;
+    packet->diastolic_centroid = dia->valid ? dia->centroid : 0.0f;
+    packet->diastolic_ratio_trend = dia_slope;
+}
+
+void wa_make_result(WindowAnalysis *wa, WindowResult *result) {
+    result->consumers = wa->consumers;
+    result->has_packet = false;
+    result->has_rms_slope = false;
+    result->has_centroid_slope = false;
+    result->abnormal_p = wa->abnormal_p;
+    result->has_features[0] = false;
+    result->has_features[1] = false;
+
+    if (wa->consumers & DSP_CONSUMER_FEATURES) {
+        for (int32_t i = 0; i < wa->num_peaks; i++) {
+            if (wa->peaks[i].type == WINDOW_PEAK_TYPE_S1 || wa->peaks[i].type == WINDOW_PEAK_TYPE_S2) {
+                _make_features(wa, i, result);
+            }
+        }
+    }
+
     for (int32_t i = 0; i < wa->num_peaks; i++) {
         if (wa->peaks[i].type == WINDOW_PEAK_TYPE_S1) {
-            packet.centroid = wa->peaks[i].centroid;
-            packet.rms = wa->peaks[i].rms;
+            //Alerts also bring monitoring windows forward, so they follow the trends
+            result->has_rms_slope = (trend_analyser_get_slope(&wa->ta_s1_rms, &result->rms_slope) == 0);
+            result->has_centroid_slope = (trend_analyser_get_slope(&wa->ta_s1_centroid, &result->centroid_slope) == 0);
+            if (!(wa->consumers & WA_PACKET_CONSUMERS)) break;
+
+            struct heart_packet *packet = &result->packet;
+            packet->centroid = wa->peaks[i].centroid;
+            packet->rms = wa->peaks[i].rms;
             uint32_t absolute_sample_index = wa->window_start_idx + wa->peaks[i].audio_index;
             uint32_t timestamp_ms = (uint32_t)(((float)absolute_sample_index / (float)MAX_SAMPLE_RATE) * 1000.0f);
-            packet.timestamp_ms = timestamp_ms;
+            packet->timestamp_ms = timestamp_ms;
 
-            float rms_slope, centroid_slope;
+            float rms_slope = 0.0f, centroid_slope = 0.0f;
             trend_analyser_get_slope(&wa->ta_s1_rms, &rms_slope);
             trend_analyser_get_slope(&wa->ta_s1_centroid, &centroid_slope);
 
-            packet.rms_trend = rms_slope;
-            packet.centroid_trend = centroid_slope;
+            packet->rms_trend = rms_slope;
+            packet->centroid_trend = centroid_slope;
+            _make_s2_packet(wa, i, packet);
+            _make_segment_packet(wa, packet);
+            result->has_packet = true;
+            //Labelling picks a single S1 per window
+            break;
+        }
+    }
+}
 
-            bt_heart_service_notify_packet(&packet);
+void wa_publish_result(const WindowResult *result) {
+    if (result->has_packet) {
+        uint32_t seq = beat_history_publish(&result->packet, (result->consumers & DSP_CONSUMER_PACKET) != 0);
+        if (result->consumers & DSP_CONSUMER_BEACON) {
+            beacon_update_beat(&result->packet, seq);
+        }
+    }
+    for (int32_t i = 0; i < WA_NUM_SOUNDS; i++) {
+        if (result->has_features[i]) {
+            bt_heart_service_notify_features(&result->features[i]);
+        }
+    }
+}
 
-            if(trend_analyser_is_alert(&wa->ta_s1_rms)) {
-                int ret = bt_heart_service_notify_alert(0x01);
-                if(ret!=0) LOG_ERR("Alert Failed to send");
-                LOG_INF("RMS ALERT");
-            }
+static void _ste_segment(WindowAnalysis *wa)
+{
+    wa_find_peaks_window(wa);
+    wa_remove_close_peaks(wa);
+    wa_label_S1_S2_by_fraction(wa);
+}
 
-            if(trend_analyser_is_alert(&wa->ta_s1_centroid)) {
-                int ret = bt_heart_service_notify_alert(0x02);
-                if(ret!=0) LOG_ERR("Alert Failed to send");
-                LOG_INF("CENTROID ALERT");
-            }
+//One unit of HSMM segmentation, true once the window is labelled
+static bool _hsmm_slice(WindowAnalysis *wa)
+{
+    int32_t index = wa->step_index++;
+
+    if (index == 0) {
+        float period_ms = (float)wa->audio_window_span * 1000.0f / (float)MAX_SAMPLE_RATE;
+        if (hsmm_begin(&wa->hsmm, wa->ste_buffer, wa->ste_window_len, period_ms) < 0) {
+            wa->hsmm_fallbacks++;
+            _ste_segment(wa);
+            return true;
+        }
+    } else if (index <= wa->hsmm.num_obs) {
+        hsmm_step(&wa->hsmm, index - 1);
+    } else {
+        if (hsmm_decode(&wa->hsmm) == 0) {
+            wa_hsmm_label(wa);
+        } else {
+            wa->hsmm_fallbacks++;
+            _ste_segment(wa);
         }
+        return true;
     }
+    return false;
+}
+
+bool wa_run_slice(WindowAnalysis *wa, WindowResult *result, uint32_t budget_cycles)
+{
+    uint32_t slice_start = k_cycle_get_32();
+    uint32_t elapsed = 0;
+    uint32_t unit_start;
+
+    //A unit of work is one STE block, one HSMM trellis column, a chunk of one wavelet lifting
+    //pass, the features of one peak, or one of the cheap whole window passes. The budget is checked between units, so a slice overruns it by at most one.
+    do {
+        switch (wa->step) {
+            case WA_STEP_STE:
+                if (wa->step_index < wa->ste_window_len) {
+                    wa->ste_buffer[wa->step_index] = _ste_block(wa, wa->step_index);
+                    wa->step_index++;
+                } else {
+                    wa->step = WA_STEP_PEAKS;
+                }
+                break;
+            case WA_STEP_PEAKS:
+                unit_start = k_cycle_get_32();
+                wa_calc_ste_mean(wa);
+                wa_hard_limit_ste(wa);
+                if (wa->segmenter == WA_SEGMENTER_WAVELET) {
+                    wa->step = WA_STEP_WAVELET;
+                    wa->step_index = 0;
+                    wa->wl_unit = 0;
+                } else if (wa->segmenter == WA_SEGMENTER_HSMM) {
+                    wa->step = WA_STEP_HSMM;
+                    wa->step_index = 0;
+                } else {
+                    _ste_segment(wa);
+                    wa_assign_audio_peaks(wa);
+                    wa->step = WA_STEP_FEATURES;
+                    wa->step_index = 0;
+                    wa->seg_count[WA_SEGMENTER_STE]++;
+                }
+                wa->seg_cycles[wa->segmenter] += k_cycle_get_32() - unit_start;
+                break;
+            case WA_STEP_WAVELET:
+                //The window is only transformed between the first and last unit
+                unit_start = k_cycle_get_32();
+                if (_wavelet_slice(wa)) {
+                    wa_assign_audio_peaks(wa);
+                    wa->step = WA_STEP_FEATURES;
+                    wa->step_index = 0;
+                    wa->seg_count[WA_SEGMENTER_WAVELET]++;
+                }
+                wa->seg_cycles[WA_SEGMENTER_WAVELET] += k_cycle_get_32() - unit_start;
+                break;
+            case WA_STEP_HSMM:
+                //Set up, one trellis column per unit, then trace back
+                unit_start = k_cycle_get_32();
+                if (_hsmm_slice(wa)) {
+                    wa_assign_audio_peaks(wa);
+                    wa->step = WA_STEP_FEATURES;
+                    wa->step_index = 0;
+                    wa->seg_count[WA_SEGMENTER_HSMM]++;
+                }
+                wa->seg_cycles[WA_SEGMENTER_HSMM] += k_cycle_get_32() - unit_start;
+                break;
+            case WA_STEP_FEATURES:
+                if (wa->step_index < wa->num_peaks) {
+                    _extract_peak_features(wa, wa->step_index);
+                    wa->step_index++;
+                } else {
+                    wa_calc_segments(wa);
+                    wa->step = WA_STEP_SEGMENTS;
+                    wa->step_index = 0;
+                }
+                break;
+            case WA_STEP_SEGMENTS:
+                if (wa->step_index < WA_NUM_SEGMENTS) {
+                    _segment_spectrum(wa, wa->step_index);
+                    wa->step_index++;
+                } else {
+                    wa->step = WA_STEP_CLASSIFY;
+                }
+                break;
+            case WA_STEP_CLASSIFY:
+                _classify(wa);
+                wa->step = WA_STEP_RESULT;
+                break;
+            case WA_STEP_RESULT:
+                wa_push_trends(wa);
+                wa_make_result(wa, result);
+                wa->step = WA_STEP_DONE;
+                break;
+            case WA_STEP_DONE:
+                break;
+        }
+        elapsed = k_cycle_get_32() - slice_start;
+    } while (wa->step != WA_STEP_DONE && elapsed < budget_cycles);
+
+    wa->slice_count++;
+    if (elapsed > wa->slice_max_cycles) wa->slice_max_cycles = elapsed;
+    return wa->step == WA_STEP_DONE;
 }
 
+void wa_log_slice_stats(const WindowAnalysis *wa)
+{
+    LOG_INF("Analysis slices: %u, longest %u us", wa->slice_count, k_cyc_to_us_ceil32(wa->slice_max_cycles));
+
+    static const char *const names[WA_NUM_SEGMENTERS] = { "STE", "wavelet", "HSMM" };
+    for (int32_t i = 0; i < WA_NUM_SEGMENTERS; i++) {
+        if (wa->seg_count[i] == 0) continue;
+        LOG_INF("%s segmentation: %u windows, avg %u us", names[i], wa->seg_count[i],
+                k_cyc_to_us_ceil32(wa->seg_cycles[i] / wa->seg_count[i]));
+    }
+    if (wa->hsmm_fallbacks > 0) {
+        LOG_INF("HSMM fell back to STE peaks on %u windows", wa->hsmm_fallbacks);
+    }
+}
@@ -5,6 +5,11 @@
 #include "../../macros.h"
 #include "arm_math.h"
 #include "trend_analysis.h"
+#include "feature_engine.h"
+#include "classifier.h"
+#include "hsmm.h"
+#include "../../ble/heart_service.h"
+#include "../dsp_consumers.h"
 
 typedef enum {
     WINDOW_PEAK_TYPE_UNVAL,
@@ -24,6 +29,14 @@ typedef struct {
     float centroid;        
 } WindowPeak;
 
+//How S1 and S2 are found in a window
+typedef enum {
+    WA_SEGMENTER_STE,     //STE peaks labelled by fixed fractions of the cardiac period
+    WA_SEGMENTER_WAVELET, //Peaks of the 0-125hz wavelet band labelled by a heart rate dependent systole
+    WA_SEGMENTER_HSMM,    //Viterbi over a duration dependent HSMM of the STE envelope
+    WA_NUM_SEGMENTERS
+} WaSegmenter;
+
 typedef struct {
     float audio_hl_thresh;
     uint32_t ste_block_size_samples;
@@ -35,6 +48,17 @@ typedef struct {
     float ident_s1_s2_gap_r; //timing gap between S1 and S2
     float ident_s1_s2_gap_tol; //timing gap tolerance
     uint32_t hs_window_size;
+    uint32_t history_decimation; //Decimation of the history ahead of the full rate audio
+    uint32_t feature_trend_mask; //FE_MASK of S1 features to trend, up to FE_MAX_TRENDS besides RMS and centroid
+    uint32_t feature_ble_mask;   //FE_MASK of S1 and S2 features sent on the features characteristic
+    bool segment_spectrum;       //Also take the centroid of each segment from an FFT at its middle
+    //Wavelet segmentation
+    WaSegmenter segmenter;       //Used for every window
+    float wl_peak_thresh_scale;  //Band energy peaks must exceed this times the mean
+    int32_t wl_s1_search_ms;     //S1 is looked for this close to where the window's opening S1 was detected
+    float wl_s2_tol;             //S2 within this fraction of the expected S1 to S2 interval
+    //HSMM segmentation
+    HsmmConfig hsmm;
     //Trend analysis
     int32_t ta_rms_buf_size;
     float ta_rms_slope_thresh;
@@ -46,30 +70,100 @@ typedef struct {
 
 } WindowAnalysisConfig;
 
+//Resumable steps of the analysis of one window, see wa_run_slice
+typedef enum {
+    WA_STEP_STE,
+    WA_STEP_PEAKS,
+    WA_STEP_WAVELET,
+    WA_STEP_HSMM,
+    WA_STEP_FEATURES,
+    WA_STEP_SEGMENTS,
+    WA_STEP_CLASSIFY,
+    WA_STEP_RESULT,
+    WA_STEP_DONE,
+} WindowAnalysisStep;
+
+//Sounds with a feature vector, S1 then S2
+#define WA_NUM_SOUNDS 2
+
+//Parts of the cardiac cycle between the sounds
+typedef enum {
+    WA_SEGMENT_SYSTOLE,  //S1 to S2
+    WA_SEGMENT_DIASTOLE, //S2 to the end of the window, just before the next S1
+    WA_NUM_SEGMENTS
+} WindowSegmentId;
+
+typedef struct {
+    bool valid;
+    int32_t ste_start; //STE blocks, the sounds themselves are left out
+    int32_t ste_end;
+    float rms;
+    float energy_ratio; //Mean STE over the mean STE of the S1 and S2 peaks
+    float duration_ms;
+    float centroid;     //With segment_spectrum, otherwise 0
+} WindowSegment;
+
+//Output of one window, published separately from the analysis
+typedef struct {
+    uint32_t consumers; //DspConsumer mask the window was analysed for
+    bool has_packet;
+    struct heart_packet packet;
+    bool has_rms_slope;     //S1 slopes for the alerts, once the trends have enough history
+    bool has_centroid_slope;
+    float rms_slope;
+    float centroid_slope;
+    bool poor_signal;       //Skipped on signal quality, nothing else is filled in
+    float abnormal_p;       //Classifier abnormal probability, -1 if not classified
+    bool has_features[WA_NUM_SOUNDS];
+    struct heart_features features[WA_NUM_SOUNDS];
+} WindowResult;
+
 typedef struct {
-    const float *audio_window;
+    float *audio_window; //Transformed in place and restored by the wavelet segmenter
     WindowAnalysisConfig cfg;
     uint32_t window_start_idx;
     int32_t audio_window_len;
+    int32_t audio_window_dec_len; //Leading decimated samples
+    int32_t audio_window_span; //Length in full rate samples, peak indexes are in this domain
     float ste_buffer[STE_MAX_BUF_LEN];
     int32_t ste_window_len;
     float ste_mean;
+    float ste_hl_level; //STE below this reads as zero when finding peaks, ste_buffer is kept intact
     WindowPeak peaks[MAX_NUM_WINDOW_PEAKS];
     int32_t num_peaks;
-    float hann_window[HS_WINDOW_SIZE];
-    arm_rfft_fast_instance_f32 fft_instance;
-    float scratch_windowed[HS_WINDOW_SIZE];
-    float scratch_fft_out[HS_WINDOW_SIZE + 2];
-    float scratch_fft_mag[(HS_WINDOW_SIZE / 2) - 1];
+    FeatureEngine fe;
+    FeatureVector sound_features[WA_NUM_SOUNDS]; //Of the S1 and S2 in the current window
     TrendAnalyser ta_s1_rms;
     TrendAnalyser ta_s2_rms;
     TrendAnalyser ta_s1_centroid;
     TrendAnalyser ta_s2_centroid;
+    TrendAnalyser feature_trends[FE_MAX_TRENDS];
+    FeatureId feature_trend_ids[FE_MAX_TRENDS];
+    int32_t num_feature_trends;
+    WindowSegment segments[WA_NUM_SEGMENTS];
+    TrendAnalyser ta_segment_ratio[WA_NUM_SEGMENTS];
+    Classifier classifier;
+    WaSegmenter segmenter; //Of the current window
+    int32_t s1_offset;     //Position of the opening S1 in the current window
+    uint32_t seg_cycles[WA_NUM_SEGMENTERS];
+    uint32_t seg_count[WA_NUM_SEGMENTERS];
+    Hsmm hsmm;
+    uint32_t hsmm_fallbacks; //Windows the HSMM couldn't segment, labelled from STE peaks instead
+    float abnormal_p; //Of the current window, -1 if not classified
+    uint32_t consumers; //DspConsumer mask of the current window
+    WindowAnalysisStep step;
+    int32_t step_index; //Progress within the current step
+    int32_t wl_unit;    //Wavelet lifting pass, peaks or labels in progress
+    uint32_t slice_count;
+    uint32_t slice_max_cycles;
 } WindowAnalysis;
 
 void wa_init(WindowAnalysis *window_analysis, const WindowAnalysisConfig *window_analysis_config);
 
-void wa_set_audio_window(WindowAnalysis *window_analysis, const float *audio_window, int32_t window_len, uint32_t window_start_idx);
+void wa_set_audio_window(WindowAnalysis *window_analysis, float *audio_window, int32_t window_len, int32_t dec_len, uint32_t window_start_idx);
+
+//Segmenter for the next window, s1_offset is the full rate position of its opening S1
+void wa_set_segmenter(WindowAnalysis *wa, WaSegmenter segmenter, int32_t s1_offset);
 
 float compute_mean_abs(const float *window, int32_t len);
 
@@ -85,12 +179,41 @@ void wa_remove_close_peaks(WindowAnalysis *wa);
 
 void wa_label_S1_S2_by_fraction(WindowAnalysis *wa);
 
+//Wavelet segmentation of the transformed window, wa_run_slice transforms it and restores it
+void wa_wavelet_find_peaks(WindowAnalysis *wa);
+void wa_wavelet_label(WindowAnalysis *wa);
+
+//Peaks at the loudest STE block of each decoded S1 and S2 state, labelled like the other segmenters
+void wa_hsmm_label(WindowAnalysis *wa);
+
 void wa_assign_audio_peaks(WindowAnalysis *wa);
 
 void wa_extract_peak_features(WindowAnalysis *wa);
 
+//Systolic and diastolic energy from the STE profile of the labelled window
+void wa_calc_segments(WindowAnalysis *wa);
+
 void wa_push_trends(WindowAnalysis *wa);
 
-void wa_make_send_ble(WindowAnalysis *wa);
+//S1/S2 RMS and centroid trends, then systolic and diastolic energy ratio trends, in that order
+#define WA_NUM_TRENDS 6
+void wa_save_trends(const WindowAnalysis *wa, TrendSnapshot out[WA_NUM_TRENDS]);
+//time_offset_s moves the saved timestamps onto the current timeline
+void wa_restore_trends(WindowAnalysis *wa, const TrendSnapshot in[WA_NUM_TRENDS], float time_offset_s);
+
+//Consumers the next window is analysed for, features no consumer needs are skipped
+void wa_set_consumers(WindowAnalysis *wa, uint32_t consumers);
+
+//Build the beat packet and alerts for the analysed window
+void wa_make_result(WindowAnalysis *wa, WindowResult *result);
+
+//Send a result over BLE, does not touch the analysis state
+void wa_publish_result(const WindowResult *result);
+
+//Continue analysing the window set by wa_set_audio_window for about budget_cycles.
+//Returns true once the window is finished and result is filled in.
+bool wa_run_slice(WindowAnalysis *wa, WindowResult *result, uint32_t budget_cycles);
+
+void wa_log_slice_stats(const WindowAnalysis *wa);
 
 #endif 
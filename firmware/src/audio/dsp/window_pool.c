@@ -0,0 +1,124 @@
+#include "window_pool.h"
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(window_pool);
+
+#define WP_DRAIN_POLL_MS 2
+
+void window_pool_init(WindowPool *pool, float *buffer, uint32_t capacity, k_work_handler_t publish_fn)
+{
+    pool->buffer = buffer;
+    pool->capacity = capacity;
+    pool->slot_head = 0;
+    pool->slots_live = 0;
+    pool->sample_head = 0;
+    pool->samples_used = 0;
+    atomic_set(&pool->drops, 0);
+    for (int i = 0; i < WP_NUM_SLOTS; i++) {
+        k_work_init(&pool->slots[i].publish_work, publish_fn);
+        pool->slots[i].samples = NULL;
+    }
+    for (int i = 0; i < WP_STAGE_COUNT; i++) {
+        atomic_set(&pool->stages[i].depth, 0);
+        atomic_set(&pool->stages[i].high_watermark, 0);
+    }
+}
+
+WindowSlot *window_pool_alloc(WindowPool *pool, int32_t len)
+{
+    WindowSlot *slot = NULL;
+    k_spinlock_key_t key = k_spin_lock(&pool->lock);
+
+    if (pool->slots_live < WP_NUM_SLOTS && len > 0 && (uint32_t)len <= pool->capacity) {
+        //Samples must be contiguous, if they don't fit before the end skip to the start and
+        //charge the skipped tail to this window. Space is free up to the oldest live window.
+        uint32_t offset = pool->sample_head;
+        uint32_t skip = 0;
+        if (pool->capacity - offset < (uint32_t)len) {
+            skip = pool->capacity - offset;
+            offset = 0;
+        }
+        if (pool->samples_used + skip + len <= pool->capacity) {
+            slot = &pool->slots[pool->slot_head % WP_NUM_SLOTS];
+            slot->samples = &pool->buffer[offset];
+            slot->reserved = skip + len;
+            slot->valid = false;
+            pool->sample_head = offset + len;
+            pool->samples_used += slot->reserved;
+            pool->slot_head++;
+            pool->slots_live++;
+        }
+    }
+
+    k_spin_unlock(&pool->lock, key);
+    if (!slot) {
+        atomic_inc(&pool->drops);
+    }
+    return slot;
+}
+
+void window_pool_release_samples(WindowPool *pool, WindowSlot *slot)
+{
+    k_spinlock_key_t key = k_spin_lock(&pool->lock);
+    pool->samples_used -= slot->reserved;
+    slot->reserved = 0;
+    slot->samples = NULL;
+    if (pool->samples_used == 0) {
+        pool->sample_head = 0; //Nothing live, start again from the front
+    }
+    k_spin_unlock(&pool->lock, key);
+}
+
+void window_pool_free(WindowPool *pool, WindowSlot *slot)
+{
+    k_spinlock_key_t key = k_spin_lock(&pool->lock);
+    pool->slots_live--;
+    k_spin_unlock(&pool->lock, key);
+}
+
+static uint32_t _slots_live(WindowPool *pool)
+{
+    k_spinlock_key_t key = k_spin_lock(&pool->lock);
+    uint32_t live = pool->slots_live;
+    k_spin_unlock(&pool->lock, key);
+    return live;
+}
+
+void window_pool_drain(WindowPool *pool)
+{
+    struct k_work_sync sync;
+
+    //Windows being analysed have no work item of their own, wait for their slots to come back
+    while (_slots_live(pool) > 0) {
+        k_msleep(WP_DRAIN_POLL_MS);
+    }
+    //The last publish handler may still be returning after it freed its slot
+    for (int i = 0; i < WP_NUM_SLOTS; i++) {
+        k_work_flush(&pool->slots[i].publish_work, &sync);
+    }
+}
+
+void window_pool_stage_enter(WindowPool *pool, WindowPoolStage stage)
+{
+    WindowPoolStageStats *stats = &pool->stages[stage];
+    atomic_val_t depth = atomic_inc(&stats->depth) + 1;
+    atomic_val_t high = atomic_get(&stats->high_watermark);
+    while (depth > high && !atomic_cas(&stats->high_watermark, high, depth)) {
+        high = atomic_get(&stats->high_watermark);
+    }
+}
+
+void window_pool_stage_leave(WindowPool *pool, WindowPoolStage stage)
+{
+    atomic_dec(&pool->stages[stage].depth);
+}
+
+void window_pool_log_stats(WindowPool *pool)
+{
+    LOG_INF("Windows: dropped %d, analysis depth %d (max %d), publish depth %d (max %d)",
+            (int)atomic_get(&pool->drops),
+            (int)atomic_get(&pool->stages[WP_STAGE_ANALYSIS].depth),
+            (int)atomic_get(&pool->stages[WP_STAGE_ANALYSIS].high_watermark),
+            (int)atomic_get(&pool->stages[WP_STAGE_PUBLISH].depth),
+            (int)atomic_get(&pool->stages[WP_STAGE_PUBLISH].high_watermark));
+}
@@ -0,0 +1,73 @@
+#ifndef WINDOW_POOL_H
+#define WINDOW_POOL_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <stdbool.h>
+#include "circular_block_buffer.h"
+#include "window_analysis.h"
+#include "heart_rate.h"
+#include "../../macros.h"
+
+//Windows in flight between extraction, analysis and publishing. Windows move through the
+//stages in order, so both the slots and the samples are handed out and returned FIFO.
+
+typedef enum {
+    WP_STAGE_ANALYSIS,
+    WP_STAGE_PUBLISH,
+    WP_STAGE_COUNT,
+} WindowPoolStage;
+
+typedef struct {
+    atomic_t depth;          //Windows queued or running in the stage
+    atomic_t high_watermark;
+} WindowPoolStageStats;
+
+typedef struct {
+    struct k_work publish_work;
+    float *samples;
+    CbbWindowInfo info;
+    bool valid;         //False if extraction failed, the window still passes through to keep order
+    uint32_t release_cyc;  //Cycle count at extraction
+    uint32_t deadline_cyc; //Analysis is due this long after release
+    uint32_t consumers; //DspConsumer mask when the window was extracted
+    float sqi;          //Signal quality when the window was extracted
+    HeartRateStats heart_rate; //Up to the S1 closing the window
+    WaSegmenter segmenter;     //S1/S2 segmenter to run on this window
+    uint32_t reserved;  //Samples held in the pool, including any skipped at the end of the buffer
+    WindowResult result;
+} WindowSlot;
+
+typedef struct {
+    WindowSlot slots[WP_NUM_SLOTS];
+    uint32_t slot_head;    //Free running count of slots handed out
+    uint32_t slots_live;
+    float *buffer;         //Sample storage, owned by the caller
+    uint32_t capacity;
+    uint32_t sample_head;  //Offset of the next allocation
+    uint32_t samples_used;
+    struct k_spinlock lock;
+    atomic_t drops;        //Windows dropped for lack of a slot or samples
+    WindowPoolStageStats stages[WP_STAGE_COUNT];
+} WindowPool;
+
+void window_pool_init(WindowPool *pool, float *buffer, uint32_t capacity, k_work_handler_t publish_fn);
+
+//Reserve a slot with room for len contiguous samples, NULL if the pool is full
+WindowSlot *window_pool_alloc(WindowPool *pool, int32_t len);
+
+//Return the samples of the oldest analysed window
+void window_pool_release_samples(WindowPool *pool, WindowSlot *slot);
+
+//Return the slot of the oldest published window
+void window_pool_free(WindowPool *pool, WindowSlot *slot);
+
+//Wait until every window handed out has been published, only once extraction has stopped
+void window_pool_drain(WindowPool *pool);
+
+void window_pool_stage_enter(WindowPool *pool, WindowPoolStage stage);
+void window_pool_stage_leave(WindowPool *pool, WindowPoolStage stage);
+
+void window_pool_log_stats(WindowPool *pool);
+
+#endif
@@ -0,0 +1,19 @@
+#include "dsp_consumers.h"
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+LOG_MODULE_REGISTER(dsp_consumers);
+
+static atomic_t _consumers = ATOMIC_INIT(0);
+
+void dsp_consumers_set(uint32_t consumers, bool active) {
+    atomic_val_t old = active ? atomic_or(&_consumers, consumers) : atomic_and(&_consumers, ~consumers);
+    atomic_val_t now = active ? (old | consumers) : (old & ~consumers);
+    if (now != old) {
+        LOG_INF("DSP consumers now 0x%02x", (unsigned int)now);
+    }
+}
+
+uint32_t dsp_consumers_get(void) {
+    return (uint32_t)atomic_get(&_consumers);
+}
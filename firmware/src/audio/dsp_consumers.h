@@ -0,0 +1,25 @@
+#ifndef _DSP_CONSUMERS_H_
+#define _DSP_CONSUMERS_H_
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Outputs of the DSP pipeline that someone is currently using. Every window is extracted and
+//analysed up to the S1 trends and alerts, which monitoring follows even with nothing subscribed,
+//and each stage only adds what an active consumer needs on top.
+typedef enum {
+    DSP_CONSUMER_PACKET = BIT(0), //Beat packet notifications subscribed
+    DSP_CONSUMER_ALERT = BIT(1),  //Alert notifications subscribed
+    DSP_CONSUMER_SD_LOG = BIT(2), //Per beat S1 and S2 features logged to SD
+    DSP_CONSUMER_FEATURES = BIT(4), //Feature vector notifications subscribed
+    DSP_CONSUMER_ENVELOPE = BIT(5), //Envelope stream notifications subscribed
+    DSP_CONSUMER_HISTORY = BIT(6),  //Beat packets kept for backfill, with CONFIG_HEART_PATCH_BEAT_HISTORY
+    DSP_CONSUMER_BEACON = BIT(7),   //Beat summary broadcast, with CONFIG_HEART_PATCH_BEACON
+} DspConsumer;
+
+//Callable from any thread
+void dsp_consumers_set(uint32_t consumers, bool active);
+uint32_t dsp_consumers_get(void);
+
+#endif
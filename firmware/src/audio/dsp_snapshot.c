@@ -0,0 +1,92 @@
+#include "dsp_snapshot.h"
+#include <zephyr/logging/log.h>
+#if IS_ENABLED(CONFIG_HEART_PATCH_SNAPSHOT_NVS)
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+#endif
+#include "../macros.h"
+
+LOG_MODULE_REGISTER(dsp_snapshot);
+
+void dsp_snapshot_stamp(DspSnapshot *snapshot) {
+    snapshot->magic = DSP_SNAPSHOT_MAGIC;
+    snapshot->version = DSP_SNAPSHOT_VERSION;
+    snapshot->size = sizeof(DspSnapshot);
+}
+
+bool dsp_snapshot_is_valid(const DspSnapshot *snapshot) {
+    return snapshot->magic == DSP_SNAPSHOT_MAGIC && snapshot->version == DSP_SNAPSHOT_VERSION &&
+           snapshot->size == sizeof(DspSnapshot);
+}
+
+#if IS_ENABLED(CONFIG_HEART_PATCH_SNAPSHOT_NVS)
+
+#define DSP_SNAPSHOT_NVS_ID 1
+
+static struct nvs_fs _fs;
+static bool _mounted = false;
+static int64_t _last_persist_ms = -1;
+
+int dsp_snapshot_storage_init(void) {
+    struct flash_pages_info info;
+
+    _fs.flash_device = FIXED_PARTITION_DEVICE(storage_partition);
+    if (!device_is_ready(_fs.flash_device)) {
+        LOG_ERR("Flash device not ready");
+        return -ENODEV;
+    }
+    _fs.offset = FIXED_PARTITION_OFFSET(storage_partition);
+    int ret = flash_get_page_info_by_offs(_fs.flash_device, _fs.offset, &info);
+    if (ret) {
+        LOG_ERR("Unable to get flash page info: %d", ret);
+        return ret;
+    }
+    _fs.sector_size = info.size;
+    _fs.sector_count = DSP_SNAPSHOT_NVS_SECTORS;
+
+    ret = nvs_mount(&_fs);
+    if (ret) {
+        LOG_ERR("NVS mount failed: %d", ret);
+        return ret;
+    }
+    _mounted = true;
+    return 0;
+}
+
+int dsp_snapshot_persist(const DspSnapshot *snapshot) {
+    if (!_mounted) return -ENODEV;
+
+    //Captures can end every few minutes while monitoring, limit the flash wear
+    int64_t now = k_uptime_get();
+    if (_last_persist_ms >= 0 && now - _last_persist_ms < DSP_SNAPSHOT_PERSIST_MIN_MS) {
+        return 0;
+    }
+    ssize_t len = nvs_write(&_fs, DSP_SNAPSHOT_NVS_ID, snapshot, sizeof(DspSnapshot));
+    if (len < 0) {
+        LOG_ERR("Snapshot write failed: %d", (int)len);
+        return (int)len;
+    }
+    _last_persist_ms = now;
+    LOG_INF("Snapshot saved to flash");
+    return 0;
+}
+
+int dsp_snapshot_load(DspSnapshot *snapshot) {
+    if (!_mounted) return -ENODEV;
+
+    ssize_t len = nvs_read(&_fs, DSP_SNAPSHOT_NVS_ID, snapshot, sizeof(DspSnapshot));
+    if (len != sizeof(DspSnapshot) || !dsp_snapshot_is_valid(snapshot)) {
+        //Nothing saved yet, or saved by a firmware with a different layout
+        return -ENOENT;
+    }
+    return 0;
+}
+
+#else
+
+int dsp_snapshot_storage_init(void) { return -ENOTSUP; }
+int dsp_snapshot_persist(const DspSnapshot *snapshot) { return -ENOTSUP; }
+int dsp_snapshot_load(DspSnapshot *snapshot) { return -ENOTSUP; }
+
+#endif
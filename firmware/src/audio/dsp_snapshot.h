@@ -0,0 +1,37 @@
+#ifndef _DSP_SNAPSHOT_H_
+#define _DSP_SNAPSHOT_H_
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "dsp/filters/bandpass_coeffs.h"
+#include "dsp/filters/lowpass_coeffs.h"
+#include "dsp/peak_validator.h"
+#include "dsp/window_analysis.h"
+
+#define DSP_SNAPSHOT_MAGIC 0x48505353 //"HPSS"
+#define DSP_SNAPSHOT_VERSION 2
+
+//DSP state carried from one capture session to the next, so a new session starts warm
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    int32_t sample_index; //Timeline position when the snapshot was taken
+    int64_t uptime_ms;    //Only meaningful in the boot that took it
+    float bp_state[4 * NUM_STAGES_BP];
+    float lp_state[4 * NUM_STAGES_LP];
+    float running_mean;
+    RTPeakValSnapshot validator;
+    TrendSnapshot trends[WA_NUM_TRENDS];
+} DspSnapshot;
+
+void dsp_snapshot_stamp(DspSnapshot *snapshot);
+bool dsp_snapshot_is_valid(const DspSnapshot *snapshot);
+
+//Flash copy with CONFIG_HEART_PATCH_SNAPSHOT_NVS, otherwise these return -ENOTSUP
+int dsp_snapshot_storage_init(void);
+int dsp_snapshot_persist(const DspSnapshot *snapshot);
+int dsp_snapshot_load(DspSnapshot *snapshot);
+
+#endif
@@ -0,0 +1,96 @@
+#include "envelope_stream.h"
+#include <zephyr/logging/log.h>
+#include "arm_math.h"
+#include "spsc_ring.h"
+#include "../macros.h"
+#include "../ble/heart_service.h"
+
+LOG_MODULE_REGISTER(envelope_stream);
+
+BUILD_ASSERT(BLOCK_SIZE_SAMPLES % ENV_STREAM_DECIMATION == 0, "Envelope stream decimation must divide the block");
+BUILD_ASSERT(ENV_STREAM_BATCH <= HEART_ENVELOPE_MAX_SAMPLES, "Envelope batch doesn't fit the notification");
+BUILD_ASSERT(MAX_SAMPLE_RATE / ENV_STREAM_DECIMATION <= UINT8_MAX, "Envelope rate is sent as a byte");
+
+SPSC_RING_DEFINE(envelope_ring, sizeof(struct heart_envelope), ENV_STREAM_QUEUE_LEN);
+
+static void _notify_envelope(struct k_work *work);
+static K_WORK_DEFINE(_notify_work, _notify_envelope);
+
+//Audio thread state
+static float _batch[ENV_STREAM_BATCH];
+static int32_t _batch_len;
+static uint32_t _batch_start_idx;
+static uint32_t _next_idx;
+static float _scale;
+
+static uint32_t _sent;
+static uint32_t _failed;
+
+void envelope_stream_init(void) {
+    _batch_len = 0;
+    _next_idx = 0;
+    _scale = 0.0f;
+    _sent = 0;
+    _failed = 0;
+    spsc_ring_reset(&envelope_ring);
+}
+
+static void _send_batch(void) {
+    struct heart_envelope envelope;
+    float batch_max;
+    uint32_t max_index;
+    arm_max_f32(_batch, ENV_STREAM_BATCH, &batch_max, &max_index);
+
+    //Full scale jumps up to a louder batch and decays slowly, so the trace doesn't rescale every batch
+    _scale *= ENV_STREAM_SCALE_DECAY;
+    if (batch_max > _scale) _scale = batch_max;
+
+    envelope.timestamp_ms = (uint32_t)(((uint64_t)_batch_start_idx * 1000) / MAX_SAMPLE_RATE);
+    envelope.scale = _scale;
+    envelope.rate_hz = MAX_SAMPLE_RATE / ENV_STREAM_DECIMATION;
+    envelope.count = ENV_STREAM_BATCH;
+    float gain = (_scale > 0.0f) ? 255.0f / _scale : 0.0f;
+    for (int32_t i = 0; i < ENV_STREAM_BATCH; i++) {
+        float q = _batch[i] * gain + 0.5f;
+        envelope.data[i] = (q <= 0.0f) ? 0 : (q >= 255.0f ? 255 : (uint8_t)q);
+    }
+
+    //A slow link drops whole batches rather than holding up the audio thread
+    if (spsc_ring_put(&envelope_ring, &envelope) == 0) {
+        k_work_submit(&_notify_work);
+    }
+}
+
+void envelope_stream_add(const float *envelope, int32_t len, uint32_t start_idx) {
+    if (start_idx != _next_idx) {
+        _batch_len = 0;
+    }
+    _next_idx = start_idx + (uint32_t)len;
+
+    for (int32_t i = 0; i + ENV_STREAM_DECIMATION <= len; i += ENV_STREAM_DECIMATION) {
+        if (_batch_len == 0) {
+            _batch_start_idx = start_idx + (uint32_t)i;
+        }
+        arm_mean_f32(&envelope[i], ENV_STREAM_DECIMATION, &_batch[_batch_len++]);
+        if (_batch_len == ENV_STREAM_BATCH) {
+            _send_batch();
+            _batch_len = 0;
+        }
+    }
+}
+
+static void _notify_envelope(struct k_work *work) {
+    struct heart_envelope envelope;
+    while (spsc_ring_get(&envelope_ring, &envelope, K_NO_WAIT) == 0) {
+        if (bt_heart_service_notify_envelope(&envelope) == 0) {
+            _sent++;
+        } else {
+            _failed++;
+        }
+    }
+}
+
+void envelope_stream_log_stats(void) {
+    LOG_INF("Envelope batches sent: %u, failed: %u", _sent, _failed);
+    spsc_ring_log_stats(&envelope_ring, "envelope");
+}
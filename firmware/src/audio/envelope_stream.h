@@ -0,0 +1,19 @@
+#ifndef _ENVELOPE_STREAM_H_
+#define _ENVELOPE_STREAM_H_
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+//Live trace of the peak detection envelope for probe placement. The audio thread averages the
+//envelope down to MAX_SAMPLE_RATE / ENV_STREAM_DECIMATION and quantises it to 8 bits in batches
+//of ENV_STREAM_BATCH, which are notified from the system work queue.
+
+void envelope_stream_init(void);
+
+//Call with every envelope block while DSP_CONSUMER_ENVELOPE is active. A block that doesn't follow
+//on from the last one starts a new batch. Audio thread only.
+void envelope_stream_add(const float *envelope, int32_t len, uint32_t start_idx);
+
+void envelope_stream_log_stats(void);
+
+#endif
@@ -0,0 +1,53 @@
+#include "pipeline_deadline.h"
+#include <string.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(pipeline_deadline);
+
+//Each stage is only ever updated from its own thread
+static PipelineDeadlineStats _stats[PIPELINE_STAGE_COUNT];
+
+static const char *_stage_names[PIPELINE_STAGE_COUNT] = {
+    [PIPELINE_STAGE_BLOCK] = "block",
+    [PIPELINE_STAGE_BEAT] = "beat",
+};
+
+void pipeline_deadline_begin(uint32_t release_cyc, uint32_t relative_deadline_cyc) {
+#if IS_ENABLED(CONFIG_HEART_PATCH_DEADLINE_SCHED)
+    uint32_t elapsed = k_cycle_get_32() - release_cyc;
+    //Already late work still runs, as the most urgent
+    int remaining = (elapsed < relative_deadline_cyc) ? (int)(relative_deadline_cyc - elapsed) : 1;
+    k_thread_deadline_set(k_current_get(), remaining);
+#else
+    ARG_UNUSED(release_cyc);
+    ARG_UNUSED(relative_deadline_cyc);
+#endif
+}
+
+bool pipeline_deadline_end(PipelineStage stage, uint32_t release_cyc, uint32_t relative_deadline_cyc) {
+    uint32_t elapsed = k_cycle_get_32() - release_cyc;
+    PipelineDeadlineStats *stats = &_stats[stage];
+
+    stats->completed++;
+    if (elapsed > stats->worst_cycles) stats->worst_cycles = elapsed;
+    if (elapsed > relative_deadline_cyc) {
+        stats->misses++;
+        return false;
+    }
+    return true;
+}
+
+void pipeline_deadline_get_stats(PipelineStage stage, PipelineDeadlineStats *stats) {
+    *stats = _stats[stage];
+}
+
+void pipeline_deadline_reset() {
+    memset(_stats, 0, sizeof(_stats));
+}
+
+void pipeline_deadline_log_stats() {
+    for (int i = 0; i < PIPELINE_STAGE_COUNT; i++) {
+        LOG_INF("Deadlines %s: %u completed, %u missed, worst %u us", _stage_names[i],
+                _stats[i].completed, _stats[i].misses, k_cyc_to_us_ceil32(_stats[i].worst_cycles));
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef _PIPELINE_DEADLINE_H_
+#define _PIPELINE_DEADLINE_H_
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Deadlines of the DSP pipeline stages. Every unit of work is released at a cycle count and
+//due a relative deadline later:
+//  block: consumed within one block period of the block completing capture
+//  beat:  analysed within one cardiac period of its window being extracted, before the next S1
+typedef enum {
+    PIPELINE_STAGE_BLOCK,
+    PIPELINE_STAGE_BEAT,
+    PIPELINE_STAGE_COUNT,
+} PipelineStage;
+
+typedef struct {
+    uint32_t completed;
+    uint32_t misses;
+    uint32_t worst_cycles; //Longest release to completion time
+} PipelineDeadlineStats;
+
+//Call from the thread starting a unit of work. With CONFIG_HEART_PATCH_DEADLINE_SCHED the thread's
+//deadline is set so that equal priority pipeline threads are scheduled earliest deadline first.
+void pipeline_deadline_begin(uint32_t release_cyc, uint32_t relative_deadline_cyc);
+
+//Record a finished unit of work, returns false if its deadline was missed
+bool pipeline_deadline_end(PipelineStage stage, uint32_t release_cyc, uint32_t relative_deadline_cyc);
+
+void pipeline_deadline_get_stats(PipelineStage stage, PipelineDeadlineStats *stats);
+void pipeline_deadline_reset();
+void pipeline_deadline_log_stats();
+
+#endif
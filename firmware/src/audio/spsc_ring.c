@@ -0,0 +1,90 @@
+#include "spsc_ring.h"
+#include <string.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/barrier.h>
+
+LOG_MODULE_REGISTER(spsc_ring);
+
+static inline uint8_t *_slot(const SpscRing *ring, uint32_t count)
+{
+    return &ring->buffer[(count & (ring->capacity - 1)) * ring->item_size];
+}
+
+int spsc_ring_put(SpscRing *ring, const void *item)
+{
+    uint32_t head = (uint32_t)atomic_get(&ring->head);
+    uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+
+    if (head - tail >= ring->capacity) {
+        atomic_inc(&ring->stats.drops);
+        return -ENOMSG;
+    }
+
+    memcpy(_slot(ring, head), item, ring->item_size);
+    barrier_dmem_fence_full(); //Item must be visible before the new head
+    atomic_set(&ring->head, (atomic_val_t)(head + 1));
+    atomic_inc(&ring->stats.puts);
+
+    uint32_t depth = head + 1 - tail;
+    if (depth > (uint32_t)atomic_get(&ring->stats.high_watermark)) {
+        atomic_set(&ring->stats.high_watermark, (atomic_val_t)depth);
+    }
+
+    //Re-read tail after publishing. If the consumer had emptied the ring it may be about to
+    //sleep, having seen the old head, so wake it. Otherwise it is still draining and will see
+    //this item before it waits again.
+    barrier_dmem_fence_full();
+    if ((uint32_t)atomic_get(&ring->tail) == head) {
+        atomic_inc(&ring->stats.wakeups);
+        k_sem_give(ring->data_sem);
+    }
+    return 0;
+}
+
+void spsc_ring_put_retry(SpscRing *ring, const void *item, int32_t poll_ms)
+{
+    while (spsc_ring_put(ring, item) != 0) {
+        k_msleep(poll_ms);
+    }
+}
+
+int spsc_ring_get(SpscRing *ring, void *item, k_timeout_t timeout)
+{
+    while (1) {
+        uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+        uint32_t head = (uint32_t)atomic_get(&ring->head);
+
+        if (head != tail) {
+            barrier_dmem_fence_full(); //Read the item only after seeing the head that published it
+            memcpy(item, _slot(ring, tail), ring->item_size);
+            barrier_dmem_fence_full(); //Finish the copy before the slot is handed back
+            atomic_set(&ring->tail, (atomic_val_t)(tail + 1));
+            return 0;
+        }
+
+        //Empty, a give left over from an earlier transition only costs one extra pass
+        int ret = k_sem_take(ring->data_sem, timeout);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+}
+
+void spsc_ring_reset(SpscRing *ring)
+{
+    atomic_set(&ring->tail, atomic_get(&ring->head));
+    k_sem_reset(ring->data_sem);
+}
+
+uint32_t spsc_ring_count(const SpscRing *ring)
+{
+    return (uint32_t)atomic_get(&ring->head) - (uint32_t)atomic_get(&ring->tail);
+}
+
+void spsc_ring_log_stats(const SpscRing *ring, const char *name)
+{
+    LOG_INF("%s: puts %d, drops %d, wakeups %d, high watermark %d/%u", name,
+            (int)atomic_get(&ring->stats.puts), (int)atomic_get(&ring->stats.drops),
+            (int)atomic_get(&ring->stats.wakeups), (int)atomic_get(&ring->stats.high_watermark),
+            ring->capacity);
+}
@@ -0,0 +1,55 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <stdint.h>
+
+//Lock free single producer, single consumer queue of fixed size items.
+//Puts never block and only take the kernel path when the queue goes from empty to
+//non-empty, to wake the consumer.
+typedef struct {
+    atomic_t puts;
+    atomic_t drops;          //Puts rejected because the ring was full
+    atomic_t wakeups;        //Semaphore gives on the empty to non-empty transition
+    atomic_t high_watermark; //Deepest the ring has been
+} SpscRingStats;
+
+typedef struct {
+    uint8_t *buffer;
+    size_t item_size;
+    uint32_t capacity; //Power of two
+    atomic_t head;     //Free running count of items put, written by the producer only
+    atomic_t tail;     //Free running count of items taken, written by the consumer only
+    struct k_sem *data_sem;
+    SpscRingStats stats;
+} SpscRing;
+
+#define SPSC_RING_DEFINE(_name, _item_size, _capacity)                                   \
+    BUILD_ASSERT(((_capacity) & ((_capacity) - 1)) == 0, "SPSC ring capacity must be a power of two"); \
+    K_SEM_DEFINE(_name##_data_sem, 0, 1);                                                 \
+    static uint8_t __aligned(4) _name##_storage[(_item_size) * (_capacity)];              \
+    SpscRing _name = {                                                                    \
+        .buffer = _name##_storage,                                                        \
+        .item_size = (_item_size),                                                        \
+        .capacity = (_capacity),                                                          \
+        .data_sem = &_name##_data_sem,                                                    \
+    }
+
+//Copy item into the ring, returns -ENOMSG if full. Producer side only.
+int spsc_ring_put(SpscRing *ring, const void *item);
+
+//Put that retries every poll_ms until there is space. Producer side only.
+void spsc_ring_put_retry(SpscRing *ring, const void *item, int32_t poll_ms);
+
+//Copy the oldest item out of the ring, waiting up to timeout. Returns -EAGAIN on timeout. Consumer side only.
+int spsc_ring_get(SpscRing *ring, void *item, k_timeout_t timeout);
+
+//Drop everything queued, only while neither side is running
+void spsc_ring_reset(SpscRing *ring);
+
+uint32_t spsc_ring_count(const SpscRing *ring);
+
+void spsc_ring_log_stats(const SpscRing *ring, const char *name);
+
+#endif
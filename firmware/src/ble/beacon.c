@@ -0,0 +1,148 @@
+#include "beacon.h"
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <errno.h>
+#include "../macros.h"
+#include "../audio/dsp_consumers.h"
+
+LOG_MODULE_REGISTER(beacon);
+
+static void _apply(struct k_work *work);
+static K_WORK_DEFINE(_apply_work, _apply);
+
+static atomic_t _enable_request;
+
+//Only touched on the system work queue. Every advertising call is also behind IS_ENABLED, so
+//without CONFIG_HEART_PATCH_BEACON none of them are built in.
+static struct bt_le_ext_adv *_adv;
+static bool _running;
+static uint32_t _interval_ms;
+static struct heart_beacon _beacon;
+static struct bt_data _ad[] = {
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, &_beacon, sizeof(_beacon)),
+};
+
+static uint32_t _updates;
+static uint32_t _interval_changes;
+static uint32_t _failed;
+
+static struct bt_le_adv_param _param(uint32_t interval_ms) {
+    uint32_t interval = BT_GAP_MS_TO_ADV_INTERVAL(interval_ms);
+    //Non-connectable and non-scannable, the summary is all in the advertising data
+    return (struct bt_le_adv_param)BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_EXT_ADV, interval, interval, NULL);
+}
+
+int beacon_init(void) {
+    _beacon = (struct heart_beacon){ .company_id = sys_cpu_to_le16(BEACON_COMPANY_ID), .version = BEACON_VERSION };
+    _interval_ms = BEACON_IDLE_INTERVAL_MS;
+    _running = false;
+    atomic_set(&_enable_request, 0);
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON)) return 0;
+
+    struct bt_le_adv_param param = _param(_interval_ms);
+    int ret = bt_le_ext_adv_create(&param, NULL, &_adv);
+    if (ret) {
+        LOG_ERR("Beacon advertising set failed (err %d)", ret);
+        _adv = NULL;
+        return ret;
+    }
+    return bt_le_ext_adv_set_data(_adv, _ad, ARRAY_SIZE(_ad), NULL, 0);
+}
+
+void beacon_enable(bool enable) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON)) {
+        LOG_WRN("Beacon not built in, CONFIG_HEART_PATCH_BEACON");
+        return;
+    }
+    atomic_set(&_enable_request, enable);
+    //Beats are packed with nobody connected while broadcasting
+    dsp_consumers_set(DSP_CONSUMER_BEACON, enable);
+    k_work_submit(&_apply_work);
+}
+
+bool beacon_is_enabled(void) {
+    return atomic_get(&_enable_request) != 0;
+}
+
+static void _apply(struct k_work *work) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON) || !_adv) return;
+    bool enable = beacon_is_enabled();
+    if (enable == _running) return;
+
+    int ret = enable ? bt_le_ext_adv_start(_adv, BT_LE_EXT_ADV_START_DEFAULT) : bt_le_ext_adv_stop(_adv);
+    if (ret) {
+        LOG_ERR("Beacon failed to %s (err %d)", enable ? "start" : "stop", ret);
+        return;
+    }
+    _running = enable;
+    LOG_INF("Beacon %s, interval %u ms", enable ? "started" : "stopped", _interval_ms);
+}
+
+//A new interval needs the set stopped, so only follow the beat period past the hysteresis
+static void _follow_heart_rate(float hr_bpm) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON)) return;
+    uint32_t interval_ms = BEACON_IDLE_INTERVAL_MS;
+    if (hr_bpm > 0.0f) {
+        interval_ms = (uint32_t)(60000.0f / hr_bpm);
+        interval_ms = CLAMP(interval_ms, BEACON_MIN_INTERVAL_MS, BEACON_MAX_INTERVAL_MS);
+    }
+    float change = ((float)interval_ms - (float)_interval_ms) / (float)_interval_ms;
+    if (change < BEACON_INTERVAL_HYST && change > -BEACON_INTERVAL_HYST) return;
+
+    struct bt_le_adv_param param = _param(interval_ms);
+    int ret = _running ? bt_le_ext_adv_stop(_adv) : 0;
+    if (!ret) ret = bt_le_ext_adv_update_param(_adv, &param);
+    if (!ret && _running) ret = bt_le_ext_adv_start(_adv, BT_LE_EXT_ADV_START_DEFAULT);
+    if (ret) {
+        LOG_ERR("Beacon interval update failed (err %d)", ret);
+        _failed++;
+        _running = false;
+        return;
+    }
+    _interval_ms = interval_ms;
+    _interval_changes++;
+}
+
+static void _set_data(void) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON)) return;
+    if (bt_le_ext_adv_set_data(_adv, _ad, ARRAY_SIZE(_ad), NULL, 0)) {
+        _failed++;
+        return;
+    }
+    _updates++;
+}
+
+static uint16_t _u16(float value) {
+    return (value <= 0.0f) ? 0 : (value >= (float)UINT16_MAX ? UINT16_MAX : (uint16_t)(value + 0.5f));
+}
+
+void beacon_update_beat(const struct heart_packet *packet, uint32_t seq) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON) || !_adv || !_running) return;
+
+    _beacon.seq = sys_cpu_to_le32(seq);
+    _beacon.timestamp_ms = sys_cpu_to_le32(packet->timestamp_ms);
+    _beacon.hr_bpm = (uint8_t)MIN(_u16(packet->hr_bpm), UINT8_MAX);
+    _beacon.hr_mean_bpm = (uint8_t)MIN(_u16(packet->hr_mean_bpm), UINT8_MAX);
+    _beacon.sdnn_ms = sys_cpu_to_le16(_u16(packet->sdnn_ms));
+    _beacon.rmssd_ms = sys_cpu_to_le16(_u16(packet->rmssd_ms));
+    _beacon.systolic_ms = sys_cpu_to_le16(_u16(packet->systolic_ms));
+    _beacon.centroid_hz = sys_cpu_to_le16(_u16(packet->centroid));
+    _beacon.rms = packet->rms;
+    _beacon.rms_trend = packet->rms_trend;
+    _set_data();
+    _follow_heart_rate(packet->hr_mean_bpm);
+}
+
+void beacon_update_alerts(uint8_t alerts) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON) || !_adv || !_running || alerts == _beacon.alerts) return;
+    _beacon.alerts = alerts;
+    _set_data();
+}
+
+void beacon_log_stats(void) {
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEACON)) return;
+    LOG_INF("Beacon updates: %u, interval changes: %u (now %u ms), failed: %u", _updates, _interval_changes,
+            _interval_ms, _failed);
+}
@@ -0,0 +1,45 @@
+#ifndef _BEACON_H_
+#define _BEACON_H_
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "heart_service.h"
+
+//Connectionless beat summary. With CONFIG_HEART_PATCH_BEACON a non-connectable extended advertising
+//set carries the last beat and the active alerts as manufacturer data, so any number of receivers
+//can follow the patch without connecting. The advertising interval follows the beat period.
+
+//Manufacturer data, little endian
+struct heart_beacon {
+	uint16_t company_id;   //BEACON_COMPANY_ID
+	uint8_t version;       //BEACON_VERSION
+	uint8_t alerts;        //BIT(code - 1) for each active alert code
+	uint32_t seq;          //Beat packet sequence number of the last beat
+	uint32_t timestamp_ms; //Of the last beat, as the beat packet
+	uint8_t hr_bpm;        //0 until the first interval is accepted
+	uint8_t hr_mean_bpm;
+	uint16_t sdnn_ms;
+	uint16_t rmssd_ms;
+	uint16_t systolic_ms;  //0 when no S2 was labelled
+	uint16_t centroid_hz;
+	float rms;
+	float rms_trend;
+} __packed;
+
+int beacon_init(void);
+
+//Start or stop broadcasting. Any thread.
+void beacon_enable(bool enable);
+
+bool beacon_is_enabled(void);
+
+//Latest beat and its sequence number. System work queue only.
+void beacon_update_beat(const struct heart_packet *packet, uint32_t seq);
+
+//Mask of active alerts as in struct heart_beacon. System work queue only.
+void beacon_update_alerts(uint8_t alerts);
+
+void beacon_log_stats(void);
+
+#endif
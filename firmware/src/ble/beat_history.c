@@ -0,0 +1,185 @@
+#include "beat_history.h"
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include "../macros.h"
+#include "../audio/dsp_consumers.h"
+#if IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY_SD)
+#include "../modules/sd_card.h"
+#endif
+
+LOG_MODULE_REGISTER(beat_history);
+
+#define HISTORY_RAM_LEN (IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY) ? BEAT_HISTORY_LEN : 1)
+
+static void _backfill_run(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(_backfill_work, _backfill_run);
+
+//Only touched on the system work queue
+static struct heart_packet _ring[HISTORY_RAM_LEN];
+static uint32_t _next_seq;
+static bool _sd_ok;
+static bool _backfilling;
+static uint32_t _backfill_next;
+static uint8_t _backfill_flags; //For the next notification
+
+static uint32_t _live_sent;
+static uint32_t _live_missed;
+static uint32_t _backfilled;
+static uint32_t _lost; //Asked for after they had left the history
+
+//Requests from the BLE threads
+static atomic_t _acked;           //Beats before this one are on the phone
+static atomic_t _request_from;
+static atomic_t _request_pending;
+
+int beat_history_init(void) {
+    _next_seq = 0;
+    _sd_ok = false;
+    _backfilling = false;
+    atomic_set(&_acked, 0);
+    atomic_set(&_request_pending, 0);
+
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY)) return 0;
+    //Beats are packed and kept with nobody subscribed
+    dsp_consumers_set(DSP_CONSUMER_HISTORY, true);
+
+#if IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY_SD)
+    //Sequence numbers restart at boot, the file is indexed by them
+    int ret = sd_card_delete(BEAT_HISTORY_FILE);
+    if (ret) {
+        LOG_WRN("Beat history in RAM only, SD not available (%d)", ret);
+    }
+    _sd_ok = (ret == 0);
+#endif
+    return 0;
+}
+
+uint32_t beat_history_publish(const struct heart_packet *packet, bool live) {
+    struct heart_packet *record = &_ring[_next_seq % HISTORY_RAM_LEN];
+    *record = *packet;
+    record->seq = _next_seq++;
+
+#if IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY_SD)
+    if (_sd_ok) {
+        size_t size = sizeof(*record);
+        int ret = sd_card_open_write_close(BEAT_HISTORY_FILE, (const char *)record, &size);
+        if (ret || size != sizeof(*record)) {
+            LOG_ERR("Beat history SD write failed (%d), RAM only from beat %u", ret, record->seq);
+            _sd_ok = false;
+        }
+    }
+#endif
+
+    if (live) {
+        if (bt_heart_service_notify_packet(record) == 0) {
+            _live_sent++;
+        } else {
+            _live_missed++;
+        }
+    }
+    return record->seq;
+}
+
+static uint32_t _oldest_kept(void) {
+    if (_sd_ok) return 0;
+    if (!IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY)) return _next_seq;
+    return (_next_seq > BEAT_HISTORY_LEN) ? _next_seq - BEAT_HISTORY_LEN : 0;
+}
+
+static int _read(uint32_t seq, struct heart_packet *record) {
+    if (IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY) && _next_seq - seq <= BEAT_HISTORY_LEN) {
+        *record = _ring[seq % HISTORY_RAM_LEN];
+        return 0;
+    }
+#if IS_ENABLED(CONFIG_HEART_PATCH_BEAT_HISTORY_SD)
+    if (_sd_ok) {
+        size_t size = sizeof(*record);
+        int ret = sd_card_read_at(BEAT_HISTORY_FILE, (size_t)seq * sizeof(*record), (char *)record, &size);
+        return (ret == 0 && size == sizeof(*record)) ? 0 : -EIO;
+    }
+#endif
+    return -ENOENT;
+}
+
+//Next notification of the backfill, count 0 once it has caught up
+static void _fill(struct heart_history *history) {
+    uint32_t oldest = _oldest_kept();
+    if (_backfill_next < oldest) {
+        _lost += oldest - _backfill_next;
+        _backfill_flags |= HEART_HISTORY_FLAG_LOST;
+        _backfill_next = oldest;
+    }
+
+    history->count = 0;
+    history->flags = _backfill_flags;
+    for (uint32_t seq = _backfill_next; seq < _next_seq && history->count < HEART_HISTORY_MAX_RECORDS; seq++) {
+        if (_read(seq, &history->records[history->count]) != 0) {
+            //Unreadable beats are skipped, the phone sees the gap in the sequence numbers
+            if (history->count == 0) {
+                _backfill_next++;
+                _lost++;
+                history->flags |= HEART_HISTORY_FLAG_LOST;
+                _backfill_flags |= HEART_HISTORY_FLAG_LOST;
+                continue;
+            }
+            break;
+        }
+        history->count++;
+    }
+}
+
+static void _backfill_run(struct k_work *work) {
+    if (atomic_cas(&_request_pending, 1, 0)) {
+        uint32_t from = (uint32_t)atomic_get(&_request_from);
+        _backfill_next = (from == BEAT_HISTORY_FROM_ACK) ? (uint32_t)atomic_get(&_acked) : from;
+        _backfill_flags = 0;
+        _backfilling = true;
+        LOG_INF("Backfilling beats %u to %u", _backfill_next, _next_seq);
+    }
+    if (!_backfilling) return;
+
+    for (int32_t n = 0; n < BEAT_HISTORY_BATCHES_PER_RUN; n++) {
+        struct heart_history history;
+        _fill(&history);
+
+        int ret = bt_heart_service_notify_history(&history);
+        if (ret == -ENOMEM) {
+            k_work_reschedule(&_backfill_work, K_MSEC(BEAT_HISTORY_RETRY_MS));
+            return;
+        }
+        if (ret) {
+            LOG_WRN("Backfill stopped at beat %u (%d)", _backfill_next, ret);
+            _backfilling = false;
+            return;
+        }
+        _backfill_flags = 0;
+        if (history.count == 0) {
+            LOG_INF("Backfill complete at beat %u", _backfill_next);
+            _backfilling = false;
+            return;
+        }
+        _backfill_next += history.count;
+        _backfilled += history.count;
+    }
+    //Let the rest of the system work queue run between bursts
+    k_work_reschedule(&_backfill_work, K_NO_WAIT);
+}
+
+void beat_history_backfill(uint32_t from_seq) {
+    atomic_set(&_request_from, (atomic_val_t)from_seq);
+    atomic_set(&_request_pending, 1);
+    k_work_reschedule(&_backfill_work, K_NO_WAIT);
+}
+
+void beat_history_ack(uint32_t seq) {
+    if ((atomic_val_t)(seq + 1) > atomic_get(&_acked)) {
+        atomic_set(&_acked, (atomic_val_t)(seq + 1));
+    }
+}
+
+void beat_history_log_stats(void) {
+    LOG_INF("Beats: %u, live sent %u, missed %u, acked %u", _next_seq, _live_sent, _live_missed,
+            (uint32_t)atomic_get(&_acked));
+    LOG_INF("Beats backfilled: %u, lost from the history: %u%s", _backfilled, _lost, _sd_ok ? " (SD)" : "");
+}
@@ -0,0 +1,29 @@
+#ifndef _BEAT_HISTORY_H_
+#define _BEAT_HISTORY_H_
+
+#include <zephyr/kernel.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "heart_service.h"
+
+//Every beat packet gets a sequence number. With CONFIG_HEART_PATCH_BEAT_HISTORY the last
+//BEAT_HISTORY_LEN are kept in RAM, and with CONFIG_HEART_PATCH_BEAT_HISTORY_SD every beat since
+//boot is also appended to BEAT_HISTORY_FILE. The phone acks what it has, and missed beats are
+//backfilled over the history characteristic when it subscribes or asks for them.
+
+#define BEAT_HISTORY_FROM_ACK UINT32_MAX
+
+int beat_history_init(void);
+
+//Number, keep and (with live set) notify a beat, returns its sequence number. System work queue only.
+uint32_t beat_history_publish(const struct heart_packet *packet, bool live);
+
+//Send every beat kept from seq on, BEAT_HISTORY_FROM_ACK for the first one not acked. Any thread.
+void beat_history_backfill(uint32_t from_seq);
+
+//The phone has every beat up to and including seq. Any thread.
+void beat_history_ack(uint32_t seq);
+
+void beat_history_log_stats(void);
+
+#endif
@@ -16,6 +16,8 @@
 #include <zephyr/bluetooth/gatt.h>
 
 #include "heart_service.h"
+#include "beat_history.h"
+#include "beacon.h"
 
 #include <zephyr/settings/settings.h>
 #include <zephyr/logging/log.h>
@@ -179,7 +181,7 @@ static struct bt_conn_auth_cb conn_auth_callbacks = {
     .cancel = auth_cancel,
 };
 
-static void heart_control_handler(uint8_t opcode){
+static void heart_control_handler(uint8_t opcode, const uint8_t *payload, uint16_t len){
     switch (opcode) {
         case 0x01:
             event_handler_post((AppEvent){ .type = EVENT_BLE_RECORD });
@@ -187,6 +189,34 @@ static void heart_control_handler(uint8_t opcode){
         case 0x02:
             event_handler_post((AppEvent){ .type = EVENT_BLE_TRANSMIT });
             break;
+        case 0x03:
+            event_handler_post((AppEvent){ .type = EVENT_BLE_SET_DSP_MODE });
+            break;
+        case 0x04:
+            event_handler_post((AppEvent){ .type = EVENT_BLE_SET_RAW_MODE });
+            break;
+        case 0x05:
+            event_handler_post((AppEvent){ .type = EVENT_BLE_STOP_STREAMING });
+            break;
+        case 0x06:
+            event_handler_post((AppEvent){ .type = EVENT_BLE_MONITOR_PERIODIC });
+            break;
+        case 0x07:
+            event_handler_post((AppEvent){ .type = EVENT_BLE_MONITOR_CONTINUOUS });
+            break;
+        case HEART_CONTROL_BACKFILL:
+            beat_history_backfill((len >= sizeof(uint32_t)) ? sys_get_le32(payload) : BEAT_HISTORY_FROM_ACK);
+            break;
+        case HEART_CONTROL_ACK:
+            if (len >= sizeof(uint32_t)) {
+                beat_history_ack(sys_get_le32(payload));
+            } else {
+                LOG_WRN("Ack without a sequence number");
+            }
+            break;
+        case HEART_CONTROL_BEACON:
+            beacon_enable(len >= 1 && payload[0] != 0);
+            break;
         default:
             LOG_WRN("Unhandled opcode: 0x%02X", opcode);
     }
@@ -2,14 +2,20 @@
 
 #include <zephyr/types.h>
 #include <errno.h>
+#include <stddef.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
 #include "../event_handler.h"
+#include "../audio/dsp_consumers.h"
+#include "beat_history.h"
 
 #define HEART_ATTR_IDX_PACKET_VALUE 2
 #define HEART_ATTR_IDX_ALERT_VALUE  5
 #define HEART_ATTR_AUDIO_VAL 8
+#define HEART_ATTR_IDX_FEATURES_VALUE 13
+#define HEART_ATTR_IDX_ENVELOPE_VALUE 16
+#define HEART_ATTR_IDX_HISTORY_VALUE 19
 #define AUDIO_CHUNK_SIZE 244  // Max payload per audio notification
 
 
@@ -18,16 +24,42 @@ LOG_MODULE_REGISTER(heart_service);
 static bool notify_enabled_packet = false;
 static bool notify_enabled_alert = false;
 static bool notify_enabled_audio = false;
+static bool notify_enabled_features = false;
+static bool notify_enabled_envelope = false;
+static bool notify_enabled_history = false;
 static struct bt_heart_service_cb registered_callbacks;
 
 static void packet_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
 {
 	notify_enabled_packet = (value == BT_GATT_CCC_NOTIFY);
+	dsp_consumers_set(DSP_CONSUMER_PACKET, notify_enabled_packet);
 }
 
 static void alert_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
 {
 	notify_enabled_alert = (value == BT_GATT_CCC_NOTIFY);
+	dsp_consumers_set(DSP_CONSUMER_ALERT, notify_enabled_alert);
+}
+
+static void features_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	notify_enabled_features = (value == BT_GATT_CCC_NOTIFY);
+	dsp_consumers_set(DSP_CONSUMER_FEATURES, notify_enabled_features);
+}
+
+static void envelope_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	notify_enabled_envelope = (value == BT_GATT_CCC_NOTIFY);
+	dsp_consumers_set(DSP_CONSUMER_ENVELOPE, notify_enabled_envelope);
+}
+
+static void history_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	notify_enabled_history = (value == BT_GATT_CCC_NOTIFY);
+	//A (re)connecting phone gets whatever it missed since its last ack
+	if (notify_enabled_history) {
+		beat_history_backfill(BEAT_HISTORY_FROM_ACK);
+	}
 }
 
 static void alert_audio_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
@@ -45,7 +77,7 @@ static ssize_t control_point_write_cb(struct bt_conn *conn,
 	const uint8_t *cmd = buf;
 
 	if (registered_callbacks.run_on_control_command) {
-		registered_callbacks.run_on_control_command(cmd[0]);
+		registered_callbacks.run_on_control_command(cmd[0], &cmd[1], len - 1);
 	}
 
 	return len;
@@ -78,6 +110,27 @@ BT_GATT_SERVICE_DEFINE(heart_svc,
 		BT_GATT_CHRC_WRITE,
 		BT_GATT_PERM_WRITE,
 		NULL, control_point_write_cb, NULL),
+
+	BT_GATT_CHARACTERISTIC(BT_UUID_HEART_FEATURES,
+		BT_GATT_CHRC_NOTIFY,
+		BT_GATT_PERM_NONE,
+		NULL, NULL, NULL),
+	BT_GATT_CCC(features_ccc_cfg_changed,
+		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+	BT_GATT_CHARACTERISTIC(BT_UUID_HEART_ENVELOPE,
+		BT_GATT_CHRC_NOTIFY,
+		BT_GATT_PERM_NONE,
+		NULL, NULL, NULL),
+	BT_GATT_CCC(envelope_ccc_cfg_changed,
+		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
+	BT_GATT_CHARACTERISTIC(BT_UUID_HEART_HISTORY,
+		BT_GATT_CHRC_NOTIFY,
+		BT_GATT_PERM_NONE,
+		NULL, NULL, NULL),
+	BT_GATT_CCC(history_ccc_cfg_changed,
+		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 );
 
 int bt_heart_service_init(const struct bt_heart_service_cb *callbacks)
@@ -102,7 +155,7 @@ int bt_heart_service_notify_packet(const struct heart_packet *pkt)
 	return bt_gatt_notify(NULL, packet_attr, pkt, sizeof(*pkt));
 }
 
-int bt_heart_service_notify_alert(uint8_t code)
+int bt_heart_service_notify_alert(const struct heart_alert *alert)
 {
 	if (!notify_enabled_alert) {
 		LOG_ERR("Alert Code Failed to send: not enabled");
@@ -111,7 +164,46 @@ int bt_heart_service_notify_alert(uint8_t code)
 
     const struct bt_gatt_attr *alert_attr  = &heart_svc.attrs[HEART_ATTR_IDX_ALERT_VALUE];
 
-	return bt_gatt_notify(NULL, alert_attr, &code, sizeof(code));
+	return bt_gatt_notify(NULL, alert_attr, alert, sizeof(*alert));
+}
+
+int bt_heart_service_notify_features(const struct heart_features *features)
+{
+	if (!notify_enabled_features) {
+		return -EACCES;
+	}
+	uint16_t len = offsetof(struct heart_features, data) +
+		sizeof(float) * (__builtin_popcount(features->value_mask) + __builtin_popcount(features->slope_mask));
+	const struct bt_gatt_attr *features_attr = &heart_svc.attrs[HEART_ATTR_IDX_FEATURES_VALUE];
+
+	return bt_gatt_notify(NULL, features_attr, features, len);
+}
+
+int bt_heart_service_notify_envelope(const struct heart_envelope *envelope)
+{
+	if (!notify_enabled_envelope) {
+		return -EACCES;
+	}
+	uint16_t len = offsetof(struct heart_envelope, data) + envelope->count;
+	const struct bt_gatt_attr *envelope_attr = &heart_svc.attrs[HEART_ATTR_IDX_ENVELOPE_VALUE];
+
+	return bt_gatt_notify(NULL, envelope_attr, envelope, len);
+}
+
+int bt_heart_service_notify_history(const struct heart_history *history)
+{
+	if (!notify_enabled_history) {
+		return -EACCES;
+	}
+	uint16_t len = offsetof(struct heart_history, records) + sizeof(struct heart_packet) * history->count;
+	const struct bt_gatt_attr *history_attr = &heart_svc.attrs[HEART_ATTR_IDX_HISTORY_VALUE];
+
+	return bt_gatt_notify(NULL, history_attr, history, len);
+}
+
+bool bt_heart_service_packet_enabled(void)
+{
+	return notify_enabled_packet;
 }
 
 int transmit_audio_buffer(const uint8_t *buffer, size_t length)
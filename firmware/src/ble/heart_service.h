@@ -2,6 +2,7 @@
 #define HEART_SERVICE_H_
 
 #include <zephyr/types.h>
+#include <stdbool.h>
 
 //09BD3E92-235B-4A5B-B00C-BD50E1749A44
 #define BT_UUID_HEART_SERVICE_VAL \
@@ -15,6 +16,18 @@
 #define BT_UUID_HEART_ALERT_VAL \
 	BT_UUID_128_ENCODE(0x359502D4, 0xF343, 0x48CE, 0x97D9, 0xD78FC37D69EE)
 
+//6A4F0C2E-7B1D-4E8A-9C55-3F2B8D1E0A71
+#define BT_UUID_HEART_FEATURES_VAL \
+	BT_UUID_128_ENCODE(0x6A4F0C2E, 0x7B1D, 0x4E8A, 0x9C55, 0x3F2B8D1E0A71)
+
+//8B3E5D21-6C4A-4F9B-A2D7-51E0C9F3B6A8
+#define BT_UUID_HEART_ENVELOPE_VAL \
+	BT_UUID_128_ENCODE(0x8B3E5D21, 0x6C4A, 0x4F9B, 0xA2D7, 0x51E0C9F3B6A8)
+
+//D4A7C2B9-3E18-4B6F-8E05-7C9A1F2D6B34
+#define BT_UUID_HEART_HISTORY_VAL \
+	BT_UUID_128_ENCODE(0xD4A7C2B9, 0x3E18, 0x4B6F, 0x8E05, 0x7C9A1F2D6B34)
+
 //C18D949A-0047-46A0-BF2C-E40D87341949
 #define BT_UUID_HEART_AUDIO_VAL \
 	BT_UUID_128_ENCODE(0xC18D949A, 0x0047, 0x46A0, 0xBF2C, 0xE40D87341949)
@@ -28,6 +41,25 @@
 #define BT_UUID_HEART_ALERT       BT_UUID_DECLARE_128(BT_UUID_HEART_ALERT_VAL)
 #define BT_UUID_HEART_AUDIO     BT_UUID_DECLARE_128(BT_UUID_HEART_AUDIO_VAL)
 #define BT_UUID_HEART_CONTROL   BT_UUID_DECLARE_128(BT_UUID_HEART_CONTROL_VAL)
+#define BT_UUID_HEART_FEATURES  BT_UUID_DECLARE_128(BT_UUID_HEART_FEATURES_VAL)
+#define BT_UUID_HEART_ENVELOPE  BT_UUID_DECLARE_128(BT_UUID_HEART_ENVELOPE_VAL)
+#define BT_UUID_HEART_HISTORY   BT_UUID_DECLARE_128(BT_UUID_HEART_HISTORY_VAL)
+
+//Alert characteristic codes
+#define HEART_ALERT_NORMAL 0x00
+#define HEART_ALERT_RMS 0x01
+#define HEART_ALERT_CENTROID 0x02
+#define HEART_ALERT_POOR_SIGNAL 0x03
+#define HEART_ALERT_ABNORMAL 0x04
+
+//Sent when an alert is raised, rises in severity or clears
+struct heart_alert {
+	uint8_t code;
+	uint8_t active;        //1 raised, 0 cleared
+	uint8_t severity;      //1 to ALERT_MAX_SEVERITY while active, 0 when cleared
+	uint32_t onset_ms;     //Uptime the condition was first seen
+	uint32_t timestamp_ms; //Uptime of this transition
+} __packed;
 
 struct heart_packet {
 	float rms;
@@ -35,9 +67,65 @@ struct heart_packet {
 	uint32_t timestamp_ms;
 	float rms_trend;
 	float centroid_trend;
+	//S2 of the same beat, all zero when none was labelled
+	float s2_rms;
+	float s2_centroid;
+	float s2_rms_trend;
+	float s2_centroid_trend;
+	float systolic_ms; //S1 to S2 interval
+	//Heart rate up to this S1, all zero until the first interval is accepted
+	float hr_bpm;
+	float hr_mean_bpm;
+	float sdnn_ms;
+	float rmssd_ms;
+	//Energy between the sounds, zero when the segment was not found
+	float systolic_rms;
+	float systolic_ratio; //Segment over S1/S2 energy
+	float systolic_centroid;
+	float systolic_ratio_trend;
+	float diastolic_rms;
+	float diastolic_ratio;
+	float diastolic_centroid;
+	float diastolic_ratio_trend;
+	uint32_t seq; //Beat sequence number since boot, for backfill
+} __packed;
+
+//Control opcodes, backfill and ack take a little endian uint32 sequence number as payload
+#define HEART_CONTROL_BACKFILL 0x08 //Send every kept beat from seq on, from the last ack without a payload
+#define HEART_CONTROL_ACK 0x09      //The phone has every beat up to and including seq
+#define HEART_CONTROL_BEACON 0x0A   //One byte payload, 1 starts the connectionless beacon, 0 stops it
+
+//Backfilled beats, count packets in sequence order. A notification with count 0 ends the backfill.
+#define HEART_HISTORY_MAX_RECORDS 2
+#define HEART_HISTORY_FLAG_LOST 0x01 //Beats before this one were dropped from the history
+struct heart_history {
+	uint8_t count;
+	uint8_t flags;
+	struct heart_packet records[HEART_HISTORY_MAX_RECORDS];
+} __packed;
+
+//Per sound feature vector, variable length: only the values in value_mask then the slopes in
+//slope_mask are sent, each in feature id order
+#define HEART_FEATURES_MAX_DATA 24
+struct heart_features {
+	uint32_t timestamp_ms;
+	uint32_t value_mask;
+	uint32_t slope_mask;
+	uint8_t sound; //1 = S1, 2 = S2
+	float data[HEART_FEATURES_MAX_DATA];
+} __packed;
+
+//Live envelope trace, 8 bit samples of data[i] * scale / 255 at rate_hz from timestamp_ms
+#define HEART_ENVELOPE_MAX_SAMPLES 32
+struct heart_envelope {
+	uint32_t timestamp_ms;
+	float scale;
+	uint8_t rate_hz;
+	uint8_t count;
+	uint8_t data[HEART_ENVELOPE_MAX_SAMPLES];
 } __packed;
 
-typedef void (*heart_control_cb_t)(uint8_t opcode);
+typedef void (*heart_control_cb_t)(uint8_t opcode, const uint8_t *payload, uint16_t len);
 
 struct bt_heart_service_cb {
 	heart_control_cb_t run_on_control_command;
@@ -45,7 +133,11 @@ struct bt_heart_service_cb {
 
 int bt_heart_service_init(const struct bt_heart_service_cb *callbacks);
 int bt_heart_service_notify_packet(const struct heart_packet *pkt);
-int bt_heart_service_notify_alert(uint8_t code);
+int bt_heart_service_notify_alert(const struct heart_alert *alert);
+int bt_heart_service_notify_features(const struct heart_features *features);
+int bt_heart_service_notify_envelope(const struct heart_envelope *envelope);
+int bt_heart_service_notify_history(const struct heart_history *history);
+bool bt_heart_service_packet_enabled(void);
 int bt_heart_service_send_audio_chunk(uint16_t offset); // new API
 
 int transmit_audio_buffer(const uint8_t *buffer, size_t length);
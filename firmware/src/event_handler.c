@@ -4,8 +4,10 @@
 #include "modules/led_controller.h"
 #include "ble/ble_manager.h"
 #include "ble/heart_service.h"
+#include "ble/beacon.h"
 #include "audio/audio_in.h"
 #include "audio/audio_stream.h"
+#include "modules/monitor_scheduler.h"
 
 LOG_MODULE_REGISTER(event_handler);
 
@@ -16,6 +18,7 @@ typedef enum {
     STATE_IDLE,
     STATE_ADVERTISING,
     STATE_CONNECTED,
+    STATE_MONITORING, //Between the capture windows of a monitoring schedule
     STATE_STREAMING
 } AppState;
 
@@ -51,7 +54,6 @@ void _send_demo_heartbeat_packet()
     }
 }
 
-#if !IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE)
 void _transmit_audio_ble() {
     //Send Via BLE
     const int16_t *buf = get_audio_buffer();
@@ -69,7 +71,6 @@ void _transmit_audio_ble() {
         LOG_WRN("No audio buffer available to transmit.");
     }
 }
-#endif
 
 //===========================================FSM State function wrappers===================================
 void _advertise() {
@@ -86,14 +87,43 @@ void _connect() {
     app_state = STATE_CONNECTED;
 }
 
-void _read_in_audio() {
+int _start_capture(uint32_t num_blocks) {
+    int ret = audio_in_start(num_blocks);
+    if (ret != 0) {
+        LOG_ERR("Capture failed to start: %d", ret);
+        return ret;
+    }
     led_controller_start_blinking(K_MSEC(150));
-    audio_in_start();
-    #if !IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE)
+    app_state = STATE_STREAMING;
+    return 0;
+}
+
+void _capture_finished() {
+    if (audio_stream_get_mode() == AUDIO_STREAM_MODE_RAW) {
         _transmit_audio_ble();
-    #endif
+    }
     led_controller_stop_blinking();
     led_controller_on();
+    app_state = monitor_scheduler_window_finished() ? STATE_MONITORING : STATE_CONNECTED;
+}
+
+void _start_monitoring(MonitorScheduleId id) {
+    //Monitoring feeds the DSP chain, raw audio only makes sense one capture at a time
+    if (audio_stream_get_mode() != AUDIO_STREAM_MODE_DSP) {
+        LOG_WRN("Monitoring needs DSP mode");
+        return;
+    }
+    if (monitor_scheduler_start(id) == 0) {
+        app_state = STATE_MONITORING;
+    }
+}
+
+void _monitor_window_due() {
+    monitor_scheduler_window_started();
+    if (_start_capture(monitor_scheduler_window_blocks()) != 0) {
+        //Try again at the next window
+        monitor_scheduler_window_finished();
+    }
 }
 
 // int _read_wav() {
@@ -121,12 +151,21 @@ void _read_in_audio() {
 
 static void handle_event(AppEvent evt)
 {
-    int ret;
+    //An alert brings the next monitoring window forward, whatever the state
+    if (evt.type == EVENT_HEART_ALERT) {
+        monitor_scheduler_trigger();
+        return;
+    }
     switch (app_state) {
         case STATE_IDLE:
             if (evt.type == EVENT_BUTTON_0_PRESS) {
                 _advertise();
             }
+            //Without a phone to start it, e.g. on native_sim
+            if (evt.type == EVENT_START_UP && IS_ENABLED(CONFIG_HEART_PATCH_AUTOSTART_MONITOR)) {
+                app_state = STATE_CONNECTED;
+                _start_monitoring(MONITOR_SCHEDULE_CONTINUOUS);
+            }
             break;
         case STATE_ADVERTISING:
             if (evt.type == EVENT_BLE_CONNECTED) {
@@ -138,12 +177,23 @@ static void handle_event(AppEvent evt)
             //Send Dummy BLE Data
             if (evt.type == EVENT_BUTTON_0_PRESS) {
                 _send_demo_heartbeat_packet();
-                ret = bt_heart_service_notify_alert(0x02);
-                if(ret!=0) LOG_ERR("Alert Failed to send");
             }
-            //Record Audio to SD Card and then stream over BLE
+            //Capture runs on the audio threads, finishing with EVENT_AUDIO_FINISHED
             if (evt.type == EVENT_BLE_RECORD) {
-                _read_in_audio();
+                _start_capture(audio_stream_get_capture_blocks());
+            }
+            if (evt.type == EVENT_BLE_MONITOR_PERIODIC) {
+                _start_monitoring(MONITOR_SCHEDULE_PERIODIC);
+            }
+            if (evt.type == EVENT_BLE_MONITOR_CONTINUOUS) {
+                _start_monitoring(MONITOR_SCHEDULE_CONTINUOUS);
+            }
+            //Switch between DSP and raw audio modes, capture is not running here
+            if (evt.type == EVENT_BLE_SET_DSP_MODE) {
+                audio_stream_set_mode(AUDIO_STREAM_MODE_DSP);
+            }
+            if (evt.type == EVENT_BLE_SET_RAW_MODE) {
+                audio_stream_set_mode(AUDIO_STREAM_MODE_RAW);
             }
             // if (evt.type = EVENT_BLE_DISCONNECTED) {
             //     app_state = STATE_IDLE;
@@ -151,14 +201,38 @@ static void handle_event(AppEvent evt)
             // }
             break;
 
+        case STATE_MONITORING:
+            //PDM is stopped here, the next window starts on EVENT_MONITOR_WINDOW_DUE
+            if (evt.type == EVENT_MONITOR_WINDOW_DUE) {
+                _monitor_window_due();
+            }
+            if (evt.type == EVENT_BLE_RECORD) {
+                monitor_scheduler_trigger();
+            }
+            //The beacon keeps monitoring going for receivers that aren't connected
+            if (evt.type == EVENT_BLE_STOP_STREAMING || evt.type == EVENT_BUTTON_0_PRESS ||
+                (evt.type == EVENT_BLE_DISCONNECTED && !beacon_is_enabled())) {
+                monitor_scheduler_stop();
+                app_state = STATE_CONNECTED;
+            }
+            if (evt.type == EVENT_BLE_SET_DSP_MODE || evt.type == EVENT_BLE_SET_RAW_MODE) {
+                LOG_WRN("Mode can't change while monitoring");
+            }
+            break;
+
         case STATE_STREAMING:
-            // if (evt.type == EVENT_AUDIO_FINISHED) {
-            //     //audio_stop();
-            //     //led_set_mode(LED_OFF);
-            //     app_state = STATE_CONNECTED;
-            // }
-            led_controller_start_blinking(K_MSEC(500));
-            app_state = STATE_IDLE;
+            //Stop early, the capture ends within a block and then reports finished
+            if (evt.type == EVENT_BLE_STOP_STREAMING || evt.type == EVENT_BUTTON_0_PRESS ||
+                (evt.type == EVENT_BLE_DISCONNECTED && !(beacon_is_enabled() && monitor_scheduler_is_active()))) {
+                monitor_scheduler_stop();
+                audio_in_request_stop();
+            }
+            if (evt.type == EVENT_AUDIO_FINISHED) {
+                _capture_finished();
+            }
+            if (evt.type == EVENT_BLE_SET_DSP_MODE || evt.type == EVENT_BLE_SET_RAW_MODE) {
+                LOG_WRN("Mode can't change during a capture");
+            }
             break;
         }
 }
@@ -17,6 +17,12 @@ typedef enum {
     EVENT_BLE_TOGGLE_LED,
     EVENT_BLE_RECORD,
     EVENT_BLE_TRANSMIT,
+    EVENT_BLE_SET_DSP_MODE,
+    EVENT_BLE_SET_RAW_MODE,
+    EVENT_BLE_MONITOR_PERIODIC,
+    EVENT_BLE_MONITOR_CONTINUOUS,
+    EVENT_MONITOR_WINDOW_DUE,
+    EVENT_HEART_ALERT,
 } AppEventType;
 
 typedef struct {
@@ -12,11 +12,13 @@
 #define NUM_CHANNELS 1
 #define READ_TIMEOUT 1000
 
-#if CONFIG_HEART_PATCH_DSP_MODE
-#define WAV_LENGTH_BLOCKS 200 //Length of capture, 200 = 20s at 16Khz fs
-#else
-#define WAV_LENGTH_BLOCKS 50  //5s for BLE transmission
-#endif
+#define WAV_LENGTH_BLOCKS 200 //Length of DSP mode capture, 200 = 20s at 16Khz fs
+#define RAW_AUDIO_LENGTH_BLOCKS 50  //Length of raw audio capture, 5s for BLE transmission
+
+//Monitoring schedules
+#define MONITOR_PERIODIC_WINDOW_BLOCKS 300 //30s windows
+#define MONITOR_PERIODIC_PERIOD_MS (5 * 60 * 1000) //every 5 minutes, start to start
+#define MONITOR_CPU_REPORT_PERIOD_MS (60 * 60 * 1000)
 
 #define BLOCK_SIZE(_sample_rate, _number_of_channels) \
 (BYTES_PER_SAMPLE * (_sample_rate / 10) * _number_of_channels)
@@ -26,22 +28,99 @@
 
 #define MAX_FILENAME_LEN 16
 
+//Raw audio mode
+#define RAW_AUDIO_BUF_SAMPLES (RAW_AUDIO_LENGTH_BLOCKS * BLOCK_SIZE_SAMPLES)
+
 //DSP 
 //Circular Buffer
-#define CB_NUM_BLOCKS 20
+#define CB_NUM_BLOCKS 16 //1.6s of full rate history
 #define CB_BLOCK_SAMPLES BLOCK_SIZE_SAMPLES
+#define CB_DECIMATION 16 //Older audio kept at 1khz, bandpass is 30-150hz so no extra anti-aliasing
+#define CB_DEC_NUM_BLOCKS 64 //6.4s of decimated history behind the full rate blocks
+#define CB_DEC_BLOCK_SAMPLES (CB_BLOCK_SAMPLES / CB_DECIMATION)
+#define CB_HISTORY_SAMPLES ((CB_NUM_BLOCKS + CB_DEC_NUM_BLOCKS) * CB_BLOCK_SAMPLES) //8s at 16khz
 
 //Peak Processor
-#define PP_MAX_WINDOW_LEN CB_NUM_BLOCKS * CB_BLOCK_SAMPLES
+#define PP_MAX_WINDOW_LEN (CB_NUM_BLOCKS * CB_BLOCK_SAMPLES + CB_DEC_NUM_BLOCKS * CB_DEC_BLOCK_SAMPLES)
+
+//Window Pool, one maximum length window or several shorter ones in flight
+#define WP_NUM_SLOTS 4
+#define WP_POOL_SAMPLES PP_MAX_WINDOW_LEN
 
 //Window Analysis
 #define STE_SAMPLES_PER_BLOCK 160 // 160 at 16khz = 10ms
-#define STE_MAX_BUF_LEN PP_MAX_WINDOW_LEN / STE_SAMPLES_PER_BLOCK
+#define STE_MAX_BUF_LEN (CB_HISTORY_SAMPLES / STE_SAMPLES_PER_BLOCK)
 #define MAX_NUM_WINDOW_PEAKS 64
 #define HS_WINDOW_SIZE 512
 
+//Feature Engine, 31.25hz bins for both the full rate and decimated FFTs
+#define FE_SPECTRUM_MAX_HZ 500.0f
+#define FE_SPECTRUM_BINS (HS_WINDOW_SIZE / CB_DECIMATION / 2 + 1) //0-500hz
+#define FE_NUM_FILTERS 6
+#define FE_NUM_CEPS 4
+#define FE_NUM_BANDS 3
+#define FE_ROLLOFF_FRACTION 0.85f
+#define FE_MAX_TRENDS 4 //Trended features beyond S1 RMS and centroid
+
 #define TREND_ANALYSER_MAX_BUFFER 30
 
+//Wavelet segmentation, 0-125hz approximation at 250hz from both tiers of the history
+#define WL_LEVELS 6     //Full rate
+#define WL_DEC_LEVELS 2 //Decimated history
+#define WL_CHUNK_ELEMENTS 2048 //Level elements per window analysis unit, half of them are lifted
+#define WL_SMOOTH_LEN 5 //20ms
+#define WL_MIN_PEAK_GAP_MS 100
+#define WL_SYSTOLE_BASE_MS 496.0f //S1 to S2 interval falls linearly with heart rate (Weissler)
+#define WL_SYSTOLE_PER_BPM_MS 2.1f
+
+//HSMM segmentation, Viterbi over a 50hz envelope of the STE profile
+#define HSMM_DECIMATION 2 //STE blocks per observation
+#define HSMM_OBS_MS (HSMM_DECIMATION * STE_SAMPLES_PER_BLOCK * 1000 / MAX_SAMPLE_RATE)
+#define HSMM_MAX_OBS 128  //2.56s, longer windows are labelled from STE peaks instead
+#define HSMM_MAX_DUR 96   //Longest state, in observations
+#define HSMM_NUM_LEVELS 16
+#define HSMM_LEVELS_PER_OCTAVE 2 //Envelope quantised in half octaves around the window mean
+#define HSMM_LOG_Q 8      //Log probabilities in Q8
+#define HSMM_DUR_SIGMAS 3 //Longer or shorter states are not allowed
+
+//Envelope stream, the detection envelope decimated for a live trace
+#define ENV_STREAM_DECIMATION 100   //160hz
+#define ENV_STREAM_BATCH 32         //Samples per notification, 200ms
+#define ENV_STREAM_SCALE_DECAY 0.9f //Per batch, full scale follows the envelope peak back down in a few seconds
+#define ENV_STREAM_QUEUE_LEN 4
+
+//Beat history, packets kept for backfill after a disconnection
+#define BEAT_HISTORY_LEN 128 //About 2 minutes in RAM
+#define BEAT_HISTORY_FILE "beats.bin" //With CONFIG_HEART_PATCH_BEAT_HISTORY_SD
+#define BEAT_HISTORY_BATCHES_PER_RUN 8 //Notifications per system work queue run during a backfill
+#define BEAT_HISTORY_RETRY_MS 20 //Wait for BLE buffers to free up
+
+//Beacon, beat summary in extended advertising with CONFIG_HEART_PATCH_BEACON
+#define BEACON_COMPANY_ID 0xFFFF //Reserved for testing, replace with an assigned company ID
+#define BEACON_VERSION 1
+#define BEACON_MIN_INTERVAL_MS 250   //240bpm
+#define BEACON_MAX_INTERVAL_MS 2000  //30bpm
+#define BEACON_IDLE_INTERVAL_MS 1000 //Until there is a heart rate
+#define BEACON_INTERVAL_HYST 0.1f    //Interval changes smaller than this fraction are ignored
+
+//Signal Quality, envelope periodicity on a 50hz envelope
+#define SQ_ENV_DECIMATION 320
+#define SQ_ENV_HISTORY_LEN 150 //3s
+#define SQ_MIN_LAG 15 //0.3s, 200bpm
+#define SQ_MAX_LAG 75 //1.5s, 40bpm
+
+//Heart rate, S1 to S1 intervals kept for the statistics
+#define HR_MAX_HORIZON_BEATS 64
+#define HR_MIN_BEATS_FOR_OUTLIERS 4 //Outlier rejection needs a mean to compare with
+
+//Alerts, severity steps by the raise to clear distance past the raise threshold
+#define ALERT_MAX_SEVERITY 3
+
+//DSP snapshot
+#define DSP_SNAPSHOT_MAX_PEAK_AGE_SAMPLES (2 * MAX_SAMPLE_RATE) //Older validator history can't pair with the next peak
+#define DSP_SNAPSHOT_NVS_SECTORS 3
+#define DSP_SNAPSHOT_PERSIST_MIN_MS (30 * 60 * 1000) //At most one flash write per half hour
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846f
 #endif
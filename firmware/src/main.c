@@ -14,6 +14,9 @@
 #include "macros.h"
 #include "event_handler.h"
 #include "ble/ble_manager.h"
+#include "ble/beat_history.h"
+#include "ble/beacon.h"
+#include "modules/monitor_scheduler.h"
 #include "audio/dsp/rt_peak_detector.h"
 #include "audio/dsp/circular_block_buffer.h"
 #include "audio/dsp/peak_processor.h"
@@ -21,6 +24,13 @@
 
 LOG_MODULE_REGISTER(main);
 
+//The board overlays label the microphone dmic_dev, pdm0 on a board without one
+#if DT_NODE_EXISTS(DT_NODELABEL(dmic_dev))
+#define DMIC_NODE DT_NODELABEL(dmic_dev)
+#else
+#define DMIC_NODE DT_NODELABEL(pdm0)
+#endif
+
 int main(void)
 {
     int ret;
@@ -48,9 +58,11 @@ int main(void)
 		.audio_input_type = AUDIO_INPUT_TYPE_PDM,
 		.input_wav_config = input_wav_config,
 		.output_wav_config = output_wav_config,
-		.dmic_ctx = DEVICE_DT_GET(DT_NODELABEL(pdm0)),
+		.dmic_ctx = DEVICE_DT_GET(DMIC_NODE),
+#if IS_ENABLED(CONFIG_AUDIO_DMIC_NRFX_PDM)
 		.pdm_gain = NRF_PDM_GAIN_MAXIMUM,
-		.msgq = audio_stream_get_msgq(),
+#endif
+		.ring = audio_stream_get_ring(),
 	};
 
 	RTPeakConfig rt_peak_config = {
@@ -65,7 +77,7 @@ int main(void)
 		.close_r = 0.45,
 		.far_r = 0.55,
 		.margin = 0.05,
-		.peak_msgq = audio_stream_get_peak_msgq()
+		.peak_ring = audio_stream_get_peak_ring()
 	};
 
 	PeakProcessorConfig peak_processor_config = {
@@ -74,6 +86,19 @@ int main(void)
 		.pre_min_samples = 200,
 	};
 
+	//Springer et al. sound durations, envelope levels in log2 of the window mean
+	HsmmConfig hsmm_config = {
+		.emission_mean = { 1.5f, -1.5f, 1.0f, -2.0f }, //S1, systole, S2, diastole
+		.emission_sd = { 1.2f, 1.5f, 1.2f, 1.5f },
+		.s1_ms = 122,
+		.s1_sd_ms = 22,
+		.s2_ms = 92,
+		.s2_sd_ms = 22,
+		.systole_sd_ms = 25,
+		.diastole_sd_r = 0.07f,
+		.diastole_sd_ms = 6,
+	};
+
 	WindowAnalysisConfig window_analysis_config = {
 		.audio_hl_thresh = 1.0f / 3.0f,
 		.ste_block_size_samples = STE_SAMPLES_PER_BLOCK,
@@ -85,6 +110,15 @@ int main(void)
 		.ident_s1_s2_gap_r = 0.29,
 		.ident_s1_s2_gap_tol = 0.15,
 		.hs_window_size = HS_WINDOW_SIZE,
+		.history_decimation = CB_DECIMATION,
+		.feature_trend_mask = FE_MASK(FE_FLATNESS) | FE_MASK(FE_ROLLOFF),
+		.feature_ble_mask = FE_MASK_ALL,
+		.segment_spectrum = false,
+		.segmenter = WA_SEGMENTER_STE,
+		.wl_peak_thresh_scale = 1.0f,
+		.wl_s1_search_ms = 100,
+		.wl_s2_tol = 0.3f,
+		.hsmm = hsmm_config,
 
 		//Trend analysis
 	    .ta_rms_buf_size = TREND_ANALYSER_MAX_BUFFER,
@@ -96,11 +130,63 @@ int main(void)
     	.ta_centroid_min_windows = 15,
 	};
 
+	SignalQualityConfig signal_quality_config = {
+		.clip_level = 0.99f,
+		.clip_rate_max = 0.01f,
+		.band_ratio_good = 0.25f,
+		.periodicity_good = 0.5f,
+		.alpha = 0.1f,
+		.sqi_thresh = 0.3f,
+	};
+
+	HeartRateConfig heart_rate_config = {
+		.horizon_beats = HR_MAX_HORIZON_BEATS,
+		.min_rr_ms = 270,  //220bpm
+		.max_rr_ms = 2000, //30bpm
+		.outlier_ratio = 0.25f,
+		.max_rejects = 4,
+	};
+
+	//Raised on the trend thresholds, cleared at half the slope
+	AlertManagerConfig alert_config = {
+		.rules = {
+			[ALERT_ID_RMS] = {
+				.raise = window_analysis_config.ta_rms_slope_thresh,
+				.clear = 0.5f * window_analysis_config.ta_rms_slope_thresh,
+				.raise_hold_ms = 10000,
+				.clear_hold_ms = 30000,
+			},
+			[ALERT_ID_CENTROID] = {
+				.raise = window_analysis_config.ta_centroid_slope_thresh,
+				.clear = 0.5f * window_analysis_config.ta_centroid_slope_thresh,
+				.raise_hold_ms = 10000,
+				.clear_hold_ms = 30000,
+			},
+			[ALERT_ID_POOR_SIGNAL] = {
+				.raise = signal_quality_config.sqi_thresh,
+				.clear = 0.4f,
+				.raise_hold_ms = 0,
+				.clear_hold_ms = 5000,
+			},
+			[ALERT_ID_ABNORMAL] = {
+				.raise = 0.8f,
+				.clear = 0.6f,
+				.raise_hold_ms = 3000,
+				.clear_hold_ms = 30000,
+			},
+		},
+		.min_interval_ms = 10000,
+	};
+
 	AudioStreamConfig audio_stream_config = {
 		.rt_peak_config = rt_peak_config,
 		.rt_peak_val_config = rt_peak_val_config,
 		.peak_processor_config = peak_processor_config,
 		.window_analysis_config = window_analysis_config,
+		.signal_quality_config = signal_quality_config,
+		.heart_rate_config = heart_rate_config,
+		.alert_config = alert_config,
+		.initial_mode = IS_ENABLED(CONFIG_HEART_PATCH_DSP_MODE) ? AUDIO_STREAM_MODE_DSP : AUDIO_STREAM_MODE_RAW,
 	};
 
 	ret = button_handler_init();
@@ -120,8 +206,13 @@ int main(void)
 
 	ret = ble_init();
 	if(ret!=0) LOG_ERR("BLE Failed to init");
+	ret = beat_history_init();
+	if(ret!=0) LOG_ERR("Beat history failed to init");
+	ret = beacon_init();
+	if(ret!=0) LOG_ERR("Beacon failed to init");
 
 	init_audio_stream(audio_stream_config);
+	monitor_scheduler_init();
 
     // Start up the application
     AppEvent ev = { .type = EVENT_START_UP};
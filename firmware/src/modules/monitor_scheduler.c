@@ -0,0 +1,184 @@
+#include "monitor_scheduler.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "../macros.h"
+#include "../event_handler.h"
+
+LOG_MODULE_REGISTER(monitor_scheduler, LOG_LEVEL_INF);
+
+static const MonitorSchedule _schedules[MONITOR_SCHEDULE_COUNT] = {
+    [MONITOR_SCHEDULE_ONE_SHOT] = { .name = "one-shot", .window_blocks = WAV_LENGTH_BLOCKS, .period_ms = 0 },
+    [MONITOR_SCHEDULE_PERIODIC] = {
+        .name = "periodic",
+        .window_blocks = MONITOR_PERIODIC_WINDOW_BLOCKS,
+        .period_ms = MONITOR_PERIODIC_PERIOD_MS,
+    },
+    [MONITOR_SCHEDULE_CONTINUOUS] = { .name = "continuous", .window_blocks = 0, .period_ms = 0 },
+};
+
+static MonitorScheduleId _schedule = MONITOR_SCHEDULE_ONE_SHOT;
+static bool _active = false;
+static bool _window_running = false;
+static bool _follow_up = false;
+static int64_t _window_start_ms;
+
+static struct k_work_delayable _window_work;
+
+static void _window_due(struct k_work *work)
+{
+    event_handler_post((AppEvent){ .type = EVENT_MONITOR_WINDOW_DUE });
+}
+
+//==============================================CPU active time=====================================================
+
+#if IS_ENABLED(CONFIG_HEART_PATCH_MONITOR_CPU_REPORT)
+
+typedef struct {
+    uint64_t active_cycles;
+    int64_t elapsed_ms;
+} MonitorCpuStats;
+
+static MonitorCpuStats _cpu_stats[MONITOR_SCHEDULE_COUNT];
+static uint64_t _cpu_mark_cycles;
+static int64_t _cpu_mark_ms;
+static struct k_spinlock _cpu_lock;
+static struct k_work_delayable _cpu_report_work;
+
+//Charge the non-idle cycles since the last mark to the current schedule
+static void _cpu_account(void)
+{
+    k_thread_runtime_stats_t stats;
+    if (k_thread_runtime_stats_all_get(&stats) != 0) return;
+
+    k_spinlock_key_t key = k_spin_lock(&_cpu_lock);
+    int64_t now = k_uptime_get();
+    _cpu_stats[_schedule].active_cycles += stats.total_cycles - _cpu_mark_cycles;
+    _cpu_stats[_schedule].elapsed_ms += now - _cpu_mark_ms;
+    _cpu_mark_cycles = stats.total_cycles;
+    _cpu_mark_ms = now;
+    k_spin_unlock(&_cpu_lock, key);
+}
+
+static void _cpu_report(struct k_work *work)
+{
+    monitor_scheduler_log_cpu();
+    k_work_schedule(&_cpu_report_work, K_MSEC(MONITOR_CPU_REPORT_PERIOD_MS));
+}
+
+void monitor_scheduler_log_cpu(void)
+{
+    _cpu_account();
+    for (int i = 0; i < MONITOR_SCHEDULE_COUNT; i++) {
+        k_spinlock_key_t key = k_spin_lock(&_cpu_lock);
+        MonitorCpuStats s = _cpu_stats[i];
+        k_spin_unlock(&_cpu_lock, key);
+        if (s.elapsed_ms <= 0) continue;
+
+        uint64_t active_ms = k_cyc_to_ms_floor64(s.active_cycles);
+        LOG_INF("CPU %s: %u ms active per hour over %u min",
+            _schedules[i].name,
+            (uint32_t)((active_ms * MONITOR_CPU_REPORT_PERIOD_MS) / s.elapsed_ms),
+            (uint32_t)(s.elapsed_ms / 60000));
+    }
+}
+
+static void _cpu_init(void)
+{
+    k_thread_runtime_stats_t stats;
+    if (k_thread_runtime_stats_all_get(&stats) == 0) {
+        _cpu_mark_cycles = stats.total_cycles;
+    }
+    _cpu_mark_ms = k_uptime_get();
+    k_work_init_delayable(&_cpu_report_work, _cpu_report);
+    k_work_schedule(&_cpu_report_work, K_MSEC(MONITOR_CPU_REPORT_PERIOD_MS));
+}
+
+#else
+
+static void _cpu_account(void) {}
+static void _cpu_init(void) {}
+void monitor_scheduler_log_cpu(void) {}
+
+#endif
+
+//==============================================Scheduling=====================================================
+
+static void _set_schedule(MonitorScheduleId id)
+{
+    //Close the time spent on the old schedule before switching
+    _cpu_account();
+    _schedule = id;
+}
+
+void monitor_scheduler_init(void)
+{
+    k_work_init_delayable(&_window_work, _window_due);
+    _cpu_init();
+}
+
+int monitor_scheduler_start(MonitorScheduleId id)
+{
+    if (id == MONITOR_SCHEDULE_ONE_SHOT || id >= MONITOR_SCHEDULE_COUNT) {
+        return -EINVAL;
+    }
+    _set_schedule(id);
+    _active = true;
+    _follow_up = false;
+    LOG_INF("Monitoring started: %s", _schedules[id].name);
+    k_work_reschedule(&_window_work, K_NO_WAIT);
+    return 0;
+}
+
+void monitor_scheduler_stop(void)
+{
+    if (!_active) return;
+    k_work_cancel_delayable(&_window_work);
+    _active = false;
+    _follow_up = false;
+    LOG_INF("Monitoring stopped: %s", _schedules[_schedule].name);
+    monitor_scheduler_log_cpu();
+    _set_schedule(MONITOR_SCHEDULE_ONE_SHOT);
+}
+
+bool monitor_scheduler_is_active(void)
+{
+    return _active;
+}
+
+uint32_t monitor_scheduler_window_blocks(void)
+{
+    return _schedules[_schedule].window_blocks;
+}
+
+void monitor_scheduler_window_started(void)
+{
+    _window_running = true;
+    _window_start_ms = k_uptime_get();
+}
+
+bool monitor_scheduler_window_finished(void)
+{
+    _window_running = false;
+    if (!_active) return false;
+
+    //Windows are spaced start to start, an alert during the window asks for the next one now
+    int64_t wait_ms = _window_start_ms + _schedules[_schedule].period_ms - k_uptime_get();
+    if (_follow_up || wait_ms < 0) {
+        wait_ms = 0;
+    }
+    _follow_up = false;
+    LOG_INF("Next window in %d ms", (int)wait_ms);
+    k_work_reschedule(&_window_work, K_MSEC(wait_ms));
+    return true;
+}
+
+void monitor_scheduler_trigger(void)
+{
+    if (!_active) return;
+
+    if (_window_running) {
+        _follow_up = true;
+    } else {
+        k_work_reschedule(&_window_work, K_NO_WAIT);
+    }
+}
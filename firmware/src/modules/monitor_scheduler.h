@@ -0,0 +1,35 @@
+#ifndef _MONITOR_SCHEDULER_H_
+#define _MONITOR_SCHEDULER_H_
+
+#include <zephyr/kernel.h>
+#include <stdbool.h>
+
+typedef enum {
+    MONITOR_SCHEDULE_ONE_SHOT,   //Single capture from the control point, no monitoring
+    MONITOR_SCHEDULE_PERIODIC,   //MONITOR_PERIODIC_WINDOW_BLOCKS every MONITOR_PERIODIC_PERIOD_MS
+    MONITOR_SCHEDULE_CONTINUOUS, //One window running until stopped
+    MONITOR_SCHEDULE_COUNT
+} MonitorScheduleId;
+
+typedef struct {
+    const char *name;
+    uint32_t window_blocks; //0 = until stopped
+    uint32_t period_ms;     //Window start to next window start
+} MonitorSchedule;
+
+//Windows come due as EVENT_MONITOR_WINDOW_DUE on the event handler, which runs the capture and
+//reports back with monitor_scheduler_window_started/finished. Call from the event handler only.
+void monitor_scheduler_init(void);
+int monitor_scheduler_start(MonitorScheduleId id);
+void monitor_scheduler_stop(void);
+bool monitor_scheduler_is_active(void);
+uint32_t monitor_scheduler_window_blocks(void);
+void monitor_scheduler_window_started(void);
+//Schedules the next window, returns false once monitoring has stopped
+bool monitor_scheduler_window_finished(void);
+//Bring the next window forward to now, or straight after the running one
+void monitor_scheduler_trigger(void);
+//Log CPU active time per hour of every schedule run so far
+void monitor_scheduler_log_cpu(void);
+
+#endif
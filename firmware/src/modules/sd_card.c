@@ -237,6 +237,98 @@ int sd_card_open_read_close(char const *const filename, char *const buf, size_t
 	return 0;
 }
 
+int sd_card_read_at(char const *const filename, size_t offset, char *const buf, size_t *size)
+{
+	int ret;
+	struct fs_file_t f_entry;
+	char abs_path_name[PATH_MAX_LEN + 1] = SD_ROOT_PATH;
+
+	ret = k_sem_take(&m_sem_sd_oper_ongoing, K_MSEC(K_SEM_OPER_TIMEOUT_MS));
+	if (ret) {
+		LOG_ERR("Sem take failed. Ret: %d", ret);
+		return ret;
+	}
+
+	if (!sd_init_success) {
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return -ENODEV;
+	}
+
+	if (strlen(filename) > FS_FATFS_MAX_LFN) {
+		LOG_ERR("Filename is too long");
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return -ENAMETOOLONG;
+	}
+
+	strcat(abs_path_name, filename);
+	fs_file_t_init(&f_entry);
+
+	ret = fs_open(&f_entry, abs_path_name, FS_O_READ);
+	if (ret) {
+		LOG_ERR("Open file failed");
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return ret;
+	}
+
+	ret = fs_seek(&f_entry, offset, FS_SEEK_SET);
+	if (ret == 0) {
+		ret = fs_read(&f_entry, buf, *size);
+	}
+	if (ret < 0) {
+		LOG_ERR("Read file failed. Ret: %d", ret);
+		fs_close(&f_entry);
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return ret;
+	}
+
+	*size = ret;
+
+	ret = fs_close(&f_entry);
+	if (ret) {
+		LOG_ERR("Close file failed");
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return ret;
+	}
+
+	k_sem_give(&m_sem_sd_oper_ongoing);
+	return 0;
+}
+
+int sd_card_delete(char const *const filename)
+{
+	int ret;
+	char abs_path_name[PATH_MAX_LEN + 1] = SD_ROOT_PATH;
+
+	ret = k_sem_take(&m_sem_sd_oper_ongoing, K_MSEC(K_SEM_OPER_TIMEOUT_MS));
+	if (ret) {
+		LOG_ERR("Sem take failed. Ret: %d", ret);
+		return ret;
+	}
+
+	if (!sd_init_success) {
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return -ENODEV;
+	}
+
+	if (strlen(filename) > FS_FATFS_MAX_LFN) {
+		LOG_ERR("Filename is too long");
+		k_sem_give(&m_sem_sd_oper_ongoing);
+		return -ENAMETOOLONG;
+	}
+
+	strcat(abs_path_name, filename);
+
+	ret = fs_unlink(abs_path_name);
+	if (ret == -ENOENT) {
+		ret = 0;
+	} else if (ret) {
+		LOG_ERR("Delete file failed: %d", ret);
+	}
+
+	k_sem_give(&m_sem_sd_oper_ongoing);
+	return ret;
+}
+
 int sd_card_open(char const *const filename, struct fs_file_t *f_seg_read_entry)
 {
 	int ret;
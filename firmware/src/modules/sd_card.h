@@ -68,6 +68,36 @@ int sd_card_open_write_close(char const *const filename, char const *const data,
  */
 int sd_card_open_read_close(char const *const filename, char *const buf, size_t *size);
 
+/**
+ * @brief	Read data from a position in a file into the buffer.
+ *
+ * @param[in]		filename	Name of the target file for reading, the default location is
+ *					the root directory of SD card.
+ * @param[in]		offset		Byte offset in the file to read from.
+ * @param[out]		buf		Pointer to the buffer to write the read data into.
+ * @param[in, out]	size		Pointer to the number of bytes to read. The actual read
+ *					size will be returned, less at the end of the file.
+ *
+ * @retval	0 on success.
+ * @retval	-EPERM SD card operation is ongoing somewhere else.
+ * @retval	-ENODEV SD init failed. SD card likely not inserted.
+ * @retval	Otherwise, error from underlying drivers.
+ */
+int sd_card_read_at(char const *const filename, size_t offset, char *const buf, size_t *size);
+
+/**
+ * @brief	Delete a file from the SD card.
+ *
+ * @param[in]		filename	Name of the file to delete, the default location is the
+ *					root directory of SD card.
+ *
+ * @retval	0 on success, or if the file didn't exist.
+ * @retval	-EPERM SD card operation is ongoing somewhere else.
+ * @retval	-ENODEV SD init failed. SD card likely not inserted.
+ * @retval	Otherwise, error from underlying drivers.
+ */
+int sd_card_delete(char const *const filename);
+
 /**
  * @brief	Open file on SD card.
  *
@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+# Builds the beacon test for nrf52_bsim (or $BOARD) into ${BSIM_OUT_PATH}/bin.
+# For BOARD=nrf5340bsim/nrf5340/cpuapp sysbuild adds the net core radio image, as for the patch.
+set -ue
+: "${ZEPHYR_BASE:?ZEPHYR_BASE must be set to point to the zephyr root directory}"
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH must point to the BabbleSim install}"
+
+BOARD="${BOARD:-nrf52_bsim}"
+test_dir="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+build_dir="${test_dir}/build_${BOARD//\//_}"
+
+if [[ "${BOARD}" == nrf5340bsim* ]]; then
+  west build -p -b "${BOARD}" -d "${build_dir}" --sysbuild "${test_dir}"
+  exe="${build_dir}/$(basename "${test_dir}")/zephyr/zephyr.exe"
+else
+  west build -p -b "${BOARD}" -d "${build_dir}" --no-sysbuild "${test_dir}"
+  exe="${build_dir}/zephyr/zephyr.exe"
+fi
+cp "${exe}" "${BSIM_OUT_PATH}/bin/bs_${BOARD//\//_}_heart_patch_beacon"
@@ -0,0 +1,307 @@
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+
+#include "bs_types.h"
+#include "bs_tracing.h"
+#include "time_machine.h"
+#include "bstests.h"
+
+#include "beacon.h"
+#include "macros.h"
+
+//Device 0 runs the firmware's beacon through an idle spell and two heart rates, device 1 scans
+//passively and decodes the manufacturer data from fixed byte offsets, so the on-air layout is
+//checked independently of struct heart_beacon. The advertising interval must follow the beat.
+
+#define WAIT_TIME (42 * USEC_PER_SEC) //Fail if not passed by then
+
+#define IDLE_MS 4000
+#define FAST_BPM 120
+#define FAST_MS 12000
+#define SLOW_BPM 40
+#define SLOW_MS 18000
+#define SCAN_MS (IDLE_MS + FAST_MS + SLOW_MS + 2000)
+#define ALERT_MASK BIT(0) //RMS alert, raised when the slow phase starts
+
+//Beat values as the beacon rounds them
+#define TEST_SDNN_MS 42
+#define TEST_RMSSD_MS 18
+#define TEST_SYSTOLIC_MS 301
+#define TEST_CENTROID_HZ 86
+#define TEST_RMS 0.25f
+#define TEST_RMS_TREND -0.5f
+
+//On-air layout of the beacon manufacturer data, little endian
+#define OFF_COMPANY_ID 0
+#define OFF_VERSION 2
+#define OFF_ALERTS 3
+#define OFF_SEQ 4
+#define OFF_TIMESTAMP 8
+#define OFF_HR 12
+#define OFF_HR_MEAN 13
+#define OFF_SDNN 14
+#define OFF_RMSSD 16
+#define OFF_SYSTOLIC 18
+#define OFF_CENTROID 20
+#define OFF_RMS 22
+#define OFF_RMS_TREND 26
+#define BEACON_LEN 30
+
+BUILD_ASSERT(sizeof(struct heart_beacon) == BEACON_LEN);
+BUILD_ASSERT(offsetof(struct heart_beacon, alerts) == OFF_ALERTS);
+BUILD_ASSERT(offsetof(struct heart_beacon, seq) == OFF_SEQ);
+BUILD_ASSERT(offsetof(struct heart_beacon, timestamp_ms) == OFF_TIMESTAMP);
+BUILD_ASSERT(offsetof(struct heart_beacon, hr_mean_bpm) == OFF_HR_MEAN);
+BUILD_ASSERT(offsetof(struct heart_beacon, centroid_hz) == OFF_CENTROID);
+BUILD_ASSERT(offsetof(struct heart_beacon, rms_trend) == OFF_RMS_TREND);
+
+#define FAIL(...)                                       \
+    do {                                                \
+        bst_result = Failed;                            \
+        bs_trace_error_time_line(__VA_ARGS__);          \
+    } while (0)
+
+#define PASS(...)                                       \
+    do {                                                \
+        bst_result = Passed;                            \
+        bs_trace_info_time(1, __VA_ARGS__);             \
+    } while (0)
+
+extern enum bst_result_t bst_result;
+
+//==============================================Beacon device=====================================================
+
+static struct heart_packet _packet;
+static uint32_t _seq;
+static uint8_t _alerts;
+
+//The beacon is driven from the system work queue, as the publish stage does
+static void _beat(struct k_work *work)
+{
+    beacon_update_beat(&_packet, ++_seq);
+}
+static K_WORK_DEFINE(_beat_work, _beat);
+
+static void _raise_alert(struct k_work *work)
+{
+    beacon_update_alerts(_alerts);
+}
+static K_WORK_DEFINE(_alert_work, _raise_alert);
+
+static void _beats(float bpm, uint32_t duration_ms)
+{
+    uint32_t period_ms = (uint32_t)(60000.0f / bpm);
+    for (uint32_t t = 0; t < duration_ms; t += period_ms) {
+        _packet = (struct heart_packet){
+            .rms = TEST_RMS,
+            .centroid = TEST_CENTROID_HZ,
+            .timestamp_ms = k_uptime_get_32(),
+            .rms_trend = TEST_RMS_TREND,
+            .systolic_ms = TEST_SYSTOLIC_MS,
+            .hr_bpm = bpm,
+            .hr_mean_bpm = bpm,
+            .sdnn_ms = TEST_SDNN_MS,
+            .rmssd_ms = TEST_RMSSD_MS,
+        };
+        k_work_submit(&_beat_work);
+        k_msleep(period_ms);
+    }
+}
+
+static void test_beacon_main(void)
+{
+    int err = bt_enable(NULL);
+    if (err) FAIL("Bluetooth init failed (err %d)\n", err);
+    err = beacon_init();
+    if (err) FAIL("Beacon init failed (err %d)\n", err);
+    beacon_enable(true);
+
+    k_msleep(IDLE_MS);
+    _beats(FAST_BPM, FAST_MS);
+    _alerts = ALERT_MASK;
+    k_work_submit(&_alert_work);
+    _beats(SLOW_BPM, SLOW_MS);
+
+    //The scanner decides the outcome
+    PASS("Beacon sent %u beats\n", _seq);
+}
+
+//==============================================Scanner device=====================================================
+
+typedef struct {
+    uint32_t time_ms;
+    uint32_t seq;
+    uint8_t hr_mean_bpm;
+    uint8_t alerts;
+} Report;
+
+#define MAX_REPORTS 256
+
+static Report _reports[MAX_REPORTS];
+static uint32_t _num_reports;
+static uint32_t _last_seq;
+
+static void _check_beacon(const uint8_t *data, uint32_t now_ms)
+{
+    uint32_t seq = sys_get_le32(&data[OFF_SEQ]);
+    uint8_t hr_mean = data[OFF_HR_MEAN];
+    uint8_t alerts = data[OFF_ALERTS];
+    float rms, rms_trend;
+
+    if (data[OFF_VERSION] != BEACON_VERSION) FAIL("Beacon version %u\n", data[OFF_VERSION]);
+    if (seq < _last_seq) FAIL("Beacon sequence went back from %u to %u\n", _last_seq, seq);
+    _last_seq = seq;
+
+    if (seq == 0) {
+        //Nothing measured yet
+        if (hr_mean != 0 || data[OFF_HR] != 0 || alerts != 0) FAIL("Idle beacon carries a beat\n");
+    } else {
+        memcpy(&rms, &data[OFF_RMS], sizeof(rms));
+        memcpy(&rms_trend, &data[OFF_RMS_TREND], sizeof(rms_trend));
+        if (hr_mean != FAST_BPM && hr_mean != SLOW_BPM) FAIL("Mean heart rate %u\n", hr_mean);
+        if (data[OFF_HR] != hr_mean) FAIL("Heart rate %u, mean %u\n", data[OFF_HR], hr_mean);
+        if (sys_get_le16(&data[OFF_SDNN]) != TEST_SDNN_MS ||
+            sys_get_le16(&data[OFF_RMSSD]) != TEST_RMSSD_MS ||
+            sys_get_le16(&data[OFF_SYSTOLIC]) != TEST_SYSTOLIC_MS ||
+            sys_get_le16(&data[OFF_CENTROID]) != TEST_CENTROID_HZ) {
+            FAIL("Beat %u: sdnn %u, rmssd %u, systolic %u, centroid %u\n", seq, sys_get_le16(&data[OFF_SDNN]),
+                 sys_get_le16(&data[OFF_RMSSD]), sys_get_le16(&data[OFF_SYSTOLIC]), sys_get_le16(&data[OFF_CENTROID]));
+        }
+        if (rms != TEST_RMS || rms_trend != TEST_RMS_TREND) FAIL("Beat %u: rms %f, trend %f\n", seq, rms, rms_trend);
+        uint32_t age_ms = now_ms - sys_get_le32(&data[OFF_TIMESTAMP]);
+        if (age_ms > 2 * BEACON_MAX_INTERVAL_MS) FAIL("Beat %u is %u ms old\n", seq, age_ms);
+        if (hr_mean == SLOW_BPM && alerts != ALERT_MASK) FAIL("Alerts 0x%02x in the slow phase\n", alerts);
+    }
+
+    if (_num_reports < MAX_REPORTS) {
+        _reports[_num_reports++] = (Report){ .time_ms = now_ms, .seq = seq, .hr_mean_bpm = hr_mean, .alerts = alerts };
+    }
+}
+
+static bool _parse_ad(struct bt_data *data, void *user_data)
+{
+    if (data->type != BT_DATA_MANUFACTURER_DATA || data->data_len < 2 ||
+        sys_get_le16(data->data) != BEACON_COMPANY_ID) {
+        return true;
+    }
+    if (data->data_len != BEACON_LEN) FAIL("Beacon data of %u bytes\n", data->data_len);
+    _check_beacon(data->data, *(uint32_t *)user_data);
+    return false;
+}
+
+static void _scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *buf)
+{
+    uint32_t now_ms = k_uptime_get_32();
+    if (!(info->adv_props & BT_GAP_ADV_PROP_EXT_ADV)) return;
+    bt_data_parse(buf, _parse_ad, &now_ms);
+}
+
+static struct bt_le_scan_cb _scan_cb = {
+    .recv = _scan_recv,
+};
+
+static int _cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+//Median gap between consecutive reports that both carry hr_mean, 0 with too few to tell
+static uint32_t _median_interval(uint8_t hr_mean)
+{
+    static uint32_t gaps[MAX_REPORTS];
+    uint32_t n = 0;
+    for (uint32_t i = 1; i < _num_reports; i++) {
+        if (_reports[i].hr_mean_bpm == hr_mean && _reports[i - 1].hr_mean_bpm == hr_mean) {
+            gaps[n++] = _reports[i].time_ms - _reports[i - 1].time_ms;
+        }
+    }
+    if (n < 5) return 0;
+    qsort(gaps, n, sizeof(gaps[0]), _cmp_u32);
+    return gaps[n / 2];
+}
+
+static void _check_interval(const char *phase, uint8_t hr_mean, uint32_t expected_ms)
+{
+    uint32_t median = _median_interval(hr_mean);
+    bs_trace_info_time(1, "%s: median interval %u ms, expected %u ms\n", phase, median, expected_ms);
+    //Advertising adds up to 10ms of random delay per event and the odd report is missed
+    if (median < expected_ms * 9 / 10 || median > expected_ms * 12 / 10) {
+        FAIL("%s: median interval %u ms, expected %u ms\n", phase, median, expected_ms);
+    }
+}
+
+static void test_scanner_main(void)
+{
+    struct bt_le_scan_param param = BT_LE_SCAN_PARAM_INIT(BT_LE_SCAN_TYPE_PASSIVE, BT_LE_SCAN_OPT_NONE,
+                                                          BT_GAP_SCAN_FAST_INTERVAL, BT_GAP_SCAN_FAST_INTERVAL);
+    int err = bt_enable(NULL);
+    if (err) FAIL("Bluetooth init failed (err %d)\n", err);
+    bt_le_scan_cb_register(&_scan_cb);
+    err = bt_le_scan_start(&param, NULL);
+    if (err) FAIL("Scanning failed to start (err %d)\n", err);
+
+    k_msleep(SCAN_MS);
+    bt_le_scan_stop();
+
+    bs_trace_info_time(1, "%u beacon reports, last beat %u\n", _num_reports, _last_seq);
+    if (_last_seq == 0) FAIL("No beat received\n");
+    _check_interval("Idle", 0, BEACON_IDLE_INTERVAL_MS);
+    _check_interval("Fast", FAST_BPM, 60000 / FAST_BPM);
+    _check_interval("Slow", SLOW_BPM, 60000 / SLOW_BPM);
+    PASS("Beacon layout and interval as expected\n");
+}
+
+//==============================================Test list=====================================================
+
+static void test_tick(bs_time_t HW_device_time)
+{
+    if (bst_result != Passed) {
+        FAIL("Test failed (not passed after %u seconds)\n", WAIT_TIME / USEC_PER_SEC);
+    }
+}
+
+static void test_init(void)
+{
+    bst_ticker_set_next_tick_absolute(WAIT_TIME);
+    bst_result = In_progress;
+}
+
+static const struct bst_test_instance test_def[] = {
+    {
+        .test_id = "beacon",
+        .test_descr = "Broadcast beats through an idle spell, 120bpm and 40bpm",
+        .test_post_init_f = test_init,
+        .test_tick_f = test_tick,
+        .test_main_f = test_beacon_main,
+    },
+    {
+        .test_id = "scanner",
+        .test_descr = "Decode the beacon and check its layout and interval",
+        .test_post_init_f = test_init,
+        .test_tick_f = test_tick,
+        .test_main_f = test_scanner_main,
+    },
+    BSTEST_END_MARKER
+};
+
+struct bst_test_list *test_beacon_install(struct bst_test_list *tests)
+{
+    return bst_add_tests(tests, test_def);
+}
+
+bst_test_install_t test_installers[] = {
+    test_beacon_install,
+    NULL
+};
+
+int main(void)
+{
+    bst_main();
+    return 0;
+}
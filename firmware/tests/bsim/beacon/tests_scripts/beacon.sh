@@ -0,0 +1,23 @@
+#!/usr/bin/env bash
+# One patch broadcasting beats at changing heart rates, one passive scanner checking the
+# manufacturer data layout and the advertising interval. Build first with ../compile.sh.
+source ${ZEPHYR_BASE}/tests/bsim/sh_common.source
+
+simulation_id="heart_patch_beacon"
+verbosity_level=2
+EXECUTE_TIMEOUT=120
+BOARD_TS="${BOARD_TS:-${BOARD:-nrf52_bsim}}"
+BOARD_TS="${BOARD_TS//\//_}"
+
+cd ${BSIM_OUT_PATH}/bin
+
+Execute ./bs_${BOARD_TS}_heart_patch_beacon \
+  -v=${verbosity_level} -s=${simulation_id} -d=0 -testid=beacon -RealEncryption=0
+
+Execute ./bs_${BOARD_TS}_heart_patch_beacon \
+  -v=${verbosity_level} -s=${simulation_id} -d=1 -testid=scanner -RealEncryption=0
+
+Execute ./bs_2G4_phy_v1 -v=${verbosity_level} -s=${simulation_id} \
+  -D=2 -sim_length=45e6 $@
+
+wait_for_background_jobs
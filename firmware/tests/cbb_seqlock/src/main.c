@@ -0,0 +1,194 @@
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "circular_block_buffer.h"
+
+//Seqlock checks for the block history: a window cbb_copy_window accepts must hold exactly the
+//samples that were written for it, and a window the writer got to first must come back -ENODATA.
+//Every sample is written as a pattern of its absolute index so a torn copy can't go unnoticed.
+
+#define TEST_NUM_BLOCKS 4 //Small rings so the writer laps readers often
+#define TEST_DEC_NUM_BLOCKS 8
+#define TEST_BLOCK_SAMPLES (BLOCK_SIZE_SAMPLES)
+#define TEST_DEC_BLOCK_SAMPLES (TEST_BLOCK_SAMPLES / CB_DECIMATION)
+#define TEST_HISTORY_SAMPLES ((TEST_NUM_BLOCKS - 1 + TEST_DEC_NUM_BLOCKS) * TEST_BLOCK_SAMPLES)
+#define TEST_MAX_WINDOW ((TEST_NUM_BLOCKS - 1) * TEST_BLOCK_SAMPLES + TEST_DEC_NUM_BLOCKS * TEST_DEC_BLOCK_SAMPLES)
+#define TEST_PATTERN_PERIOD 1000003 //Prime, a block from another lap never carries the same values
+#define TEST_ITERATIONS 2000
+
+#define WRITER_STACK_SIZE 1024
+#define WRITER_PRIORITY 3 //Above the reader, as the audio consumer is above the peak thread
+
+static float _storage[TEST_NUM_BLOCKS][BLOCK_SIZE_SAMPLES];
+static float _dec_storage[TEST_DEC_NUM_BLOCKS * TEST_DEC_BLOCK_SAMPLES];
+static float _window[TEST_MAX_WINDOW];
+static CircularBlockBuffer _buf;
+
+K_THREAD_STACK_DEFINE(_writer_stack, WRITER_STACK_SIZE);
+static struct k_thread _writer_thread;
+static atomic_t _writer_stop;
+
+static uint32_t _rand(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static float _pattern(uint32_t abs_idx)
+{
+    return (float)(abs_idx % TEST_PATTERN_PERIOD);
+}
+
+static void _write_block(void)
+{
+    uint32_t first = cbb_get_absolute_sample_index(&_buf);
+    float *block = cbb_get_write_block(&_buf);
+    for (uint32_t i = 0; i < TEST_BLOCK_SAMPLES; i++) {
+        block[i] = _pattern(first + i);
+    }
+    cbb_advance_write_index(&_buf);
+}
+
+static void _fill_history(void)
+{
+    for (uint32_t i = 0; i < TEST_NUM_BLOCKS + TEST_DEC_NUM_BLOCKS; i++) {
+        _write_block();
+    }
+}
+
+//Index of the first sample that doesn't match the pattern, -1 if the window is intact
+static int32_t _first_mismatch(const CbbWindowInfo *info, const float *window)
+{
+    for (int32_t i = 0; i < info->dec_len; i++) {
+        if (window[i] != _pattern(info->start_idx + i * CB_DECIMATION)) return i;
+    }
+    for (int32_t i = info->dec_len; i < info->len; i++) {
+        if (window[i] != _pattern(info->full_start_idx + (i - info->dec_len))) return i;
+    }
+    return -1;
+}
+
+//Writes bursts of blocks, sometimes more than the full rate tier holds, once per tick
+static void _writer(void *p1, void *p2, void *p3)
+{
+    uint32_t seed = 7;
+    while (!atomic_get(&_writer_stop)) {
+        uint32_t burst = 1 + _rand(&seed) % (TEST_NUM_BLOCKS + 1);
+        for (uint32_t i = 0; i < burst; i++) {
+            _write_block();
+        }
+        k_sleep(K_TICKS(1));
+    }
+}
+
+static void _before(void *fixture)
+{
+    cbb_init(&_buf, _storage, TEST_NUM_BLOCKS, TEST_BLOCK_SAMPLES, _dec_storage, TEST_DEC_NUM_BLOCKS, CB_DECIMATION);
+}
+
+ZTEST(cbb_seqlock, test_window_intact_without_writer)
+{
+    CbbWindowInfo info;
+    _fill_history();
+    uint32_t latest = cbb_get_absolute_sample_index(&_buf);
+
+    //Whole history, decimated tier first
+    zassert_ok(cbb_plan_window(&_buf, latest - TEST_HISTORY_SAMPLES, latest, 0, 0, &info));
+    zassert_true(info.dec_len > 0);
+    zassert_ok(cbb_copy_window(&_buf, &info, _window));
+    zassert_equal(_first_mismatch(&info, _window), -1);
+    zassert_equal(cbb_get_torn_reads(&_buf), 0);
+}
+
+ZTEST(cbb_seqlock, test_overwritten_full_rate_window_rejected)
+{
+    CbbWindowInfo info;
+    _fill_history();
+    uint32_t oldest = cbb_get_absolute_sample_index(&_buf) - (TEST_NUM_BLOCKS - 1) * TEST_BLOCK_SAMPLES;
+
+    zassert_ok(cbb_plan_window(&_buf, oldest, oldest + TEST_BLOCK_SAMPLES, 0, 0, &info));
+    zassert_equal(info.dec_len, 0);
+    for (uint32_t i = 0; i < TEST_NUM_BLOCKS; i++) {
+        _write_block();
+    }
+    zassert_equal(cbb_copy_window(&_buf, &info, _window), -ENODATA);
+    zassert_equal(cbb_get_torn_reads(&_buf), 1);
+}
+
+ZTEST(cbb_seqlock, test_window_in_slot_being_written_rejected)
+{
+    CbbWindowInfo info;
+    _fill_history();
+    uint32_t oldest = cbb_get_absolute_sample_index(&_buf) - (TEST_NUM_BLOCKS - 1) * TEST_BLOCK_SAMPLES;
+
+    zassert_ok(cbb_plan_window(&_buf, oldest, oldest + TEST_BLOCK_SAMPLES, 0, 0, &info));
+    //One block on, the planned block's slot is the next write block. Copy while it is half written.
+    _write_block();
+    float *block = cbb_get_write_block(&_buf);
+    block[0] = -1.0f;
+    zassert_equal(cbb_copy_window(&_buf, &info, _window), -ENODATA);
+    cbb_advance_write_index(&_buf);
+    zassert_equal(cbb_get_torn_reads(&_buf), 1);
+}
+
+ZTEST(cbb_seqlock, test_overwritten_decimated_window_rejected)
+{
+    CbbWindowInfo info;
+    _fill_history();
+    uint32_t oldest = cbb_get_absolute_sample_index(&_buf) - TEST_HISTORY_SAMPLES;
+
+    zassert_ok(cbb_plan_window(&_buf, oldest, oldest + TEST_BLOCK_SAMPLES, 0, 0, &info));
+    zassert_equal(info.dec_len, TEST_DEC_BLOCK_SAMPLES);
+    for (uint32_t i = 0; i < TEST_DEC_NUM_BLOCKS; i++) {
+        _write_block();
+    }
+    zassert_equal(cbb_copy_window(&_buf, &info, _window), -ENODATA);
+    zassert_equal(cbb_get_torn_reads(&_buf), 1);
+}
+
+//A writer thread hammers the buffer while this thread plans and copies random windows. On
+//hardware the writer preempts copies part way through; on native_sim, where a copy takes no
+//time, every other window sleeps between planning and copying so the writer can overtake it.
+ZTEST(cbb_seqlock, test_concurrent_windows_untorn)
+{
+    uint32_t seed = 1;
+    uint32_t accepted = 0, torn = 0, not_planned = 0;
+
+    _fill_history();
+    atomic_set(&_writer_stop, 0);
+    k_thread_create(&_writer_thread, _writer_stack, K_THREAD_STACK_SIZEOF(_writer_stack), _writer,
+                    NULL, NULL, NULL, WRITER_PRIORITY, 0, K_NO_WAIT);
+
+    for (int i = 0; i < TEST_ITERATIONS; i++) {
+        CbbWindowInfo info;
+        uint32_t latest = cbb_get_absolute_sample_index(&_buf);
+        uint32_t len = 1 + _rand(&seed) % (TEST_HISTORY_SAMPLES / 2);
+        uint32_t start = latest - TEST_HISTORY_SAMPLES + _rand(&seed) % (TEST_HISTORY_SAMPLES - len + 1);
+
+        if (cbb_plan_window(&_buf, start, start + len, 0, 0, &info) != 0) {
+            not_planned++; //The writer moved on between reading latest and planning
+            continue;
+        }
+        if (i & 1) {
+            k_sleep(K_TICKS(1));
+        }
+        int ret = cbb_copy_window(&_buf, &info, _window);
+        if (ret == 0) {
+            int32_t mismatch = _first_mismatch(&info, _window);
+            zassert_equal(mismatch, -1, "Accepted window at %d of %d samples torn at sample %d",
+                          info.start_idx, info.len, mismatch);
+            accepted++;
+        } else {
+            zassert_equal(ret, -ENODATA);
+            torn++;
+        }
+    }
+
+    atomic_set(&_writer_stop, 1);
+    k_thread_join(&_writer_thread, K_FOREVER);
+    TC_PRINT("%u windows accepted, %u torn, %u not planned\n", accepted, torn, not_planned);
+    zassert_true(accepted > 0);
+    zassert_true(torn > 0, "Writer never overtook a reader");
+    zassert_equal(cbb_get_torn_reads(&_buf), torn);
+}
+
+ZTEST_SUITE(cbb_seqlock, NULL, NULL, _before, NULL, NULL);
@@ -0,0 +1,10 @@
+//Built into the native_sim runner, with the host C library
+#include <stdint.h>
+#include <time.h>
+
+uint64_t bench_host_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
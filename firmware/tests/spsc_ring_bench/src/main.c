@@ -0,0 +1,166 @@
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "spsc_ring.h"
+
+//Moves the same messages through an spsc_ring and a k_msgq of the same depth and reports
+//throughput and how often the consumer had to be woken. Two scenarios:
+//- consumer above producer: every put reaches an empty queue and wakes the consumer, the worst
+//  case for both queues
+//- equal priority: the producer fills the queue and yields, the consumer drains it in one go,
+//  as the pipeline threads run when the consumer falls behind a burst
+
+#define BENCH_ITEMS 20000
+#define BENCH_CAPACITY 8 //Depth of the audio and peak rings
+#define BENCH_PRODUCER_PRIORITY 5
+#define BENCH_CONSUMER_STACK_SIZE 1024
+
+typedef struct {
+    uint32_t seq;
+    uint32_t payload[3]; //Same size as an audio_slab_msg
+} BenchItem;
+
+typedef enum {
+    BENCH_SPSC,
+    BENCH_MSGQ,
+} BenchQueue;
+
+typedef struct {
+    uint32_t received;
+    uint32_t out_of_order;
+    uint32_t waits; //Gets that found the queue empty and blocked
+} BenchConsumerStats;
+
+typedef struct {
+    uint64_t elapsed_ns;
+    uint32_t full;      //Puts that found the queue full and yielded
+    uint32_t wakeups;   //k_sem_give calls for the ring, consumer wakeups for the message queue
+    BenchConsumerStats consumer;
+} BenchResult;
+
+SPSC_RING_DEFINE(bench_ring, sizeof(BenchItem), BENCH_CAPACITY);
+K_MSGQ_DEFINE(bench_msgq, sizeof(BenchItem), BENCH_CAPACITY, 4);
+
+K_THREAD_STACK_DEFINE(_consumer_stack, BENCH_CONSUMER_STACK_SIZE);
+static struct k_thread _consumer_thread;
+static BenchConsumerStats _consumer_stats;
+
+#if IS_ENABLED(CONFIG_ARCH_POSIX)
+//Host wall clock, code takes no simulated time on native_sim
+extern uint64_t bench_host_clock_ns(void);
+
+static uint64_t _now_ns(void)
+{
+    return bench_host_clock_ns();
+}
+#else
+static uint64_t _now_ns(void)
+{
+    return k_cyc_to_ns_floor64(k_cycle_get_32());
+}
+#endif
+
+static void _consumer(void *p1, void *p2, void *p3)
+{
+    BenchQueue queue = (BenchQueue)(uintptr_t)p1;
+    BenchItem item;
+
+    for (uint32_t i = 0; i < BENCH_ITEMS; i++) {
+        if (queue == BENCH_SPSC) {
+            if (spsc_ring_count(&bench_ring) == 0) _consumer_stats.waits++;
+            spsc_ring_get(&bench_ring, &item, K_FOREVER);
+        } else if (k_msgq_get(&bench_msgq, &item, K_NO_WAIT) != 0) {
+            _consumer_stats.waits++;
+            k_msgq_get(&bench_msgq, &item, K_FOREVER);
+        }
+        if (item.seq != i) _consumer_stats.out_of_order++;
+        _consumer_stats.received++;
+    }
+}
+
+static void _put(BenchQueue queue, const BenchItem *item, BenchResult *result)
+{
+    if (queue == BENCH_SPSC) {
+        while (spsc_ring_put(&bench_ring, item) != 0) {
+            result->full++;
+            k_yield();
+        }
+    } else {
+        while (k_msgq_put(&bench_msgq, item, K_NO_WAIT) != 0) {
+            result->full++;
+            k_yield();
+        }
+    }
+}
+
+static BenchResult _run(BenchQueue queue, int consumer_priority)
+{
+    BenchResult result = { 0 };
+    BenchItem item = { 0 };
+
+    spsc_ring_reset(&bench_ring);
+    atomic_set(&bench_ring.stats.wakeups, 0);
+    k_msgq_purge(&bench_msgq);
+    _consumer_stats = (BenchConsumerStats){ 0 };
+
+    //A consumer above the producer starts now and blocks on the empty queue
+    k_thread_priority_set(k_current_get(), BENCH_PRODUCER_PRIORITY);
+    k_thread_create(&_consumer_thread, _consumer_stack, K_THREAD_STACK_SIZEOF(_consumer_stack), _consumer,
+                    (void *)(uintptr_t)queue, NULL, NULL, consumer_priority, 0, K_NO_WAIT);
+
+    uint64_t start = _now_ns();
+    for (uint32_t i = 0; i < BENCH_ITEMS; i++) {
+        item.seq = i;
+        _put(queue, &item, &result);
+    }
+    k_thread_join(&_consumer_thread, K_FOREVER);
+    result.elapsed_ns = _now_ns() - start;
+
+    result.consumer = _consumer_stats;
+    //A blocked k_msgq_get is ended by the put that hands it a message
+    result.wakeups = (queue == BENCH_SPSC) ? (uint32_t)atomic_get(&bench_ring.stats.wakeups) : _consumer_stats.waits;
+    return result;
+}
+
+static void _report(const char *scenario, const char *name, const BenchResult *result)
+{
+    uint64_t ops_per_s = result->elapsed_ns ? ((uint64_t)BENCH_ITEMS * NSEC_PER_SEC) / result->elapsed_ns : 0;
+
+    TC_PRINT("%s, %-8s: %u msgs in %u us, %u ops/s, %u wakeups, %u consumer waits, %u producer yields\n",
+             scenario, name, BENCH_ITEMS, (uint32_t)(result->elapsed_ns / NSEC_PER_USEC), (uint32_t)ops_per_s,
+             result->wakeups, result->consumer.waits, result->full);
+}
+
+static void _check_delivery(const BenchResult *result)
+{
+    zassert_equal(result->consumer.received, BENCH_ITEMS);
+    zassert_equal(result->consumer.out_of_order, 0);
+}
+
+ZTEST(spsc_ring_bench, test_consumer_above_producer)
+{
+    BenchResult spsc = _run(BENCH_SPSC, BENCH_PRODUCER_PRIORITY - 1);
+    BenchResult msgq = _run(BENCH_MSGQ, BENCH_PRODUCER_PRIORITY - 1);
+
+    _report("consumer above", "spsc", &spsc);
+    _report("consumer above", "k_msgq", &msgq);
+    _check_delivery(&spsc);
+    _check_delivery(&msgq);
+    //Every put finds the ring empty, so each one wakes the consumer
+    zassert_true(spsc.wakeups <= BENCH_ITEMS);
+}
+
+ZTEST(spsc_ring_bench, test_equal_priority)
+{
+    BenchResult spsc = _run(BENCH_SPSC, BENCH_PRODUCER_PRIORITY);
+    BenchResult msgq = _run(BENCH_MSGQ, BENCH_PRODUCER_PRIORITY);
+
+    _report("equal priority", "spsc", &spsc);
+    _report("equal priority", "k_msgq", &msgq);
+    _check_delivery(&spsc);
+    _check_delivery(&msgq);
+    //The ring only signals on the empty to non-empty transition, once per drained burst
+    zassert_true(spsc.wakeups <= BENCH_ITEMS / (BENCH_CAPACITY / 2),
+                 "%u wakeups for %u messages", spsc.wakeups, BENCH_ITEMS);
+}
+
+ZTEST_SUITE(spsc_ring_bench, NULL, NULL, NULL, NULL, NULL);
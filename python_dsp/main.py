@@ -1,8 +1,10 @@
+import os
 import numpy as np
 import matplotlib.pyplot as plt
 from dataclasses import dataclass
 
 from src.filters import design_bandpass_iir, design_lowpass_iir, plot_filter_response, export_sos_to_cmsis_header
+from src.classifier import export_classifier_header, placeholder_model
 from scipy.signal import sosfilt, sosfilt_zi
 from src.utils import plot_debug_audio_and_peaks, plot_audio_windows, plot_STE_windows, plot_fft_overlay, plot_rms_vs_event, plot_rms_distribution, read_wav_blocks
 from src.peak_detector_rt import PeakDetectorNPoint
@@ -78,6 +80,12 @@ plot_filter_response(sos_lowpass, cfg.fs, title="3rd-Order Lowpass IIR Filter 20
 export_sos_to_cmsis_header(sos_bandpass, "output/bandpass_coeffs", "bandpass_coeffs")
 export_sos_to_cmsis_header(sos_lowpass, "output/lowpass_coeffs", "lowpass_coeffs")
 
+# Classifier weights, a placeholder until a model is trained on labelled cycles (see src/classifier.py).
+# Only written when there is no header yet, trained weights are never replaced.
+CLASSIFIER_HEADER = "output/classifier_weights.h"
+if not os.path.exists(CLASSIFIER_HEADER):
+    export_classifier_header(placeholder_model(), CLASSIFIER_HEADER, placeholder=True)
+
 # Buffers & State
 slab_buffer = SlabBuffer(NUM_BLOCKS, BLOCK_SIZE)  
 peak_queue = [] #
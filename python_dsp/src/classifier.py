@@ -0,0 +1,197 @@
+import numpy as np
+import os
+
+# Per cycle abnormal sound classifier, a one hidden layer int8 MLP. The integer reference here
+# matches firmware/src/audio/dsp/classifier.c (and CMSIS-NN arm_fully_connected_s8) bit for bit.
+
+FEATURE_NAMES = ['rms', 'centroid', 'bandwidth', 'rolloff', 'flatness', 'peak_freq',
+                 'band_low', 'band_mid', 'band_high', 'cep_0', 'cep_1', 'cep_2', 'cep_3']
+
+# Input order: S1 features, S2 features, systolic and diastolic energy ratios
+INPUT_NAMES = ([f's1_{n}' for n in FEATURE_NAMES] + [f's2_{n}' for n in FEATURE_NAMES] +
+               ['systolic_ratio', 'diastolic_ratio'])
+NUM_INPUTS = len(INPUT_NAMES)
+NUM_HIDDEN = 16
+NUM_OUTPUTS = 2  # normal, abnormal
+
+INPUT_SCALE = 1.0 / 32.0  # Standardised inputs, +-4 sigma
+INPUT_ZERO_POINT = 0
+
+
+def make_inputs(s1_features, s2_features, systolic_ratio, diastolic_ratio):
+    return np.concatenate([s1_features, s2_features, [systolic_ratio, diastolic_ratio]]).astype(np.float32)
+
+
+def train_mlp(X, y, hidden=NUM_HIDDEN, epochs=2000, lr=0.05, l2=1e-4, seed=0):
+    """Float MLP on standardised inputs, y is 0 (normal) or 1 (abnormal) per cycle."""
+    rng = np.random.default_rng(seed)
+    mean = X.mean(axis=0)
+    std = X.std(axis=0) + 1e-6
+    Z = (X - mean) / std
+    W1 = rng.normal(0, np.sqrt(2.0 / Z.shape[1]), (Z.shape[1], hidden))
+    b1 = np.zeros(hidden)
+    W2 = rng.normal(0, np.sqrt(1.0 / hidden), (hidden, NUM_OUTPUTS))
+    b2 = np.zeros(NUM_OUTPUTS)
+    Y = np.eye(NUM_OUTPUTS)[y.astype(int)]
+
+    for _ in range(epochs):
+        H = np.maximum(Z @ W1 + b1, 0.0)
+        L = H @ W2 + b2
+        P = np.exp(L - L.max(axis=1, keepdims=True))
+        P /= P.sum(axis=1, keepdims=True)
+        dL = (P - Y) / len(Z)
+        dW2 = H.T @ dL + l2 * W2
+        dH = (dL @ W2.T) * (H > 0)
+        dW1 = Z.T @ dH + l2 * W1
+        W2 -= lr * dW2
+        b2 -= lr * dL.sum(axis=0)
+        W1 -= lr * dW1
+        b1 -= lr * dH.sum(axis=0)
+
+    return {'mean': mean, 'std': std, 'W1': W1, 'b1': b1, 'W2': W2, 'b2': b2}
+
+
+def _quantize_multiplier(real):
+    """real = multiplier * 2^(shift - 31), multiplier in [2^30, 2^31)"""
+    if real == 0.0:
+        return 0, 0
+    mant, shift = np.frexp(real)
+    q = int(np.round(mant * (1 << 31)))
+    if q == (1 << 31):
+        q //= 2
+        shift += 1
+    return q, int(shift)
+
+
+def _quantize_layer(W, b, in_scale, out_scale):
+    w_scale = max(np.abs(W).max(), 1e-8) / 127.0
+    Wq = np.clip(np.round(W / w_scale), -127, 127).astype(np.int8)
+    bq = np.round(b / (in_scale * w_scale)).astype(np.int32)
+    mult, shift = _quantize_multiplier(in_scale * w_scale / out_scale)
+    return Wq, bq, mult, shift
+
+
+def quantize_mlp(model, X):
+    """Symmetric int8 weights, int32 biases and per layer requantisation, calibrated on X."""
+    Z = (X - model['mean']) / model['std']
+    H = np.maximum(Z @ model['W1'] + model['b1'], 0.0)
+    L = H @ model['W2'] + model['b2']
+    # ReLU output uses the full int8 range from zero point -128
+    hidden_scale = max(H.max(), 1e-6) / 255.0
+    out_scale = max(np.abs(L).max(), 1e-6) / 127.0
+
+    W1q, b1q, m1, s1 = _quantize_layer(model['W1'], model['b1'], INPUT_SCALE, hidden_scale)
+    W2q, b2q, m2, s2 = _quantize_layer(model['W2'], model['b2'], hidden_scale, out_scale)
+    # Fold the hidden zero point into the second layer's input offset
+    return {
+        'mean': model['mean'].astype(np.float32), 'inv_std': (1.0 / model['std']).astype(np.float32),
+        'W1': W1q, 'b1': b1q, 'mult1': m1, 'shift1': s1, 'hidden_zp': -128,
+        'W2': W2q, 'b2': b2q, 'mult2': m2, 'shift2': s2, 'out_zp': 0, 'out_scale': out_scale,
+    }
+
+
+def _doubling_high_mult(a, b):
+    return (int(a) * int(b) + (1 << 30)) >> 31
+
+
+def _divide_by_power_of_two(x, exponent):
+    mask = (1 << exponent) - 1
+    result = x >> exponent
+    threshold = (mask >> 1) + (1 if result < 0 else 0)
+    return result + (1 if (x & mask) > threshold else 0)
+
+
+def requantize(acc, mult, shift):
+    """arm_nn_requantize"""
+    left = max(shift, 0)
+    right = max(-shift, 0)
+    return _divide_by_power_of_two(_doubling_high_mult(acc * (1 << left), mult), right)
+
+
+def _fully_connected(x, W, b, input_offset, mult, shift, out_offset, act_min, act_max):
+    out = np.zeros(W.shape[1], dtype=np.int8)
+    for o in range(W.shape[1]):
+        acc = int(b[o]) + sum((int(x[i]) + input_offset) * int(W[i, o]) for i in range(W.shape[0]))
+        out[o] = min(max(requantize(acc, mult, shift) + out_offset, act_min), act_max)
+    return out
+
+
+def quantize_inputs(qmodel, inputs):
+    z = (inputs - qmodel['mean']) * qmodel['inv_std']
+    return np.clip(np.round(z / INPUT_SCALE) + INPUT_ZERO_POINT, -128, 127).astype(np.int8)
+
+
+def mlp_int8_reference(qmodel, inputs):
+    """Probability of abnormal for one cycle, as computed on the patch."""
+    x = quantize_inputs(qmodel, inputs)
+    h = _fully_connected(x, qmodel['W1'], qmodel['b1'], -INPUT_ZERO_POINT,
+                         qmodel['mult1'], qmodel['shift1'], qmodel['hidden_zp'], -128, 127)
+    y = _fully_connected(h, qmodel['W2'], qmodel['b2'], -qmodel['hidden_zp'],
+                         qmodel['mult2'], qmodel['shift2'], qmodel['out_zp'], -128, 127)
+    margin = (int(y[1]) - int(y[0])) * qmodel['out_scale']
+    return 1.0 / (1.0 + np.exp(-margin))
+
+
+def _write_array(f, c_type, name, values, per_line=16):
+    f.write(f"static const {c_type} {name}[] = {{\n")
+    for i in range(0, len(values), per_line):
+        chunk = values[i:i + per_line]
+        if c_type == 'float':
+            f.write("    " + " ".join(f"{v:.8f}f," for v in chunk) + "\n")
+        else:
+            f.write("    " + " ".join(f"{int(v)}," for v in chunk) + "\n")
+    f.write("};\n\n")
+
+
+def is_trained_header(file_path):
+    """True if file_path holds exported weights that are not the placeholder."""
+    if not os.path.exists(file_path):
+        return False
+    with open(file_path) as f:
+        return "#define CLS_WEIGHTS_PLACEHOLDER 0" in f.read()
+
+
+def export_classifier_header(qmodel, file_path="classifier_weights.h", placeholder=False):
+    if placeholder and is_trained_header(file_path):
+        print(f"Trained classifier weights kept in: {file_path}")
+        return
+    os.makedirs(os.path.dirname(file_path) or ".", exist_ok=True)
+
+    with open(file_path, "w") as f:
+        f.write("// Auto-generated int8 MLP classifier weights, see python_dsp/src/classifier.py\n")
+        f.write("#ifndef CLASSIFIER_WEIGHTS_H\n#define CLASSIFIER_WEIGHTS_H\n\n")
+        f.write("#include <stdint.h>\n\n")
+        f.write(f"#define CLS_WEIGHTS_PLACEHOLDER {1 if placeholder else 0}\n")
+        f.write(f"#define CLS_NUM_INPUTS {NUM_INPUTS}\n")
+        f.write(f"#define CLS_NUM_HIDDEN {NUM_HIDDEN}\n")
+        f.write(f"#define CLS_NUM_OUTPUTS {NUM_OUTPUTS}\n\n")
+        f.write(f"#define CLS_INPUT_SCALE {INPUT_SCALE:.8f}f\n")
+        f.write(f"#define CLS_INPUT_ZERO_POINT {INPUT_ZERO_POINT}\n")
+        f.write(f"#define CLS_HIDDEN_ZERO_POINT {qmodel['hidden_zp']}\n")
+        f.write(f"#define CLS_OUTPUT_ZERO_POINT {qmodel['out_zp']}\n")
+        f.write(f"#define CLS_OUTPUT_SCALE {qmodel['out_scale']:.8f}f\n")
+        f.write(f"#define CLS_L1_MULTIPLIER {qmodel['mult1']}\n")
+        f.write(f"#define CLS_L1_SHIFT {qmodel['shift1']}\n")
+        f.write(f"#define CLS_L2_MULTIPLIER {qmodel['mult2']}\n")
+        f.write(f"#define CLS_L2_SHIFT {qmodel['shift2']}\n\n")
+        _write_array(f, 'float', 'cls_input_mean', list(qmodel['mean']), 4)
+        _write_array(f, 'float', 'cls_input_inv_std', list(qmodel['inv_std']), 4)
+        # Weights are stored output major ([out][in]) as CMSIS-NN expects
+        _write_array(f, 'int8_t', 'cls_l1_weights', list(np.asarray(qmodel['W1']).T.flatten()))
+        _write_array(f, 'int32_t', 'cls_l1_bias', list(qmodel['b1']), 8)
+        _write_array(f, 'int8_t', 'cls_l2_weights', list(np.asarray(qmodel['W2']).T.flatten()))
+        _write_array(f, 'int32_t', 'cls_l2_bias', list(qmodel['b2']), 8)
+        f.write("#endif\n")
+
+    print(f"Classifier weights written to: {file_path} ({NUM_INPUTS}-{NUM_HIDDEN}-{NUM_OUTPUTS})")
+
+
+def placeholder_model():
+    """All zero weights, always classifies normal. Stands in until a trained model is exported."""
+    return {
+        'mean': np.zeros(NUM_INPUTS, dtype=np.float32), 'inv_std': np.ones(NUM_INPUTS, dtype=np.float32),
+        'W1': np.zeros((NUM_INPUTS, NUM_HIDDEN), dtype=np.int8), 'b1': np.zeros(NUM_HIDDEN, dtype=np.int32),
+        'mult1': 1 << 30, 'shift1': 0, 'hidden_zp': -128,
+        'W2': np.zeros((NUM_HIDDEN, NUM_OUTPUTS), dtype=np.int8), 'b2': np.zeros(NUM_OUTPUTS, dtype=np.int32),
+        'mult2': 1 << 30, 'shift2': 0, 'out_zp': 0, 'out_scale': 1.0 / 16.0,
+    }
@@ -0,0 +1,155 @@
+import numpy as np
+from src.window_analysis import compute_energy_blocks, hard_limit
+from src.wavelet_segmentation import (WL_SYSTOLE_BASE_MS, WL_SYSTOLE_PER_BPM_MS, ste_segment, wavelet_segment,
+                                      compare_segmenters)
+
+# Host model of firmware/src/audio/dsp/hsmm.c, the same integer Viterbi so paths match the patch.
+# States cycle S1 -> systole -> S2 -> diastole over a 50hz envelope of the STE profile.
+
+S1, SYSTOLE, S2, DIASTOLE = range(4)
+NUM_STATES = 4
+
+HSMM_DECIMATION = 2
+HSMM_OBS_MS = 20
+HSMM_MAX_OBS = 128
+HSMM_MAX_DUR = 96
+HSMM_NUM_LEVELS = 16
+HSMM_LEVELS_PER_OCTAVE = 2
+HSMM_LOG_Q = 8
+HSMM_DUR_SIGMAS = 3
+LOG_MIN = -(1 << 30)
+DUR_NONE = None
+
+DEFAULT_CONFIG = {
+    'emission_mean': [1.5, -1.5, 1.0, -2.0],
+    'emission_sd': [1.2, 1.5, 1.2, 1.5],
+    's1_ms': 122, 's1_sd_ms': 22, 's2_ms': 92, 's2_sd_ms': 22,
+    'systole_sd_ms': 25, 'diastole_sd_r': 0.07, 'diastole_sd_ms': 6,
+}
+
+
+def emission_table(cfg=DEFAULT_CONFIG):
+    table = np.zeros((NUM_STATES, HSMM_NUM_LEVELS), dtype=np.int32)
+    for j in range(NUM_STATES):
+        sd = max(cfg['emission_sd'][j], 0.1)
+        for level in range(HSMM_NUM_LEVELS):
+            x = (level - HSMM_NUM_LEVELS // 2 + 0.5) / HSMM_LEVELS_PER_OCTAVE
+            z = (x - cfg['emission_mean'][j]) / sd
+            table[j, level] = max(int(np.round((-0.5 * z * z - np.log(sd)) * (1 << HSMM_LOG_Q))), -32767)
+    return table
+
+
+def _duration(mean_ms, sd_ms):
+    mean_q4 = max(int(mean_ms * 16 / HSMM_OBS_MS), 16)
+    sd_q4 = max(int(sd_ms * 16 / HSMM_OBS_MS), 8)
+    limit = HSMM_DUR_SIGMAS * HSMM_DUR_SIGMAS * sd_q4 * sd_q4
+    table = [DUR_NONE] * (HSMM_MAX_DUR + 1)
+    d_max = 0
+    for d in range(1, HSMM_MAX_DUR + 1):
+        diff = d * 16 - mean_q4
+        if diff * diff <= limit:
+            table[d] = -((diff * diff << HSMM_LOG_Q) // (2 * sd_q4 * sd_q4))
+            d_max = d
+    return table, mean_q4 // 16, d_max
+
+
+def duration_tables(period_ms, cfg=DEFAULT_CONFIG):
+    interval = WL_SYSTOLE_BASE_MS - WL_SYSTOLE_PER_BPM_MS * (60000.0 / period_ms)
+    interval = min(max(interval, 0.3 * period_ms), 0.5 * period_ms)
+    diastole = period_ms - interval - cfg['s2_ms']
+    return [_duration(cfg['s1_ms'], cfg['s1_sd_ms']),
+            _duration(interval - cfg['s1_ms'], cfg['systole_sd_ms']),
+            _duration(cfg['s2_ms'], cfg['s2_sd_ms']),
+            _duration(diastole, cfg['diastole_sd_r'] * diastole + cfg['diastole_sd_ms'])]
+
+
+def observations(ste):
+    mean = np.mean(ste)
+    n = (len(ste) + HSMM_DECIMATION - 1) // HSMM_DECIMATION
+    obs = np.zeros(n, dtype=np.int32)
+    for t in range(n):
+        env = np.mean(ste[t * HSMM_DECIMATION:(t + 1) * HSMM_DECIMATION]) / mean
+        if env > 0:
+            level = int(np.floor(HSMM_LEVELS_PER_OCTAVE * np.log2(env))) + HSMM_NUM_LEVELS // 2
+            obs[t] = min(max(level, 0), HSMM_NUM_LEVELS - 1)
+    return obs
+
+
+def viterbi(obs, durations, emissions):
+    """State of each observation, or None if no path fits the durations."""
+    n = len(obs)
+    cum = np.zeros((n + 1, NUM_STATES), dtype=np.int64)
+    cum[1:] = np.cumsum(emissions[:, obs].T, axis=0)
+    delta = np.full((n, NUM_STATES), LOG_MIN, dtype=np.int64)
+    best_dur = np.zeros((n, NUM_STATES), dtype=np.int32)
+
+    for t in range(n):
+        last = t == n - 1
+        for j in range(NUM_STATES):
+            prev = (j + NUM_STATES - 1) % NUM_STATES
+            table, mean, d_max = durations[j]
+            for d in range(1, min(d_max, t + 1) + 1):
+                first = d == t + 1
+                dur = 0 if (first or last) and d <= mean else table[d]
+                if dur is DUR_NONE:
+                    continue
+                start = 0 if first else delta[t - d, prev]
+                if start <= LOG_MIN:
+                    continue
+                score = start + dur + cum[t + 1, j] - cum[t + 1 - d, j]
+                if score > delta[t, j]:
+                    delta[t, j] = score
+                    best_dur[t, j] = d
+
+    j = int(np.argmax(delta[n - 1]))
+    if delta[n - 1, j] <= LOG_MIN:
+        return None
+    path = np.zeros(n, dtype=np.int32)
+    t = n - 1
+    while t >= 0:
+        d = best_dur[t, j]
+        path[t - d + 1:t + 1] = j
+        t -= d
+        j = (j + NUM_STATES - 1) % NUM_STATES
+    return path
+
+
+def hsmm_segment(window, fs=16000, s1_offset=0, ste_block_size=160, audio_hl_thresh=1.0 / 3.0, cfg=DEFAULT_CONFIG):
+    """S1 and S2 sample positions in the window, None where not found, as wa_hsmm_label."""
+    ste = compute_energy_blocks(hard_limit(window, audio_hl_thresh), samples_per_window=ste_block_size)
+    n = (len(ste) + HSMM_DECIMATION - 1) // HSMM_DECIMATION
+    if n < NUM_STATES or n > HSMM_MAX_OBS or np.mean(ste) <= 0:
+        return None, None
+    path = viterbi(observations(ste), duration_tables(len(window) * 1000.0 / fs, cfg), emission_table(cfg))
+    if path is None:
+        return None, None
+
+    sounds = []
+    t = 0
+    while t < n:
+        end = t
+        while end + 1 < n and path[end + 1] == path[t]:
+            end += 1
+        if path[t] in (S1, S2):
+            blocks = ste[t * HSMM_DECIMATION:(end + 1) * HSMM_DECIMATION]
+            k = t * HSMM_DECIMATION + int(np.argmax(blocks))
+            sounds.append((path[t], k * ste_block_size + ste_block_size // 2))
+        t = end + 1
+
+    s1s = [i for i, (state, _) in enumerate(sounds) if state == S1]
+    if not s1s:
+        return None, None
+    s1 = min(s1s, key=lambda i: abs(sounds[i][1] - s1_offset))
+    s2 = next((i for i in range(s1 + 1, len(sounds)) if sounds[i][0] == S2), None)
+    if s2 is None:
+        return None, None
+    return sounds[s1][1], sounds[s2][1]
+
+
+def compare_all(windows, annotations, fs=16000, tol_ms=50):
+    """STE, wavelet and HSMM segmenters on the same annotated windows, see compare_segmenters."""
+    return compare_segmenters(windows, annotations, fs, tol_ms, segmenters={
+        'ste': lambda w, o: ste_segment(w),
+        'wavelet': lambda w, o: wavelet_segment(w, fs, o),
+        'hsmm': lambda w, o: hsmm_segment(w, fs, o),
+    })
@@ -0,0 +1,147 @@
+import time
+import numpy as np
+from src.window_analysis import compute_energy_blocks, hard_limit, find_peaks_window, remove_close_peaks, label_S1_S2_by_fraction
+
+# Host model of the wavelet S1/S2 segmenter in firmware/src/audio/dsp/wavelet.c and
+# wa_wavelet_* in window_analysis.c, and a harness comparing it with the STE labeller.
+# The firmware runs the transform on a two tier window (decimated history, full rate tail),
+# here the window is full rate throughout, which gives the same 0-125Hz band.
+
+WL_LEVELS = 6
+WL_SMOOTH_LEN = 5
+WL_MIN_PEAK_GAP_MS = 100
+WL_SYSTOLE_BASE_MS = 496.0
+WL_SYSTOLE_PER_BPM_MS = 2.1
+
+
+def _sym(i, n):
+    return -i if i < 0 else (2 * (n - 1) - i if i >= n else i)
+
+
+def wl_forward(x, levels=WL_LEVELS):
+    """In place CDF 5/3 lifting, the level L approximation ends up at x[k << L]."""
+    x = np.array(x, dtype=np.float64)
+    n = len(x)
+    for level in range(levels):
+        stride = 1 << level
+        m = (n - 1) // stride + 1
+        if m < 2:
+            break
+        for i in range(1, m, 2):  # predict
+            x[i * stride] -= 0.5 * (x[(i - 1) * stride] + x[_sym(i + 1, m) * stride])
+        for i in range(0, m, 2):  # update
+            x[i * stride] += 0.25 * (x[_sym(i - 1, m) * stride] + x[_sym(i + 1, m) * stride])
+    return x
+
+
+def wl_inverse(x, levels=WL_LEVELS):
+    x = np.array(x, dtype=np.float64)
+    n = len(x)
+    for level in reversed(range(levels)):
+        stride = 1 << level
+        m = (n - 1) // stride + 1
+        if m < 2:
+            continue
+        for i in range(0, m, 2):
+            x[i * stride] -= 0.25 * (x[_sym(i - 1, m) * stride] + x[_sym(i + 1, m) * stride])
+        for i in range(1, m, 2):
+            x[i * stride] += 0.5 * (x[(i - 1) * stride] + x[_sym(i + 1, m) * stride])
+    return x
+
+
+def band_envelope(window, levels=WL_LEVELS):
+    """Smoothed energy of the approximation band, and the sample position of each value."""
+    approx = wl_forward(window, levels)[::1 << levels]
+    energy = np.convolve(approx ** 2, np.ones(WL_SMOOTH_LEN) / WL_SMOOTH_LEN, mode='valid')
+    pos = (np.arange(len(energy)) + WL_SMOOTH_LEN // 2) << levels
+    return energy, pos
+
+
+def wavelet_find_peaks(window, fs=16000, thresh_scale=1.0, levels=WL_LEVELS):
+    energy, pos = band_envelope(window, levels)
+    if len(energy) < 3 or energy.mean() <= 0:
+        return []
+    threshold = energy.mean() * thresh_scale
+    min_gap = WL_MIN_PEAK_GAP_MS * fs // 1000
+    peaks = []
+    for i in range(1, len(energy) - 1):
+        if energy[i] > threshold and energy[i] > energy[i - 1] and energy[i] >= energy[i + 1]:
+            if peaks and pos[i] - peaks[-1]['pos'] < min_gap:
+                if energy[i] > peaks[-1]['value']:
+                    peaks[-1].update(pos=int(pos[i]), value=energy[i])
+            else:
+                peaks.append({'pos': int(pos[i]), 'value': energy[i], 'type': 'candidate'})
+    return peaks
+
+
+def wavelet_label(peaks, window_len, s1_offset=0, fs=16000, s1_search_ms=100, s2_tol=0.3):
+    search = s1_search_ms * fs // 1000
+    near = [i for i, p in enumerate(peaks) if abs(p['pos'] - s1_offset) <= search]
+    s1 = max(near, key=lambda i: peaks[i]['value']) if near else None
+    s2 = None
+    if s1 is not None:
+        period_ms = window_len * 1000.0 / fs
+        systole_ms = WL_SYSTOLE_BASE_MS - WL_SYSTOLE_PER_BPM_MS * (60000.0 / period_ms)
+        systole_ms = min(max(systole_ms, 0.3 * period_ms), 0.5 * period_ms)
+        expected = systole_ms * fs / 1000.0
+        later = [i for i in range(s1 + 1, len(peaks))
+                 if abs(peaks[i]['pos'] - peaks[s1]['pos'] - expected) <= s2_tol * expected]
+        s2 = max(later, key=lambda i: peaks[i]['value']) if later else None
+    for i, p in enumerate(peaks):
+        p['type'] = 'S1' if (i == s1 and s2 is not None) else ('S2' if i == s2 else 'other')
+    return peaks
+
+
+def wavelet_segment(window, fs=16000, s1_offset=0, thresh_scale=1.0, s1_search_ms=100, s2_tol=0.3):
+    """S1 and S2 sample positions in the window, None where not found."""
+    peaks = wavelet_label(wavelet_find_peaks(window, fs, thresh_scale), len(window), s1_offset, fs, s1_search_ms, s2_tol)
+    return _positions(peaks)
+
+
+def ste_segment(window, ste_block_size=160, audio_hl_thresh=1.0 / 3.0, ste_hl_thresh=0.4,
+                peak_thresh=0.7, c_rmvl_r=0.2, reject_s1_r=0.3, cls_r=0.29, cls_tol=0.15):
+    """The firmware's default STE path, positions at the centre of the STE block."""
+    ste = compute_energy_blocks(hard_limit(window, audio_hl_thresh), samples_per_window=ste_block_size)
+    peaks = find_peaks_window(hard_limit(ste, ste_hl_thresh), np.mean(ste), peak_thresh, 1)
+    peaks = remove_close_peaks(peaks, c_rmvl_r, len(ste))
+    peaks = label_S1_S2_by_fraction(peaks, len(ste), reject_s1_r, cls_r, cls_tol)
+    for p in peaks:
+        p['pos'] = p['ste_index'] * ste_block_size + ste_block_size // 2
+    return _positions(peaks)
+
+
+def _positions(peaks):
+    s1 = next((p['pos'] for p in peaks if p['type'] == 'S1'), None)
+    s2 = next((p['pos'] for p in peaks if p['type'] == 'S2'), None)
+    return s1, s2
+
+
+def compare_segmenters(windows, annotations, fs=16000, tol_ms=50, segmenters=None):
+    """Accuracy and run time of the segmenters over annotated windows.
+
+    windows: list of (audio, s1_offset), one cardiac period each
+    annotations: list of (s1, s2) reference sample positions within the window
+    segmenters: name -> fn(audio, s1_offset) returning (s1, s2), STE and wavelet by default
+    A sound counts as found when it is labelled within tol_ms of the annotation.
+    """
+    if segmenters is None:
+        segmenters = {'ste': lambda w, o: ste_segment(w),
+                      'wavelet': lambda w, o: wavelet_segment(w, fs, o)}
+    tol = tol_ms * fs // 1000
+    results = {}
+    for name, fn in segmenters.items():
+        hits = [0, 0]
+        elapsed = 0.0
+        for (audio, s1_offset), ref in zip(windows, annotations):
+            start = time.perf_counter()
+            found = fn(audio, s1_offset)
+            elapsed += time.perf_counter() - start
+            for k in range(2):
+                if found[k] is not None and ref[k] is not None and abs(found[k] - ref[k]) <= tol:
+                    hits[k] += 1
+        n = max(len(windows), 1)
+        results[name] = {'s1_acc': hits[0] / n, 's2_acc': hits[1] / n, 'ms_per_window': 1000.0 * elapsed / n}
+
+    for name, r in results.items():
+        print(f"{name:8s} S1 {100 * r['s1_acc']:.1f}%  S2 {100 * r['s2_acc']:.1f}%  {r['ms_per_window']:.2f} ms/window")
+    return results